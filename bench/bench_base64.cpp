@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/base64.h"
+
+
+typedef std::chrono::high_resolution_clock Clock;
+
+
+// Pulls the text of the first <data> node out of a tmx file.
+static std::string loadLayerPayload(const std::string& fileName)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	std::stringstream ss;
+	ss << file.rdbuf();
+	std::string xml = ss.str();
+
+	size_t start = xml.find("<data");
+	if (start == std::string::npos)
+	{
+		return std::string();
+	}
+
+	start = xml.find('>', start) + 1;
+	size_t end = xml.find("</data>", start);
+	return xml.substr(start, end - start);
+}
+
+
+// What _parseLayerDataNode has been doing: strip whitespace, then decode.
+static std::string decodeLegacy(const std::string& payload)
+{
+	std::string text = payload;
+	text.erase(std::remove(text.begin(), text.end(), '\n'), text.end());
+	text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+	text.erase(std::remove(text.begin(), text.end(), ' '), text.end());
+	return base64_decode(text);
+}
+
+
+static size_t decodeBuffer(const std::string& payload, std::vector<unsigned char>& out)
+{
+	return base64_decode(payload.data(), payload.size(), out.data(), out.size());
+}
+
+
+static void run(const char* label, const std::string& payload, int iterations)
+{
+	std::vector<unsigned char> out(base64_decoded_length(payload.size()));
+
+	std::string reference = decodeLegacy(payload);
+	size_t written = decodeBuffer(payload, out);
+	if (written != reference.size() || !std::equal(reference.begin(), reference.end(), out.begin()))
+	{
+		printf("%s: decoders disagree!\n", label);
+		return;
+	}
+
+	size_t sink = 0;
+
+	Clock::time_point t0 = Clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		sink += decodeLegacy(payload).size();
+	}
+	Clock::time_point t1 = Clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		sink += decodeBuffer(payload, out);
+	}
+	Clock::time_point t2 = Clock::now();
+
+	double legacy = std::chrono::duration<double>(t1 - t0).count();
+	double buffer = std::chrono::duration<double>(t2 - t1).count();
+	double mb = (double)payload.size() * iterations / (1024.0 * 1024.0);
+
+	printf("%s (%zu chars x %d)\n", label, payload.size(), iterations);
+	printf("    legacy:  %8.3f ms  %8.1f MB/s\n", legacy * 1000.0, mb / legacy);
+	printf("    buffer:  %8.3f ms  %8.1f MB/s  (%.1fx)\n", buffer * 1000.0, mb / buffer, legacy / buffer);
+	printf("    [%zu]\n", sink);
+}
+
+
+int main()
+{
+	std::string payload = loadLayerPayload("../test_files/test_base64_level.tmx");
+	if (payload.empty())
+	{
+		printf("Cannot read ../test_files/test_base64_level.tmx\n");
+		return 1;
+	}
+
+	run("test_base64_level.tmx", payload, 100000);
+
+	// tile the real layer out to a 2048x2048 map, formatted the way tiled writes it
+	std::string gids = decodeLegacy(payload);
+	std::string big;
+	big.reserve(2048 * 2048 * 4);
+	while (big.size() < 2048 * 2048 * 4)
+	{
+		big += gids;
+	}
+	big.resize(2048 * 2048 * 4);
+
+	std::string bigPayload = "\n   " + base64_encode((const unsigned char*)big.data(), big.size()) + "\n  ";
+	run("2048x2048 layer", bigPayload, 10);
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../src/tmxparser.h"
+
+
+typedef std::chrono::high_resolution_clock Clock;
+
+
+// The per tile linear search _calculateTileIndices used to do.
+static void resolveLinear(const tmxparser::TmxTilesetCollection_t& tilesets, tmxparser::TmxLayerTile* outTile)
+{
+	outTile->tilesetIndex = 0;
+	outTile->tileFlatIndex = 0;
+
+	if (outTile->gid == 0)
+	{
+		return;
+	}
+
+	unsigned int index = 0;
+	unsigned int lastEndIndex = 1;
+	for (auto it = tilesets.begin(); it != tilesets.end(); ++it)
+	{
+		unsigned int startIndex = it->firstgid;
+		unsigned int endIndex = it->firstgid + (it->colCount * it->rowCount);
+
+		if (outTile->gid >= startIndex && outTile->gid < endIndex)
+		{
+			outTile->tilesetIndex = index;
+			outTile->tileFlatIndex = outTile->gid - lastEndIndex;
+			return;
+		}
+
+		lastEndIndex = endIndex;
+		index++;
+	}
+}
+
+
+static void run(unsigned int tilesetCount, unsigned int layerSize)
+{
+	tmxparser::TmxTilesetCollection_t tilesets(tilesetCount);
+	unsigned int firstgid = 1;
+	for (unsigned int i = 0; i < tilesetCount; i++)
+	{
+		tilesets[i].firstgid = firstgid;
+		tilesets[i].colCount = 32;
+		tilesets[i].rowCount = 32;
+		firstgid += 32 * 32;
+	}
+
+	tmxparser::TmxLayerTileCollection_t tiles(layerSize * layerSize);
+	srand(1234);
+	for (auto it = tiles.begin(); it != tiles.end(); ++it)
+	{
+		it->gid = (rand() % 4 == 0) ? 0 : (unsigned int)(rand() % firstgid);
+	}
+	tmxparser::TmxLayerTileCollection_t reference = tiles;
+	std::vector<unsigned int> gids(tiles.size());
+	for (size_t i = 0; i < tiles.size(); i++)
+	{
+		gids[i] = tiles[i].gid;
+	}
+	tmxparser::TmxLayerTileCollection_t batchTiles(tiles.size());
+
+	Clock::time_point t0 = Clock::now();
+	for (auto it = reference.begin(); it != reference.end(); ++it)
+	{
+		resolveLinear(tilesets, &(*it));
+	}
+
+	Clock::time_point t1 = Clock::now();
+	tmxparser::TmxTilesetLookup lookup;
+	tmxparser::buildTilesetLookup(tilesets, &lookup);
+
+	Clock::time_point t2 = Clock::now();
+	tmxparser::resolveTileIndices(lookup, tiles.data(), tiles.size());
+
+	Clock::time_point t3 = Clock::now();
+	tmxparser::resolveLayerGids(lookup, gids.data(), gids.size(), batchTiles.data());
+
+	Clock::time_point t4 = Clock::now();
+
+	for (size_t i = 0; i < tiles.size(); i++)
+	{
+		if (tiles[i].tilesetIndex != reference[i].tilesetIndex || tiles[i].tileFlatIndex != reference[i].tileFlatIndex ||
+			batchTiles[i].tilesetIndex != reference[i].tilesetIndex || batchTiles[i].tileFlatIndex != reference[i].tileFlatIndex)
+		{
+			printf("mismatch at tile %zu\n", i);
+			return;
+		}
+	}
+
+	printf("%u tilesets, %ux%u layer\n", tilesetCount, layerSize, layerSize);
+	printf("    linear:  %8.3f ms\n", std::chrono::duration<double>(t1 - t0).count() * 1000.0);
+	printf("    build:   %8.3f ms\n", std::chrono::duration<double>(t2 - t1).count() * 1000.0);
+	printf("    lookup:  %8.3f ms\n", std::chrono::duration<double>(t3 - t2).count() * 1000.0);
+	printf("    batch:   %8.3f ms\n", std::chrono::duration<double>(t4 - t3).count() * 1000.0);
+}
+
+
+int main()
+{
+	run(3, 2048);
+	run(30, 2048);
+	run(60, 2048);
+	return 0;
+}
@@ -22,7 +22,31 @@ void printProperties(int depth, const tmxparser::TmxPropertyMap_t& map)
 	printf_depth(depth, "%s", "<properties>");
 	for (auto it = map.begin(); it != map.end(); ++it)
 	{
-		printf_depth(depth+1, "%s=%s", it->first.c_str(), it->second.c_str());
+		const char* name = tmxparser::getInternedString(it->name);
+		switch (it->type)
+		{
+			case tmxparser::kPropertyInt:
+				printf_depth(depth+1, "%s=%d (int)", name, it->intValue);
+				break;
+			case tmxparser::kPropertyFloat:
+				printf_depth(depth+1, "%s=%f (float)", name, it->floatValue);
+				break;
+			case tmxparser::kPropertyBool:
+				printf_depth(depth+1, "%s=%s (bool)", name, it->boolValue ? "true" : "false");
+				break;
+			case tmxparser::kPropertyColor:
+				printf_depth(depth+1, "%s=0x%08x (color)", name, it->colorValue);
+				break;
+			case tmxparser::kPropertyFile:
+				printf_depth(depth+1, "%s=%s (file)", name, it->value.c_str());
+				break;
+			case tmxparser::kPropertyObject:
+				printf_depth(depth+1, "%s=%u (object)", name, it->objectId);
+				break;
+			default:
+				printf_depth(depth+1, "%s=%s", name, it->value.c_str());
+				break;
+		}
 	}
 }
 
@@ -35,8 +59,8 @@ void printObjects(int depth, const tmxparser::TmxObjectCollection_t& collection)
 	{
 		printf_depth(depth, "%s", "<object>");
 
-		printf_depth(nextdepth, "Name: %s", it->name.c_str());
-		printf_depth(nextdepth, "Type: %s", it->type.c_str());
+		printf_depth(nextdepth, "Name: %s", tmxparser::getInternedString(it->name));
+		printf_depth(nextdepth, "Type: %s", tmxparser::getInternedString(it->type));
 		printf_depth(nextdepth, "x: %f", it->x);
 		printf_depth(nextdepth, "y: %f", it->y);
 		printf_depth(nextdepth, "width: %f", it->width);
@@ -164,6 +188,16 @@ void printLayers(int depth, const tmxparser::TmxLayerCollection_t& collection)
 		printf_depth(nextdepth, "Visible: %u", (*it).visible);
 		printProperties(nextdepth+1, it->propertyMap);
 		printLayerTiles(nextdepth+1, it->tiles);
+
+		for (auto chunk = it->chunks.begin(); chunk != it->chunks.end(); ++chunk)
+		{
+			printf_depth(nextdepth+1, "%s", "<chunk>");
+			printf_depth(nextdepth+2, "X: %d", chunk->x);
+			printf_depth(nextdepth+2, "Y: %d", chunk->y);
+			printf_depth(nextdepth+2, "Width: %u", chunk->width);
+			printf_depth(nextdepth+2, "Height: %u", chunk->height);
+			printLayerTiles(nextdepth+3, chunk->tiles);
+		}
 	}
 }
 
@@ -23,11 +23,21 @@
 
    René Nyffenegger rene.nyffenegger@adp-gmbh.ch
 
+   This is an altered version: a table driven, buffer based decoder with
+   SSE4.1/AVX2 block kernels has been added for libtmx-parser.
+
 */
 
 #include "base64.h"
 #include <iostream>
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86_DISPATCH 1
+#include <immintrin.h>
+#else
+#define BASE64_X86_DISPATCH 0
+#endif
+
 static const std::string base64_chars =
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
              "abcdefghijklmnopqrstuvwxyz"
@@ -121,3 +131,238 @@ std::string base64_decode(std::string const& encoded_string) {
 
   return ret;
 }
+
+
+// Decoder table: sextet values, or one of the markers below.
+#define BASE64_WS 0xfe
+#define BASE64_PAD 0xfd
+#define BASE64_BAD 0xff
+
+static const unsigned char base64_decode_table[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0xfe, 0xff, 0xff, 0xfe, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff,
+  0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+  0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+typedef void (*base64_block_decoder_t)(const unsigned char*& src, const unsigned char* srcEnd, unsigned char*& dst, const unsigned char* dstEnd);
+
+// Decodes whole quartets that contain no whitespace, padding or invalid chars.
+static void base64_decode_blocks_scalar(const unsigned char*& src, const unsigned char* srcEnd, unsigned char*& dst, const unsigned char* dstEnd) {
+  while (srcEnd - src >= 4 && dstEnd - dst >= 3) {
+    unsigned int a = base64_decode_table[src[0]];
+    unsigned int b = base64_decode_table[src[1]];
+    unsigned int c = base64_decode_table[src[2]];
+    unsigned int d = base64_decode_table[src[3]];
+    if ((a | b | c | d) & 0xc0)
+      break;
+
+    unsigned int triple = (a << 18) | (b << 12) | (c << 6) | d;
+    dst[0] = (unsigned char)(triple >> 16);
+    dst[1] = (unsigned char)(triple >> 8);
+    dst[2] = (unsigned char)triple;
+    src += 4;
+    dst += 3;
+  }
+}
+
+#if BASE64_X86_DISPATCH
+
+// Vector kernels after Wojciech Muła and Daniel Lemire, "Faster Base64
+// Encoding and Decoding using AVX2 Instructions".  A block is only decoded
+// when all of its characters are valid, anything else is left to the scalar
+// code, which then hands control back at the next quartet.
+
+__attribute__((target("ssse3,sse4.1")))
+static void base64_decode_blocks_sse41(const unsigned char*& src, const unsigned char* srcEnd, unsigned char*& dst, const unsigned char* dstEnd) {
+  const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                        0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+  const __m128i slash = _mm_set1_epi8(0x2f);
+
+  while (srcEnd - src >= 16 && dstEnd - dst >= 16) {
+    __m128i str = _mm_loadu_si128((const __m128i*)src);
+    __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), nibbleMask);
+    __m128i loNibbles = _mm_and_si128(str, nibbleMask);
+    __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+    __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+    if (!_mm_testz_si128(lo, hi))
+      break;
+
+    __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(str, slash), hiNibbles));
+    str = _mm_add_epi8(str, roll);
+    str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+    str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+    str = _mm_shuffle_epi8(str, pack);
+
+    _mm_storeu_si128((__m128i*)dst, str);
+    src += 16;
+    dst += 12;
+  }
+
+  base64_decode_blocks_scalar(src, (srcEnd - src > 16) ? src + 16 : srcEnd, dst, dstEnd);
+}
+
+__attribute__((target("avx2")))
+static void base64_decode_blocks_avx2(const unsigned char*& src, const unsigned char* srcEnd, unsigned char*& dst, const unsigned char* dstEnd) {
+  const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                         0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0,
+                                           0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  const __m256i nibbleMask = _mm256_set1_epi8(0x0f);
+  const __m256i slash = _mm256_set1_epi8(0x2f);
+
+  while (srcEnd - src >= 32 && dstEnd - dst >= 32) {
+    __m256i str = _mm256_loadu_si256((const __m256i*)src);
+    __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), nibbleMask);
+    __m256i loNibbles = _mm256_and_si256(str, nibbleMask);
+    __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+    __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+    if (!_mm256_testz_si256(lo, hi))
+      break;
+
+    __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, slash), hiNibbles));
+    str = _mm256_add_epi8(str, roll);
+    str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+    str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+    str = _mm256_shuffle_epi8(str, pack);
+    str = _mm256_permutevar8x32_epi32(str, lanes);
+
+    _mm256_storeu_si256((__m256i*)dst, str);
+    src += 32;
+    dst += 24;
+  }
+
+  base64_decode_blocks_scalar(src, (srcEnd - src > 32) ? src + 32 : srcEnd, dst, dstEnd);
+}
+
+#endif
+
+static base64_block_decoder_t base64_select_block_decoder() {
+#if BASE64_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return base64_decode_blocks_avx2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return base64_decode_blocks_sse41;
+#endif
+  return base64_decode_blocks_scalar;
+}
+
+#define BASE64_QUARTET_MORE   0
+#define BASE64_QUARTET_END    1
+#define BASE64_QUARTET_FULL   2
+#define BASE64_QUARTET_ERROR  3
+
+// Slow path, decodes a single quartet while skipping whitespace and
+// handling padding, unpadded tails and a full output buffer.
+static int base64_decode_quartet(const unsigned char*& src, const unsigned char* srcEnd, unsigned char*& dst, const unsigned char* dstEnd) {
+  const unsigned char* p = src;
+  unsigned int sextets[4] = { 0, 0, 0, 0 };
+  int count = 0;
+  bool padded = false;
+
+  while (p < srcEnd && count < 4) {
+    unsigned char v = base64_decode_table[*p];
+    if (v < 64) {
+      sextets[count++] = v;
+    }
+    else if (v == BASE64_PAD) {
+      padded = true;
+      break;
+    }
+    else if (v != BASE64_WS) {
+      return BASE64_QUARTET_ERROR;
+    }
+    p++;
+  }
+
+  if (count == 0 && !padded) {
+    src = p;
+    return BASE64_QUARTET_END;
+  }
+
+  if (count == 1 || (padded && count == 0))
+    return BASE64_QUARTET_ERROR;
+
+  int bytes = (count == 4) ? 3 : count - 1;
+  if (dstEnd - dst < bytes)
+    return BASE64_QUARTET_FULL;
+
+  unsigned int triple = (sextets[0] << 18) | (sextets[1] << 12) | (sextets[2] << 6) | sextets[3];
+  dst[0] = (unsigned char)(triple >> 16);
+  if (bytes > 1) dst[1] = (unsigned char)(triple >> 8);
+  if (bytes > 2) dst[2] = (unsigned char)triple;
+  dst += bytes;
+
+  if (count == 4) {
+    src = p;
+    return BASE64_QUARTET_MORE;
+  }
+
+  // short quartet, only padding and whitespace may follow
+  while (p < srcEnd) {
+    unsigned char v = base64_decode_table[*p];
+    if (v != BASE64_PAD && v != BASE64_WS)
+      return BASE64_QUARTET_ERROR;
+    p++;
+  }
+
+  src = p;
+  return BASE64_QUARTET_END;
+}
+
+size_t base64_decoded_length(size_t inLength) {
+  return ((inLength + 3) / 4) * 3;
+}
+
+size_t base64_decode(const char* in, size_t inLength, unsigned char* out, size_t outCapacity, size_t* inConsumed) {
+  static const base64_block_decoder_t decodeBlocks = base64_select_block_decoder();
+
+  const unsigned char* src = (const unsigned char*)in;
+  const unsigned char* srcEnd = src + inLength;
+  unsigned char* dst = out;
+  const unsigned char* dstEnd = out + outCapacity;
+
+  int status = BASE64_QUARTET_MORE;
+  while (status == BASE64_QUARTET_MORE) {
+    decodeBlocks(src, srcEnd, dst, dstEnd);
+    status = base64_decode_quartet(src, srcEnd, dst, dstEnd);
+  }
+
+  if (status == BASE64_QUARTET_ERROR)
+    return BASE64_DECODE_ERROR;
+
+  if (inConsumed)
+    *inConsumed = src - (const unsigned char*)in;
+
+  return dst - out;
+}
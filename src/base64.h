@@ -23,13 +23,42 @@
 
    René Nyffenegger rene.nyffenegger@adp-gmbh.ch
 
+   This is an altered version: a table driven, buffer based decoder with
+   SSE4.1/AVX2 block kernels has been added for libtmx-parser.
+
 */
 #ifndef SRC_BASE64_H_
 #define SRC_BASE64_H_
 
+#include <cstddef>
 #include <string>
 
+#define BASE64_DECODE_ERROR ((size_t)-1)
+
 std::string base64_encode(unsigned char const* , unsigned int len);
 std::string base64_decode(std::string const& s);
 
+/**
+ * Upper bound of the decoded size of inLength characters of base64 text.
+ */
+size_t base64_decoded_length(size_t inLength);
+
+/**
+ * Decodes base64 text into a caller provided buffer.  Whitespace is skipped
+ * as it is read, so tiled layer text can be passed in untouched.
+ *
+ * Decoding stops at the end of the input, after padding, or once the next
+ * group of 3 bytes no longer fits into the output buffer.  In the last case
+ * call again with the remaining input to continue, outCapacity must be at
+ * least 3 for that to make progress.
+ *
+ * @param in            base64 text, does not need to be null terminated
+ * @param inLength      number of characters in the text
+ * @param out           output buffer
+ * @param outCapacity   size of the output buffer in bytes
+ * @param inConsumed    optional, receives the number of characters consumed
+ * @return number of bytes written, or BASE64_DECODE_ERROR on malformed input
+ */
+size_t base64_decode(const char* in, size_t inLength, unsigned char* out, size_t outCapacity, size_t* inConsumed = NULL);
+
 #endif /* SRC_BASE64_H_ */
@@ -28,8 +28,13 @@
  */
 
 #include <zlib.h>
+#define ZSTD_STATIC_LINKING_ONLY // ZSTD_createDCtx_advanced, only called once setAllocator installed hooks
 #include <zstd.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
 #include "compression.h"
 
 #define QUOTEME_(x) #x
@@ -60,73 +65,210 @@ std::vector<char> decompress(const std::string &data,
                              int length,
                              CompressionMethod method)
 {
-	std::vector<char> out(length);
 	std::vector<char> emptyVector;
-	if (data.empty())
+	if (data.empty() || length <= 0)
 		return emptyVector;
 
-	if (method == Zlib || method == Gzip) {
-		z_stream strm;
+	Decompressor decompressor;
+	if (!decompressor.begin(method))
+		return emptyVector;
+	decompressor.setInput(data.data(), data.size());
 
-		strm.zalloc = Z_NULL;
-		strm.zfree = Z_NULL;
-		strm.opaque = Z_NULL;
-		strm.next_in = (Bytef *) data.data();
-		strm.avail_in = data.length();
-		strm.next_out = (Bytef *) out.data();
-		strm.avail_out = out.size();
+	// length comes from the file, so it only caps the output. The buffer grows
+	// with what actually decompresses, a bogus length costs nothing up front.
+	std::vector<char> out;
+	size_t outLength = 0;
+	while (!decompressor.finished()) {
+		if (outLength == out.size()) {
+			if (out.size() >= (size_t)length) {
+				LOGE("Uncompressed data is larger than expected!");
+				return emptyVector;
+			}
+			size_t grown = std::max(out.size() * 2, data.size() * 4);
+			out.resize(std::min(grown, (size_t)length));
+		}
 
-		int ret = inflateInit2(&strm, 15 + 32);
+		int inflated = decompressor.decompress(out.data() + outLength, out.size() - outLength);
+		if (inflated < 0)
+			return emptyVector;
 
-		if (ret != Z_OK) {
-			logZlibError(ret);
+		if (inflated == 0 && decompressor.inputConsumed() && !decompressor.finished()) {
+			LOGE("Compressed data is truncated!");
 			return emptyVector;
 		}
+		outLength += inflated;
+	}
 
-		do {
-			ret = inflate(&strm, Z_SYNC_FLUSH);
-//			assert(ret != Z_STREAM_ERROR);
-
-			switch (ret) {
-				case Z_NEED_DICT:
-					ret = Z_DATA_ERROR;
-				case Z_DATA_ERROR:
-				case Z_MEM_ERROR:
-					inflateEnd(&strm);
-					logZlibError(ret);
-					return emptyVector;
-			}
+	if (!decompressor.inputConsumed()) {
+		logZlibError(Z_DATA_ERROR);
+		return emptyVector;
+	}
 
-			if (ret != Z_STREAM_END) {
-				int oldSize = out.size();
-				out.resize(oldSize * 2);
+	out.resize(outLength);
+	return out;
+}
 
-				strm.next_out = (Bytef *)(out.data() + oldSize);
-				strm.avail_out = oldSize;
-			}
+
+Decompressor::Decompressor()
+	: mMethod(Zlib)
+	, mFinished(false)
+	, mZlibStream(NULL)
+	, mZstdContext(NULL)
+	, mInput(NULL)
+	, mInputLength(0)
+	, mInputPos(0)
+	, mAlloc(NULL)
+	, mFree(NULL)
+	, mOpaque(NULL)
+{
+}
+
+Decompressor::~Decompressor()
+{
+	release();
+}
+
+void Decompressor::release()
+{
+	if (mZlibStream) {
+		inflateEnd(mZlibStream);
+		delete mZlibStream;
+		mZlibStream = NULL;
+	}
+
+	if (mZstdContext) {
+		ZSTD_freeDCtx(mZstdContext);
+		mZstdContext = NULL;
+	}
+}
+
+void *Decompressor::zlibAlloc(void *opaque, unsigned int items, unsigned int size)
+{
+	Decompressor *decompressor = (Decompressor *) opaque;
+	return decompressor->mAlloc(decompressor->mOpaque, (size_t) items * size);
+}
+
+void Decompressor::zlibFree(void *opaque, void *address)
+{
+	Decompressor *decompressor = (Decompressor *) opaque;
+	decompressor->mFree(decompressor->mOpaque, address);
+}
+
+void Decompressor::setAllocator(DecompressorAlloc alloc, DecompressorFree free, void *opaque)
+{
+	release();
+	mAlloc = alloc;
+	mFree = free;
+	mOpaque = opaque;
+}
+
+bool Decompressor::begin(CompressionMethod method)
+{
+	mMethod = method;
+	mFinished = false;
+	setInput(NULL, 0);
+
+	if (method == Zlib || method == Gzip) {
+		if (mZlibStream)
+			return inflateReset(mZlibStream) == Z_OK;
+
+		mZlibStream = new z_stream;
+		memset(mZlibStream, 0, sizeof(z_stream));
+		mZlibStream->zalloc = mAlloc ? zlibAlloc : Z_NULL;
+		mZlibStream->zfree = mAlloc ? zlibFree : Z_NULL;
+		mZlibStream->opaque = mAlloc ? this : Z_NULL;
+
+		int ret = inflateInit2(mZlibStream, 15 + 32);
+		if (ret != Z_OK) {
+			logZlibError(ret);
+			delete mZlibStream;
+			mZlibStream = NULL;
+			return false;
 		}
-		while (ret != Z_STREAM_END);
+		return true;
+	} else if (method == Zstandard) {
+		if (mZstdContext)
+			return !ZSTD_isError(ZSTD_DCtx_reset(mZstdContext, ZSTD_reset_session_only));
 
-		if (strm.avail_in != 0) {
-			logZlibError(Z_DATA_ERROR);
-			return emptyVector;
+		if (mAlloc) {
+			ZSTD_customMem customMem = { mAlloc, mFree, mOpaque };
+			mZstdContext = ZSTD_createDCtx_advanced(customMem);
+		} else {
+			mZstdContext = ZSTD_createDCtx();
 		}
+		return mZstdContext != NULL;
+	}
 
-		const int outLength = out.size() - strm.avail_out;
-		inflateEnd(&strm);
+	LOGE("compression method not supported: %d", method);
+	return false;
+}
 
-		out.resize(outLength);
-		return out;
-	} else if (method == Zstandard) {
-		size_t const dSize = ZSTD_decompress(out.data(), out.size(), data.data(), data.size());
-		if (ZSTD_isError(dSize)) {
-			LOGE("error decoding: %s", ZSTD_getErrorName(dSize));
-			return emptyVector;
+void Decompressor::setInput(const void *data, size_t length)
+{
+	mInput = data;
+	mInputLength = length;
+	mInputPos = 0;
+
+	if (mZlibStream && (mMethod == Zlib || mMethod == Gzip)) {
+		mZlibStream->next_in = (Bytef *) data;
+		mZlibStream->avail_in = length;
+	}
+}
+
+bool Decompressor::inputConsumed() const
+{
+	if (mMethod == Zlib || mMethod == Gzip)
+		return mZlibStream == NULL || mZlibStream->avail_in == 0;
+
+	return mInputPos >= mInputLength;
+}
+
+int Decompressor::decompress(void *out, size_t capacity)
+{
+	if (mFinished || capacity == 0)
+		return 0;
+
+	if (mMethod == Zlib || mMethod == Gzip) {
+		if (!mZlibStream)
+			return -1;
+
+		mZlibStream->next_out = (Bytef *) out;
+		mZlibStream->avail_out = capacity;
+
+		int ret = inflate(mZlibStream, Z_SYNC_FLUSH);
+		if (ret == Z_NEED_DICT)
+			ret = Z_DATA_ERROR; // layer data never comes with a dictionary
+		switch (ret) {
+			case Z_DATA_ERROR:
+			case Z_MEM_ERROR:
+			case Z_STREAM_ERROR:
+				logZlibError(ret);
+				return -1;
+			case Z_STREAM_END:
+				mFinished = true;
+				break;
 		}
-		out.resize(dSize);
-		return out;
-	} else {
-		LOGE("compression method not supported: %d", method);
-		return emptyVector;
+
+		return capacity - mZlibStream->avail_out;
+	} else if (mMethod == Zstandard) {
+		if (!mZstdContext)
+			return -1;
+
+		ZSTD_inBuffer input = { mInput, mInputLength, mInputPos };
+		ZSTD_outBuffer output = { out, capacity, 0 };
+
+		size_t const ret = ZSTD_decompressStream(mZstdContext, &output, &input);
+		if (ZSTD_isError(ret)) {
+			LOGE("error decoding: %s", ZSTD_getErrorName(ret));
+			return -1;
+		}
+
+		mInputPos = input.pos;
+		if (ret == 0)
+			mFinished = true;
+
+		return output.pos;
 	}
+
+	return -1;
 }
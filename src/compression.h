@@ -30,6 +30,7 @@
 #ifndef SRC_COMPRESSION_H_
 #define SRC_COMPRESSION_H_
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -44,10 +45,80 @@ enum CompressionMethod {
  * if decompressing failed.
  *
  * @param data         the compressed data
- * @param length       the expected size of the uncompressed data in bytes
+ * @param length       the expected size of the uncompressed data in bytes.
+ *                     Only a limit, the output grows with what actually
+ *                     decompresses and data larger than this fails.
  * @param method       the compression method
  * @return the uncompressed data, or an empty string if decompressing failed
  */
 std::vector<char> decompress(const std::string &data, int length, CompressionMethod method = Zlib);
 
+struct z_stream_s;
+struct ZSTD_DCtx_s;
+
+/**
+ * Memory functions for the state of the zlib and zstd streams. alloc returns
+ * NULL when out of memory, which fails the stream.
+ */
+typedef void *(*DecompressorAlloc)(void *opaque, size_t size);
+typedef void (*DecompressorFree)(void *opaque, void *address);
+
+/**
+ * Incremental decompressor. Compressed input is handed over in pieces with
+ * setInput() and drained into caller provided buffers with decompress(), so
+ * neither side has to be held in memory as a whole.
+ */
+class Decompressor
+{
+public:
+    Decompressor();
+    ~Decompressor();
+
+    /**
+     * Routes the memory of the streams through alloc and free instead of
+     * malloc. Streams already set up are dropped, begin() creates them anew.
+     */
+    void setAllocator(DecompressorAlloc alloc, DecompressorFree free, void *opaque);
+
+    /**
+     * Starts a new stream, previous state is discarded.
+     * @return false if the method is not supported or setup failed
+     */
+    bool begin(CompressionMethod method);
+
+    /**
+     * Sets the next piece of compressed input. The data has to stay valid
+     * until inputConsumed() returns true.
+     */
+    void setInput(const void *data, size_t length);
+
+    /**
+     * Decompresses as much as fits into out.
+     * @return the number of bytes written, or -1 if decompressing failed
+     */
+    int decompress(void *out, size_t capacity);
+
+    bool inputConsumed() const;
+    bool finished() const { return mFinished; }
+
+private:
+    Decompressor(const Decompressor &);
+    Decompressor &operator=(const Decompressor &);
+
+    void release();
+    static void *zlibAlloc(void *opaque, unsigned int items, unsigned int size);
+    static void zlibFree(void *opaque, void *address);
+
+    CompressionMethod mMethod;
+    bool mFinished;
+    z_stream_s *mZlibStream;
+    ZSTD_DCtx_s *mZstdContext;
+    const void *mInput;
+    size_t mInputLength;
+    size_t mInputPos;
+    DecompressorAlloc mAlloc;
+    DecompressorFree mFree;
+    void *mOpaque;
+};
+
 #endif /* SRC_COMPRESSION_H_ */
@@ -0,0 +1,116 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "mappedfile.h"
+
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TMX_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define TMX_HAVE_MMAP 0
+#endif
+
+MappedFile::MappedFile()
+    : mData(NULL)
+    , mSize(0)
+    , mMapped(false)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &fileName)
+{
+    close();
+
+#if TMX_HAVE_MMAP
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *mapping = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // the parser reads front to back, let the kernel read ahead aggressively
+            madvise(mapping, (size_t) info.st_size, MADV_SEQUENTIAL);
+
+            ::close(fd);
+            mData = (const char *) mapping;
+            mSize = (size_t) info.st_size;
+            mMapped = true;
+            return true;
+        }
+    }
+
+    ::close(fd);
+#endif
+
+    return readBuffered(fileName);
+}
+
+void MappedFile::close()
+{
+#if TMX_HAVE_MMAP
+    if (mMapped)
+        munmap((void *) mData, mSize);
+#endif
+
+    std::vector<char>().swap(mBuffer);
+    mData = NULL;
+    mSize = 0;
+    mMapped = false;
+}
+
+bool MappedFile::readBuffered(const std::string &fileName)
+{
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file)
+        return false;
+
+    char chunk[64 * 1024];
+    size_t bytesRead;
+    while ((bytesRead = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        mBuffer.insert(mBuffer.end(), chunk, chunk + bytesRead);
+
+    bool ok = (ferror(file) == 0);
+    fclose(file);
+
+    if (!ok) {
+        std::vector<char>().swap(mBuffer);
+        return false;
+    }
+
+    mData = mBuffer.data();
+    mSize = mBuffer.size();
+    return true;
+}
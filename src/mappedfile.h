@@ -0,0 +1,67 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _LIB_TMX_MAPPED_FILE_H_
+#define _LIB_TMX_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Read only view of a whole file. On POSIX systems the file is mmap'd with a
+ * sequential access hint, so its pages come straight from the page cache and
+ * are shared between processes. Anywhere mmap is unavailable or fails, the
+ * file is read into a heap buffer instead.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    /**
+     * Maps or reads fileName, closing whatever was open before.
+     * @return false if the file could not be opened or read
+     */
+    bool open(const std::string &fileName);
+    void close();
+
+    const char *data() const { return mData; }
+    size_t size() const { return mSize; }
+    bool isMapped() const { return mMapped; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    bool readBuffered(const std::string &fileName);
+
+    const char *mData;
+    size_t mSize;
+    bool mMapped;
+    std::vector<char> mBuffer;
+};
+
+#endif /* _LIB_TMX_MAPPED_FILE_H_ */
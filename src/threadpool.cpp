@@ -0,0 +1,226 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "threadpool.h"
+
+// the pool and worker index of the current thread, if it is a worker
+static thread_local ThreadPool *tPool = NULL;
+static thread_local unsigned int tWorker = 0;
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+    : mQueued(0)
+    , mUnfinished(0)
+    , mStopping(false)
+{
+    if (threadCount == 0)
+        threadCount = 1;
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+        mWorkers.push_back(new Worker());
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+        mThreads.push_back(std::thread(&ThreadPool::run, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mJobAvailable.notify_all();
+
+    for (size_t i = 0; i < mThreads.size(); ++i)
+        mThreads[i].join();
+
+    for (size_t i = 0; i < mWorkers.size(); ++i)
+        delete mWorkers[i];
+}
+
+void ThreadPool::enqueue(const Job &job, Group *group)
+{
+    Task task = { job, group };
+    if (group != NULL)
+        ++group->mPending;
+    ++mUnfinished;
+
+    try {
+        if (tPool == this) {
+            Worker *worker = mWorkers[tWorker];
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->tasks.push_back(task);
+        } else {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mShared.push_back(task);
+        }
+    } catch (...) {
+        // never queued, so nobody may wait for it
+        finishTask(task);
+        throw;
+    }
+
+    ++mQueued;
+    {
+        // taken so a worker between checking mQueued and sleeping cannot miss the notify
+        std::lock_guard<std::mutex> lock(mMutex);
+    }
+    mJobAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mUnfinished > 0)
+        mJobsDone.wait(lock);
+}
+
+void ThreadPool::wait(Group &group)
+{
+    if (tPool != this) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while (group.mPending > 0)
+                mJobsDone.wait(lock);
+        }
+        rethrowError(group);
+        return;
+    }
+
+    // a worker helps out instead of blocking a thread of the pool
+    while (group.mPending > 0) {
+        Task task;
+        if (popTask(tWorker, &task)) {
+            runTask(tWorker, task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (group.mPending > 0 && mQueued == 0)
+            mJobAvailable.wait(lock);
+    }
+    rethrowError(group);
+}
+
+void ThreadPool::rethrowError(Group &group)
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        error = group.mError;
+        group.mError = std::exception_ptr();
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+bool ThreadPool::popTask(unsigned int worker, Task *task)
+{
+    if (mQueued == 0)
+        return false;
+
+    {
+        Worker *own = mWorkers[worker];
+        std::lock_guard<std::mutex> lock(own->mutex);
+        if (!own->tasks.empty()) {
+            *task = std::move(own->tasks.back());
+            own->tasks.pop_back();
+            --mQueued;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < mWorkers.size(); ++i) {
+        Worker *victim = mWorkers[(worker + i) % mWorkers.size()];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->tasks.empty()) {
+            *task = std::move(victim->tasks.front());
+            victim->tasks.pop_front();
+            --mQueued;
+            return true;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mShared.empty()) {
+        *task = std::move(mShared.front());
+        mShared.pop_front();
+        --mQueued;
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::runTask(unsigned int worker, Task &task)
+{
+    // a throwing job must neither take the worker down nor leave its group waiting forever
+    try {
+        task.job(worker);
+    } catch (...) {
+        if (task.group != NULL) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!task.group->mError)
+                task.group->mError = std::current_exception();
+        }
+    }
+
+    finishTask(task);
+}
+
+void ThreadPool::finishTask(Task &task)
+{
+    bool notify = false;
+    if (task.group != NULL && --task.group->mPending == 0)
+        notify = true;
+    if (--mUnfinished == 0)
+        notify = true;
+
+    if (notify) {
+        // group waiters on workers sleep on mJobAvailable, everyone else on mJobsDone
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobsDone.notify_all();
+        mJobAvailable.notify_all();
+    }
+}
+
+void ThreadPool::run(unsigned int worker)
+{
+    tPool = this;
+    tWorker = worker;
+
+    for (;;) {
+        Task task;
+        if (popTask(worker, &task)) {
+            runTask(worker, task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mQueued == 0 && !mStopping)
+            mJobAvailable.wait(lock);
+
+        if (mQueued == 0)
+            return;
+    }
+}
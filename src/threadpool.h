@@ -0,0 +1,120 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _LIB_TMX_THREAD_POOL_H_
+#define _LIB_TMX_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed size, work stealing pool of worker threads. Jobs queued by a worker go
+ * on that worker's own queue, which it runs newest first while idle workers
+ * steal the oldest jobs from it. Jobs queued from other threads are shared.
+ * Each job is told which worker runs it, so callers can keep per worker
+ * scratch state.
+ */
+class ThreadPool
+{
+public:
+    typedef std::function<void(unsigned int worker)> Job;
+
+    /**
+     * Jobs queued with the same group can be waited for apart from the rest.
+     * The first exception one of them throws is kept for the wait.
+     */
+    class Group
+    {
+    public:
+        Group() : mPending(0) {}
+
+    private:
+        Group(const Group &);
+        Group &operator=(const Group &);
+
+        friend class ThreadPool;
+        std::atomic<unsigned int> mPending;
+        std::exception_ptr mError; // guarded by the pool's mMutex
+    };
+
+    explicit ThreadPool(unsigned int threadCount);
+    ~ThreadPool();
+
+    void enqueue(const Job &job, Group *group = NULL);
+
+    /**
+     * Blocks until every job queued so far has finished.
+     */
+    void wait();
+
+    /**
+     * Blocks until the jobs of group have finished. A worker of this pool
+     * runs other queued jobs meanwhile, so jobs may wait on the jobs they queue.
+     * Rethrows the first exception a job of the group threw.  Jobs without a
+     * group have nobody to hand theirs to, what they throw is dropped.
+     */
+    void wait(Group &group);
+
+    unsigned int threadCount() const { return (unsigned int) mThreads.size(); }
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    struct Task
+    {
+        Job job;
+        Group *group;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool popTask(unsigned int worker, Task *task);
+    void runTask(unsigned int worker, Task &task);
+    void finishTask(Task &task);
+    void rethrowError(Group &group);
+    void run(unsigned int worker);
+
+    std::vector<std::thread> mThreads;
+    std::vector<Worker *> mWorkers;
+    std::deque<Task> mShared; // guarded by mMutex
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::condition_variable mJobsDone;
+    std::atomic<unsigned int> mQueued;
+    std::atomic<unsigned int> mUnfinished;
+    bool mStopping;
+};
+
+#endif /* _LIB_TMX_THREAD_POOL_H_ */
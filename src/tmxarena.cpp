@@ -0,0 +1,144 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "tmxarena.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+
+namespace tmxparser
+{
+
+
+struct TmxArena::Block
+{
+	Block* next;
+	size_t size; // of the whole block, this header included
+};
+
+
+static thread_local TmxArena* _currentArena = NULL;
+
+
+TmxArena::TmxArena(size_t blockSize)
+	: _blocks(NULL), _cursor(NULL), _end(NULL), _blockSize(blockSize), _allocated(0), _reserved(0)
+{
+}
+
+
+TmxArena::~TmxArena()
+{
+	release();
+}
+
+
+void* TmxArena::allocate(size_t size, size_t alignment)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// start may land past _end when a block ends unaligned, so it is checked before the room is worked out
+	uintptr_t start = ((uintptr_t)_cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	if (_cursor == NULL || start > (uintptr_t)_end || size > (uintptr_t)_end - start)
+	{
+		// the rest of the current block is given up, allocations are never moved
+		size_t blockSize = sizeof(Block) + alignment + size;
+		if (blockSize < _blockSize)
+		{
+			blockSize = _blockSize;
+		}
+
+		Block* block = (Block*)malloc(blockSize);
+		if (block == NULL)
+		{
+			throw std::bad_alloc();
+		}
+		block->next = _blocks;
+		block->size = blockSize;
+		_blocks = block;
+		_reserved += blockSize;
+
+		_cursor = (char*)(block + 1);
+		_end = (char*)block + blockSize;
+		start = ((uintptr_t)_cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	}
+
+	_cursor = (char*)start + size;
+	_allocated += size;
+	return (void*)start;
+}
+
+
+void TmxArena::release()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	while (_blocks != NULL)
+	{
+		Block* next = _blocks->next;
+		free(_blocks);
+		_blocks = next;
+	}
+	_cursor = NULL;
+	_end = NULL;
+	_allocated = 0;
+	_reserved = 0;
+}
+
+
+size_t TmxArena::bytesAllocated() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _allocated;
+}
+
+
+size_t TmxArena::bytesReserved() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _reserved;
+}
+
+
+TmxArena* TmxArena::current()
+{
+	return _currentArena;
+}
+
+
+TmxArenaScope::TmxArenaScope(TmxArena* arena)
+	: _previous(_currentArena)
+{
+	_currentArena = arena;
+}
+
+
+TmxArenaScope::~TmxArenaScope()
+{
+	_currentArena = _previous;
+}
+
+
+}
@@ -0,0 +1,221 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _LIB_TMX_ARENA_H_
+#define _LIB_TMX_ARENA_H_
+
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+
+
+namespace tmxparser
+{
+
+
+/*
+ * Monotonic memory for maps.  Built with TMXPARSER_USE_ARENA every string and collection of a TmxMap allocates
+ * through TmxArenaAllocator, which takes its memory from the arena current on the thread that created the
+ * container, or from the heap when there is none.  Nothing allocated from an arena is freed on its own,
+ * release() hands all of it back at once.
+ */
+
+
+/**
+ * Hands out memory carved from large blocks.  Thread safe, layers decoded on worker threads allocate from the
+ * arena of their map as well.
+ */
+class TmxArena
+{
+public:
+	/**
+	 * @param blockSize Size of the blocks taken from the heap, larger allocations get a block of their own.
+	 */
+	explicit TmxArena(size_t blockSize = 256 * 1024);
+	~TmxArena();
+
+	void* allocate(size_t size, size_t alignment);
+
+	/**
+	 * Frees every block at once.  A map built with create() is gone along with its memory without its destructor
+	 * ever running, any other map using the arena must have been destroyed first.
+	 */
+	void release();
+
+	/**
+	 * Default constructs a T with this arena current, so the containers of a TmxMap allocate from it right away.
+	 * The object is never destroyed, release() the arena instead.
+	 */
+	template <typename T>
+	T* create();
+
+	size_t bytesAllocated() const; /// handed out since the last release
+	size_t bytesReserved() const; /// held in blocks
+
+	/**
+	 * The arena new containers allocate from on this thread, NULL for the heap.  See TmxArenaScope.
+	 */
+	static TmxArena* current();
+
+private:
+	TmxArena(const TmxArena&);
+	TmxArena& operator=(const TmxArena&);
+
+	struct Block;
+
+	mutable std::mutex _mutex;
+	Block* _blocks;
+	char* _cursor;
+	char* _end;
+	size_t _blockSize;
+	size_t _allocated;
+	size_t _reserved;
+};
+
+
+/**
+ * Makes an arena current on this thread until the scope ends, NULL to allocate from the heap again.
+ */
+class TmxArenaScope
+{
+public:
+	explicit TmxArenaScope(TmxArena* arena);
+	~TmxArenaScope();
+
+private:
+	TmxArenaScope(const TmxArenaScope&);
+	TmxArenaScope& operator=(const TmxArenaScope&);
+
+	TmxArena* _previous;
+};
+
+
+template <typename T>
+T* TmxArena::create()
+{
+	TmxArenaScope scope(this);
+	return new (allocate(sizeof(T), std::alignment_of<T>::value)) T();
+}
+
+
+/**
+ * Allocator of the containers of a TmxMap built with TMXPARSER_USE_ARENA.  Containers keep the arena that was
+ * current when they were created, copies take the one current where they are made, moves and swaps carry theirs along.
+ */
+template <typename T>
+class TmxArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	typedef std::false_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef TmxArenaAllocator<U> other;
+	};
+
+	TmxArenaAllocator() : arena(TmxArena::current()) {}
+	explicit TmxArenaAllocator(TmxArena* arena) : arena(arena) {}
+	template <typename U>
+	TmxArenaAllocator(const TmxArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t count)
+	{
+		if (count > (size_t)-1 / sizeof(T))
+		{
+			throw std::bad_alloc();
+		}
+		if (arena != NULL)
+		{
+			return (T*)arena->allocate(count * sizeof(T), std::alignment_of<T>::value);
+		}
+		return (T*)::operator new(count * sizeof(T));
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		if (arena == NULL)
+		{
+			::operator delete(p);
+		}
+	}
+
+	TmxArenaAllocator select_on_container_copy_construction() const { return TmxArenaAllocator(); }
+
+	TmxArena* arena; /// NULL for the heap
+};
+
+
+template <typename T, typename U>
+bool operator==(const TmxArenaAllocator<T>& lhs, const TmxArenaAllocator<U>& rhs) { return lhs.arena == rhs.arena; }
+
+
+template <typename T, typename U>
+bool operator!=(const TmxArenaAllocator<T>& lhs, const TmxArenaAllocator<U>& rhs) { return lhs.arena != rhs.arena; }
+
+
+typedef std::basic_string<char, std::char_traits<char>, TmxArenaAllocator<char> > TmxArenaString;
+
+
+/**
+ * std::hash for the keys of arena maps, which has no specialization for strings with another allocator.
+ */
+template <typename T>
+struct TmxArenaHash : std::hash<T>
+{
+};
+
+
+template <>
+struct TmxArenaHash<TmxArenaString>
+{
+	size_t operator()(const TmxArenaString& value) const
+	{
+		// FNV-1a
+		size_t hash = (size_t)14695981039346656037ULL;
+		for (size_t i = 0; i < value.size(); i++)
+		{
+			hash = (hash ^ (unsigned char)value[i]) * (size_t)1099511628211ULL;
+		}
+		return hash;
+	}
+};
+
+
+}
+#endif /* _LIB_TMX_ARENA_H_ */
@@ -0,0 +1,698 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "tmxbinary.h"
+#include "tmxparser_internal.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+#ifndef LOG_TAG
+#define LOG_TAG "libtmxparser"
+#endif
+
+#define QUOTEME_(x) #x
+#define QUOTEME(x) QUOTEME_(x)
+#define LOGE(...) fprintf(stderr, "E/" QUOTEME(LOG_TAG) "(" ")" __VA_ARGS__ ); fprintf(stderr, "\n");
+
+
+namespace tmxparser
+{
+
+
+// Builds a blob front to back.  Records are filled in locally and stored once their strings and
+// child arrays have been written, since every append may move the blob.
+class TmxBinaryWriter
+{
+public:
+	template <typename T>
+	TmxBinaryArray reserve(size_t count)
+	{
+		TmxBinaryArray array;
+		array.offset = (_blob.size() + 15) & ~(uint64_t)15;
+		array.count = count;
+		_blob.resize(array.offset + count * sizeof(T));
+		return array;
+	}
+
+	template <typename T>
+	void store(const TmxBinaryArray& array, size_t index, const T& record)
+	{
+		memcpy(&_blob[array.offset + index * sizeof(T)], &record, sizeof(T));
+	}
+
+	template <typename T>
+	T* data(const TmxBinaryArray& array)
+	{
+		return (T*)&_blob[array.offset];
+	}
+
+	template <typename TString>
+	TmxBinaryString string(const TString& value)
+	{
+		TmxBinaryString string;
+		string.offset = _blob.size();
+		string.length = value.size();
+		_blob.insert(_blob.end(), value.begin(), value.end());
+		_blob.push_back('\0');
+		return string;
+	}
+
+	std::vector<char>& blob() { return _blob; }
+
+private:
+	std::vector<char> _blob;
+};
+
+
+template <typename T>
+static T _zeroed()
+{
+	T record;
+	memset(&record, 0, sizeof(T));
+	return record;
+}
+
+
+typedef std::pair<std::string, const TmxProperty*> TmxNamedProperty;
+
+
+static bool _propertyLess(const TmxNamedProperty& lhs, const TmxNamedProperty& rhs)
+{
+	return lhs.first < rhs.first;
+}
+
+
+// Binary maps are read without the string table, so names are written out and sorted by name rather than id
+static TmxBinaryArray _writeProperties(TmxBinaryWriter& writer, const TmxPropertyMap_t& propertyMap)
+{
+	std::vector<TmxNamedProperty> properties;
+	for (auto it = propertyMap.begin(); it != propertyMap.end(); ++it)
+	{
+		properties.push_back(TmxNamedProperty(getInternedString(it->name), &(*it)));
+	}
+	std::sort(properties.begin(), properties.end(), _propertyLess);
+
+	TmxBinaryArray array = writer.reserve<TmxBinaryProperty>(properties.size());
+	for (size_t i = 0; i < properties.size(); i++)
+	{
+		TmxBinaryProperty property = _zeroed<TmxBinaryProperty>();
+		property.name = writer.string(properties[i].first);
+		property.value = writer.string(properties[i].second->value);
+		property.type = properties[i].second->type;
+		switch (properties[i].second->type)
+		{
+			case kPropertyInt:
+				property.intValue = properties[i].second->intValue;
+				break;
+			case kPropertyFloat:
+				property.floatValue = properties[i].second->floatValue;
+				break;
+			case kPropertyBool:
+				property.boolValue = properties[i].second->boolValue ? 1 : 0;
+				break;
+			case kPropertyColor:
+				property.colorValue = properties[i].second->colorValue;
+				break;
+			case kPropertyObject:
+				property.objectId = properties[i].second->objectId;
+				break;
+			default:
+				break;
+		}
+		writer.store(array, i, property);
+	}
+
+	return array;
+}
+
+
+static TmxBinaryImage _writeImage(TmxBinaryWriter& writer, const TmxImage& image)
+{
+	TmxBinaryImage record = _zeroed<TmxBinaryImage>();
+	record.format = writer.string(image.format);
+	record.source = writer.string(image.source);
+	record.transparentColor = writer.string(image.transparentColor);
+	record.width = image.width;
+	record.height = image.height;
+	return record;
+}
+
+
+static TmxBinaryArray _writeObjectGroups(TmxBinaryWriter& writer, const TmxObjectGroupCollection_t& objectGroups)
+{
+	TmxBinaryArray array = writer.reserve<TmxBinaryObjectGroup>(objectGroups.size());
+	for (size_t i = 0; i < objectGroups.size(); i++)
+	{
+		const TmxObjectGroup& group = objectGroups[i];
+
+		TmxBinaryObjectGroup record = _zeroed<TmxBinaryObjectGroup>();
+		record.name = writer.string(group.name);
+		record.color = writer.string(group.color);
+		record.opacity = group.opacity;
+		record.visible = group.visible;
+		record.properties = _writeProperties(writer, group.propertyMap);
+
+		record.objects = writer.reserve<TmxBinaryObject>(group.objects.size());
+		for (size_t o = 0; o < group.objects.size(); o++)
+		{
+			const TmxObject& object = group.objects[o];
+
+			TmxBinaryObject objectRecord = _zeroed<TmxBinaryObject>();
+			objectRecord.name = writer.string(std::string(getInternedString(object.name)));
+			objectRecord.type = writer.string(std::string(getInternedString(object.type)));
+			objectRecord.x = object.x;
+			objectRecord.y = object.y;
+			objectRecord.width = object.width;
+			objectRecord.height = object.height;
+			objectRecord.rotation = object.rotation;
+			objectRecord.referenceGid = object.referenceGid;
+			objectRecord.visible = object.visible;
+			objectRecord.shapeType = object.shapeType;
+			objectRecord.properties = _writeProperties(writer, object.propertyMap);
+
+			objectRecord.shapePoints = writer.reserve<TmxBinaryPoint>(object.shapePoints.size());
+			for (size_t p = 0; p < object.shapePoints.size(); p++)
+			{
+				TmxBinaryPoint point = { object.shapePoints[p].first, object.shapePoints[p].second };
+				writer.store(objectRecord.shapePoints, p, point);
+			}
+
+			writer.store(record.objects, o, objectRecord);
+		}
+
+		writer.store(array, i, record);
+	}
+
+	return array;
+}
+
+
+static bool _tileDefinitionLess(const TmxTileDefinition* lhs, const TmxTileDefinition* rhs)
+{
+	return lhs->id < rhs->id;
+}
+
+
+static TmxBinaryArray _writeTilesets(TmxBinaryWriter& writer, const TmxTilesetCollection_t& tilesets)
+{
+	TmxBinaryArray array = writer.reserve<TmxBinaryTileset>(tilesets.size());
+	for (size_t i = 0; i < tilesets.size(); i++)
+	{
+		const TmxTileset& tileset = tilesets[i];
+
+		TmxBinaryTileset record = _zeroed<TmxBinaryTileset>();
+		record.source = writer.string(tileset.source);
+		record.name = writer.string(tileset.name);
+		record.firstgid = tileset.firstgid;
+		record.tileWidth = tileset.tileWidth;
+		record.tileHeight = tileset.tileHeight;
+		record.tileSpacingInImage = tileset.tileSpacingInImage;
+		record.tileMarginInImage = tileset.tileMarginInImage;
+		record.offsetX = tileset.offset.x;
+		record.offsetY = tileset.offset.y;
+		record.rowCount = tileset.rowCount;
+		record.colCount = tileset.colCount;
+		record.image = _writeImage(writer, tileset.image);
+
+		std::vector<const TmxTileDefinition*> definitions;
+		const TmxTileDefinitionMap_t& tileDefinitions = getTileDefinitions(tileset);
+		for (auto it = tileDefinitions.begin(); it != tileDefinitions.end(); ++it)
+		{
+			definitions.push_back(&it->second);
+		}
+		std::sort(definitions.begin(), definitions.end(), _tileDefinitionLess);
+
+		record.tileDefinitions = writer.reserve<TmxBinaryTileDefinition>(definitions.size());
+		for (size_t d = 0; d < definitions.size(); d++)
+		{
+			const TmxTileDefinition& definition = *definitions[d];
+
+			TmxBinaryTileDefinition definitionRecord = _zeroed<TmxBinaryTileDefinition>();
+			definitionRecord.id = definition.id;
+			definitionRecord.properties = _writeProperties(writer, definition.propertyMap);
+			definitionRecord.animations = writer.reserve<TmxAnimationFrame>(definition.animations.size());
+			for (size_t a = 0; a < definition.animations.size(); a++)
+			{
+				writer.store(definitionRecord.animations, a, definition.animations[a]);
+			}
+			definitionRecord.objectGroups = _writeObjectGroups(writer, definition.objectgroups);
+
+			writer.store(record.tileDefinitions, d, definitionRecord);
+		}
+
+		writer.store(array, i, record);
+	}
+
+	return array;
+}
+
+
+static TmxReturn _writeLayers(TmxBinaryWriter& writer, const TmxMap& map, TmxBinaryArray* outLayers)
+{
+	TmxBinaryArray array = writer.reserve<TmxBinaryLayer>(map.layerCollection.size());
+	for (size_t i = 0; i < map.layerCollection.size(); i++)
+	{
+		const TmxLayer& layer = map.layerCollection[i];
+
+		TmxBinaryLayer record = _zeroed<TmxBinaryLayer>();
+		record.name = writer.string(layer.name);
+		record.width = layer.width;
+		record.height = layer.height;
+		record.opacity = layer.opacity;
+		record.visible = layer.visible;
+		record.properties = _writeProperties(writer, layer.propertyMap);
+
+		// the blob always holds resolved tiles, so readers never touch the tileset lookup
+		record.tiles = writer.reserve<TmxLayerTile>(getLayerTileCount(layer));
+		const TmxLayerTileCollection_t* tiles = getLayerTiles(map, layer);
+		if (tiles != NULL && !tiles->empty())
+		{
+			memcpy(writer.data<TmxLayerTile>(record.tiles), tiles->data(), tiles->size() * sizeof(TmxLayerTile));
+		}
+		else if (!layer.gids.empty())
+		{
+			resolveLayerGids(map.tilesetLookup, layer.gids.data(), layer.gids.size(), writer.data<TmxLayerTile>(record.tiles));
+		}
+		else if (tiles == NULL)
+		{
+			// a lazy layer whose data does not decode, its tiles are not known
+			LOGE("Cannot decode layer %s for the binary map", layer.name.c_str());
+			return TmxReturn::kErrorParsing;
+		}
+
+		writer.store(array, i, record);
+	}
+
+	*outLayers = array;
+	return TmxReturn::kSuccess;
+}
+
+
+static TmxBinaryArray _writeImageLayers(TmxBinaryWriter& writer, const TmxImageLayerCollection_t& imageLayers)
+{
+	TmxBinaryArray array = writer.reserve<TmxBinaryImageLayer>(imageLayers.size());
+	for (size_t i = 0; i < imageLayers.size(); i++)
+	{
+		const TmxImageLayer& imageLayer = imageLayers[i];
+
+		TmxBinaryImageLayer record = _zeroed<TmxBinaryImageLayer>();
+		record.name = writer.string(imageLayer.name);
+		record.x = imageLayer.x;
+		record.y = imageLayer.y;
+		record.widthInTiles = imageLayer.widthInTiles;
+		record.heightInTiles = imageLayer.heightInTiles;
+		record.opacity = imageLayer.opacity;
+		record.visible = imageLayer.visible;
+		record.properties = _writeProperties(writer, imageLayer.propertyMap);
+		record.image = _writeImage(writer, imageLayer.image);
+
+		writer.store(array, i, record);
+	}
+
+	return array;
+}
+
+
+static bool _statFile(const std::string& fileName, uint64_t* outModifiedTime, uint64_t* outSize)
+{
+	struct stat fileInfo;
+	if (stat(fileName.c_str(), &fileInfo) != 0)
+	{
+		return false;
+	}
+
+	*outModifiedTime = (uint64_t)_modifiedTime(fileInfo);
+	*outSize = (uint64_t)fileInfo.st_size;
+	return true;
+}
+
+
+static TmxReturn _writeSources(TmxBinaryWriter& writer, const TmxMap& map, const std::string& sourceFileName, const std::string& tilesetPath, TmxBinaryArray* outSources)
+{
+	// canonical, so open() finds them whatever the working directory is by then
+	std::vector<std::string> sourceFiles(1, _canonicalPath(sourceFileName));
+	for (auto it = map.tilesetCollection.begin(); it != map.tilesetCollection.end(); ++it)
+	{
+		if (!it->source.empty())
+		{
+			std::string tilesetFile = _canonicalPath(_updatePath(it->source.c_str(), tilesetPath));
+			if (std::find(sourceFiles.begin(), sourceFiles.end(), tilesetFile) == sourceFiles.end())
+			{
+				sourceFiles.push_back(tilesetFile);
+			}
+		}
+	}
+
+	*outSources = writer.reserve<TmxBinarySource>(sourceFiles.size());
+	for (size_t i = 0; i < sourceFiles.size(); i++)
+	{
+		TmxBinarySource source = _zeroed<TmxBinarySource>();
+		if (!_statFile(sourceFiles[i], &source.modifiedTime, &source.size))
+		{
+			LOGE("Cannot stat binary map source file %s", sourceFiles[i].c_str());
+			return TmxReturn::kErrorParsing;
+		}
+
+		source.path = writer.string(sourceFiles[i]);
+		writer.store(*outSources, i, source);
+	}
+
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn writeBinaryMap(const TmxMap& map, const std::string& fileName, const std::string& sourceFileName, const std::string& tilesetPath)
+{
+	if (map.infinite)
+	{
+		LOGE("Infinite maps cannot be written as binary maps...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	TmxBinaryWriter writer;
+	TmxBinaryArray headerArray = writer.reserve<TmxBinaryHeader>(1);
+
+	TmxBinaryHeader header = _zeroed<TmxBinaryHeader>();
+	header.magic = TMX_BINARY_MAGIC;
+	header.formatVersion = TMX_BINARY_VERSION;
+	header.headerSize = sizeof(TmxBinaryHeader);
+	header.tileSize = sizeof(TmxLayerTile);
+
+	TmxReturn error = _writeSources(writer, map, sourceFileName, tilesetPath, &header.sources);
+	if (error)
+	{
+		return error;
+	}
+
+	header.version = writer.string(map.version);
+	header.orientation = map.orientation;
+	header.width = map.width;
+	header.height = map.height;
+	header.tileWidth = map.tileWidth;
+	header.tileHeight = map.tileHeight;
+	header.backgroundColor = writer.string(map.backgroundColor);
+	header.renderOrder = writer.string(map.renderOrder);
+	header.properties = _writeProperties(writer, map.propertyMap);
+	header.tilesets = _writeTilesets(writer, map.tilesetCollection);
+	error = _writeLayers(writer, map, &header.layers);
+	if (error)
+	{
+		return error;
+	}
+	header.objectGroups = _writeObjectGroups(writer, map.objectGroupCollection);
+	header.imageLayers = _writeImageLayers(writer, map.imageLayerCollection);
+
+	std::vector<char>& blob = writer.blob();
+	header.fileSize = blob.size();
+	writer.store(headerArray, 0, header);
+
+	std::string tempFileName = fileName + ".tmp";
+	FILE* file = fopen(tempFileName.c_str(), "wb");
+	if (file == NULL)
+	{
+		LOGE("Cannot open binary map file %s for writing", tempFileName.c_str());
+		return TmxReturn::kErrorParsing;
+	}
+
+	bool written = (fwrite(blob.data(), 1, blob.size(), file) == blob.size());
+	written = (fclose(file) == 0) && written;
+
+#if defined(WIN32) || defined(_WIN32)
+	remove(fileName.c_str());
+#endif
+	if (!written || rename(tempFileName.c_str(), fileName.c_str()) != 0)
+	{
+		LOGE("Cannot write binary map file %s", fileName.c_str());
+		remove(tempFileName.c_str());
+		return TmxReturn::kErrorParsing;
+	}
+
+	return TmxReturn::kSuccess;
+}
+
+
+// open() checks every string and array of a blob against the file once, so array() and string() can
+// read in place without checks of their own
+static bool _checkString(const MappedFile& file, const TmxBinaryString& value)
+{
+	return value.offset < file.size() && value.length < file.size() - value.offset && file.data()[value.offset + value.length] == '\0';
+}
+
+
+template <typename T>
+static const T* _checkArray(const MappedFile& file, const TmxBinaryArray& values)
+{
+	if (values.offset > file.size() || (values.offset & 15) != 0 || values.count > (file.size() - values.offset) / sizeof(T))
+	{
+		return NULL;
+	}
+	return (const T*)(file.data() + values.offset);
+}
+
+
+static bool _checkProperties(const MappedFile& file, const TmxBinaryArray& values)
+{
+	const TmxBinaryProperty* properties = _checkArray<TmxBinaryProperty>(file, values);
+	if (properties == NULL)
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < values.count; i++)
+	{
+		if (!_checkString(file, properties[i].name) || !_checkString(file, properties[i].value))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static bool _checkImage(const MappedFile& file, const TmxBinaryImage& image)
+{
+	return _checkString(file, image.format) && _checkString(file, image.source) && _checkString(file, image.transparentColor);
+}
+
+
+static bool _checkObjectGroups(const MappedFile& file, const TmxBinaryArray& values)
+{
+	const TmxBinaryObjectGroup* groups = _checkArray<TmxBinaryObjectGroup>(file, values);
+	if (groups == NULL)
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < values.count; i++)
+	{
+		const TmxBinaryObjectGroup& group = groups[i];
+		const TmxBinaryObject* objects = _checkArray<TmxBinaryObject>(file, group.objects);
+		if (!_checkString(file, group.name) || !_checkString(file, group.color) || !_checkProperties(file, group.properties) || objects == NULL)
+		{
+			return false;
+		}
+
+		for (uint64_t o = 0; o < group.objects.count; o++)
+		{
+			const TmxBinaryObject& object = objects[o];
+			if (!_checkString(file, object.name) || !_checkString(file, object.type) || !_checkProperties(file, object.properties) ||
+				_checkArray<TmxBinaryPoint>(file, object.shapePoints) == NULL)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+static bool _checkTilesets(const MappedFile& file, const TmxBinaryArray& values)
+{
+	const TmxBinaryTileset* tilesets = _checkArray<TmxBinaryTileset>(file, values);
+	if (tilesets == NULL)
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < values.count; i++)
+	{
+		const TmxBinaryTileset& tileset = tilesets[i];
+		const TmxBinaryTileDefinition* definitions = _checkArray<TmxBinaryTileDefinition>(file, tileset.tileDefinitions);
+		if (!_checkString(file, tileset.source) || !_checkString(file, tileset.name) || !_checkImage(file, tileset.image) || definitions == NULL)
+		{
+			return false;
+		}
+
+		for (uint64_t d = 0; d < tileset.tileDefinitions.count; d++)
+		{
+			const TmxBinaryTileDefinition& definition = definitions[d];
+			if (!_checkProperties(file, definition.properties) || _checkArray<TmxAnimationFrame>(file, definition.animations) == NULL ||
+				!_checkObjectGroups(file, definition.objectGroups))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+static bool _checkLayers(const MappedFile& file, const TmxBinaryHeader& header)
+{
+	const TmxBinaryLayer* layers = _checkArray<TmxBinaryLayer>(file, header.layers);
+	if (layers == NULL)
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < header.layers.count; i++)
+	{
+		if (!_checkString(file, layers[i].name) || !_checkProperties(file, layers[i].properties) || _checkArray<TmxLayerTile>(file, layers[i].tiles) == NULL)
+		{
+			return false;
+		}
+	}
+
+	const TmxBinaryImageLayer* imageLayers = _checkArray<TmxBinaryImageLayer>(file, header.imageLayers);
+	if (imageLayers == NULL)
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < header.imageLayers.count; i++)
+	{
+		if (!_checkString(file, imageLayers[i].name) || !_checkProperties(file, imageLayers[i].properties) || !_checkImage(file, imageLayers[i].image))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static bool _checkBlob(const MappedFile& file, const TmxBinaryHeader& header)
+{
+	const TmxBinarySource* sources = _checkArray<TmxBinarySource>(file, header.sources);
+	if (sources == NULL)
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < header.sources.count; i++)
+	{
+		if (!_checkString(file, sources[i].path))
+		{
+			return false;
+		}
+	}
+
+	return _checkString(file, header.version) && _checkString(file, header.backgroundColor) && _checkString(file, header.renderOrder) &&
+		_checkProperties(file, header.properties) && _checkTilesets(file, header.tilesets) && _checkLayers(file, header) &&
+		_checkObjectGroups(file, header.objectGroups);
+}
+
+
+TmxBinaryMap::TmxBinaryMap()
+	: _header(NULL)
+{
+}
+
+
+TmxReturn TmxBinaryMap::open(const std::string& fileName, bool checkSources)
+{
+	close();
+
+	if (!_file.open(fileName))
+	{
+		LOGE("Cannot read binary map file");
+		return TmxReturn::kErrorParsing;
+	}
+
+	const TmxBinaryHeader* header = (const TmxBinaryHeader*)_file.data();
+	if (_file.size() < 2 * sizeof(uint32_t) || header->magic != TMX_BINARY_MAGIC)
+	{
+		LOGE("Not a binary map file...");
+		close();
+		return TmxReturn::kErrorParsing;
+	}
+
+	// blobs from another format version, or a build with another tile layout, have to be written again
+	if (header->formatVersion != TMX_BINARY_VERSION || _file.size() < sizeof(TmxBinaryHeader) ||
+		header->headerSize != sizeof(TmxBinaryHeader) || header->tileSize != sizeof(TmxLayerTile))
+	{
+		close();
+		return TmxReturn::kStaleBinaryMap;
+	}
+
+	if (header->fileSize != _file.size())
+	{
+		LOGE("Binary map file is truncated...");
+		close();
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (!_checkBlob(_file, *header))
+	{
+		LOGE("Binary map file refers to data outside of itself...");
+		close();
+		return TmxReturn::kErrorParsing;
+	}
+
+	_header = header;
+
+	if (checkSources)
+	{
+		const TmxBinarySource* sources = array<TmxBinarySource>(header->sources);
+		for (uint64_t i = 0; i < header->sources.count; i++)
+		{
+			uint64_t modifiedTime;
+			uint64_t size;
+			if (!_statFile(string(sources[i].path), &modifiedTime, &size) || modifiedTime != sources[i].modifiedTime || size != sources[i].size)
+			{
+				close();
+				return TmxReturn::kStaleBinaryMap;
+			}
+		}
+	}
+
+	return TmxReturn::kSuccess;
+}
+
+
+void TmxBinaryMap::close()
+{
+	_file.close();
+	_header = NULL;
+}
+
+
+}
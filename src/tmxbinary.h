@@ -0,0 +1,263 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _LIB_TMX_BINARY_H_
+#define _LIB_TMX_BINARY_H_
+
+
+#include <stdint.h>
+#include <string>
+
+#include "tmxparser.h"
+#include "mappedfile.h"
+
+
+namespace tmxparser
+{
+
+
+/*
+ * Compiled binary maps.  A parsed TmxMap is written out as one blob of plain structs that refer to each
+ * other by byte offsets from the start of the blob.  Loading maps the file and checks the header, nothing
+ * is parsed or copied.  Every array starts on a 16 byte boundary, strings are NUL terminated.
+ */
+
+
+#define TMX_BINARY_MAGIC 0x42584d54 // "TMXB"
+#define TMX_BINARY_VERSION 3
+
+
+typedef struct
+{
+	uint64_t offset;
+	uint64_t length; /// without the NUL
+} TmxBinaryString;
+
+
+typedef struct
+{
+	uint64_t offset;
+	uint64_t count;
+} TmxBinaryArray;
+
+
+typedef struct
+{
+	TmxBinaryString name;
+	TmxBinaryString value; /// the text, for every type
+	uint32_t type; /// TmxPropertyType
+	union
+	{
+		int32_t intValue;
+		float floatValue;
+		uint32_t boolValue;
+		uint32_t colorValue; /// 0xRRGGBBAA
+		uint32_t objectId;
+	};
+} TmxBinaryProperty; /// sorted by name within each array
+
+
+typedef struct
+{
+	float x;
+	float y;
+} TmxBinaryPoint;
+
+
+typedef struct
+{
+	TmxBinaryString name;
+	TmxBinaryString type;
+	float x;
+	float y;
+	float width;
+	float height;
+	float rotation;
+	uint32_t referenceGid;
+	uint32_t visible;
+	uint32_t shapeType; /// TmxShapeType
+	TmxBinaryArray properties; /// TmxBinaryProperty
+	TmxBinaryArray shapePoints; /// TmxBinaryPoint
+} TmxBinaryObject;
+
+
+typedef struct
+{
+	TmxBinaryString name;
+	TmxBinaryString color;
+	float opacity;
+	uint32_t visible;
+	TmxBinaryArray properties; /// TmxBinaryProperty
+	TmxBinaryArray objects; /// TmxBinaryObject
+} TmxBinaryObjectGroup;
+
+
+typedef struct
+{
+	uint32_t id;
+	uint32_t reserved;
+	TmxBinaryArray properties; /// TmxBinaryProperty
+	TmxBinaryArray animations; /// TmxAnimationFrame
+	TmxBinaryArray objectGroups; /// TmxBinaryObjectGroup
+} TmxBinaryTileDefinition; /// sorted by id within each tileset
+
+
+typedef struct
+{
+	TmxBinaryString format;
+	TmxBinaryString source;
+	TmxBinaryString transparentColor;
+	uint32_t width;
+	uint32_t height;
+} TmxBinaryImage;
+
+
+typedef struct
+{
+	TmxBinaryString source;
+	TmxBinaryString name;
+	uint32_t firstgid;
+	uint32_t tileWidth;
+	uint32_t tileHeight;
+	uint32_t tileSpacingInImage;
+	uint32_t tileMarginInImage;
+	int32_t offsetX;
+	int32_t offsetY;
+	uint32_t rowCount;
+	uint32_t colCount;
+	uint32_t reserved;
+	TmxBinaryImage image;
+	TmxBinaryArray tileDefinitions; /// TmxBinaryTileDefinition
+} TmxBinaryTileset;
+
+
+typedef struct
+{
+	TmxBinaryString name;
+	uint32_t width;
+	uint32_t height;
+	float opacity;
+	uint32_t visible;
+	TmxBinaryArray properties; /// TmxBinaryProperty
+	TmxBinaryArray tiles; /// TmxLayerTile, always resolved whatever storage the map was parsed with
+} TmxBinaryLayer;
+
+
+typedef struct
+{
+	TmxBinaryString name;
+	uint32_t x;
+	uint32_t y;
+	uint32_t widthInTiles;
+	uint32_t heightInTiles;
+	float opacity;
+	uint32_t visible;
+	uint32_t reserved;
+	TmxBinaryArray properties; /// TmxBinaryProperty
+	TmxBinaryImage image;
+} TmxBinaryImageLayer;
+
+
+typedef struct
+{
+	TmxBinaryString path; /// canonical
+	uint64_t modifiedTime; /// nanoseconds where the platform has them
+	uint64_t size;
+} TmxBinarySource; /// a file the map was parsed from, to tell when the blob is stale
+
+
+typedef struct
+{
+	uint32_t magic; /// TMX_BINARY_MAGIC, also tells a blob written with the other endianness
+	uint32_t formatVersion; /// TMX_BINARY_VERSION
+	uint32_t headerSize; /// sizeof(TmxBinaryHeader)
+	uint32_t tileSize; /// sizeof(TmxLayerTile)
+	uint64_t fileSize;
+	TmxBinaryArray sources; /// TmxBinarySource, the tmx first, then external tilesets
+
+	TmxBinaryString version;
+	uint32_t orientation; /// TmxOrientation
+	uint32_t width;
+	uint32_t height;
+	uint32_t tileWidth;
+	uint32_t tileHeight;
+	uint32_t reserved;
+	TmxBinaryString backgroundColor;
+	TmxBinaryString renderOrder;
+	TmxBinaryArray properties; /// TmxBinaryProperty
+	TmxBinaryArray tilesets; /// TmxBinaryTileset
+	TmxBinaryArray layers; /// TmxBinaryLayer
+	TmxBinaryArray objectGroups; /// TmxBinaryObjectGroup
+	TmxBinaryArray imageLayers; /// TmxBinaryImageLayer
+} TmxBinaryHeader;
+
+
+/**
+ * Writes a parsed map as a binary blob.  The blob is written next to fileName first and renamed into place,
+ * so readers never see half a file.
+ * @param map The parsed map.
+ * @param fileName Where to write the blob.
+ * @param sourceFileName The tmx the map was parsed from, recorded along with its external tilesets for the staleness check.
+ * @param tilesetPath The tilesetPath the map was parsed with.
+ * @return kSuccess on success, kErrorParsing for infinite maps, whose chunks the format has no room for.
+ */
+TmxReturn writeBinaryMap(const TmxMap& map, const std::string& fileName, const std::string& sourceFileName, const std::string& tilesetPath);
+
+
+/**
+ * A memory mapped binary map.  Arrays and strings are read in place through array() and string().
+ */
+class TmxBinaryMap
+{
+public:
+	TmxBinaryMap();
+
+	/**
+	 * Maps a blob written by writeBinaryMap.
+	 * @param fileName The blob.
+	 * @param checkSources Whether to compare the recorded source files against the disk.
+	 * @return kSuccess, kStaleBinaryMap if the blob is from another format version or a source file has
+	 * changed since it was written, kErrorParsing if it cannot be read or is not a binary map.
+	 */
+	TmxReturn open(const std::string& fileName, bool checkSources = true);
+	void close();
+
+	const TmxBinaryHeader* header() const { return _header; }
+
+	template <typename T>
+	const T* array(const TmxBinaryArray& values) const { return (const T*)(_file.data() + values.offset); }
+
+	const char* string(const TmxBinaryString& value) const { return _file.data() + value.offset; }
+
+private:
+	TmxBinaryMap(const TmxBinaryMap&);
+	TmxBinaryMap& operator=(const TmxBinaryMap&);
+
+	MappedFile _file;
+	const TmxBinaryHeader* _header;
+};
+
+
+}
+#endif /* _LIB_TMX_BINARY_H_ */
@@ -24,9 +24,10 @@ THE SOFTWARE.
 
 
 #include "tmxparser.h"
+#include "tmxparser_internal.h"
 
 #include "base64.h"
-#include "compression.h"
+#include "mappedfile.h"
 
 
 #if (defined(_WIN32))
@@ -42,8 +43,34 @@ THE SOFTWARE.
 #endif
 
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <locale>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TMX_X86_DISPATCH 1
+#include <immintrin.h>
+#else
+#define TMX_X86_DISPATCH 0
+#endif
 
 
 #ifndef LOG_TAG
@@ -125,605 +152,4025 @@ namespace tmxparser
 		}
 
 
+// A layer waiting to be decoded, either as an element of a finished document or as raw xml text
+typedef struct
+{
+	tinyxml2::XMLElement* element;
+	const char* xml;
+	size_t xmlLength;
+} TmxPendingLayer;
+
+
+// The encoded data of a kLayerStorageLazy layer, decoded by whoever reads the layer first
+struct TmxLazyLayerData
+{
+	TmxString encoding;
+	TmxString compression;	// empty if uncompressed
+	TmxString text;			// freed once decoded
+	size_t count;
+	TmxAllocator* allocator;	// options.allocator of the parse, NULL for malloc
+	std::once_flag decoded;
+	TmxReturn result;
+	TmxLayerTileCollection_t tiles;
+};
+
+
+// An external tileset whose tsx is loaded on a worker while the rest of the map is parsed
+typedef struct
+{
+	size_t slot;
+	std::string fileName;
+	TmxTileset tileset;		// loaded into, since the map's collection may still grow, and moved to its slot once done
+	TmxReturn result;
+} TmxPendingTileset;
+
+
+// The tsx loads of one parse, each queued as soon as its <tileset> is seen
+struct TmxTilesetLoads
+{
+	ThreadPool* pool;
+	ThreadPool::Group jobs;
+	std::deque<TmxPendingTileset> pending;	// the jobs hold pointers into it
+
+	explicit TmxTilesetLoads(ThreadPool* pool) : pool(pool) {}
+	~TmxTilesetLoads()
+	{
+		// a parse that fails early still has to wait for the loads it started, it already has an error to report
+		if (pool != NULL)
+		{
+			try
+			{
+				pool->wait(jobs);
+			}
+			catch (...)
+			{
+			}
+		}
+	}
+};
+
+
+// Where decoding a layer's <data> stopped, so it can go on a chunk of tiles at a time
+typedef struct
+{
+	const char* encoding;		// NULL for <tile> elements
+	const char* compression;
+	tinyxml2::XMLElement* nextTile;
+	const char* text;			// csv and base64
+	size_t textLength;
+	size_t textPos;
+	size_t gidChunkFill;		// base64, bytes waiting in TmxParseContext::gidChunk
+	bool draining;				// base64, compressed input still in the decompressor
+	bool done;
+} TmxLayerDataCursor;
+
+
 // Prototypes
-std::string _updatePath(std::string path, const std::string& tilesetPath);
-TmxReturn _parseStart(tinyxml2::XMLElement* element, TmxMap* outMap, const std::string& tilesetPath);
+TmxReturn _parseFile(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context);
+TmxReturn _parseStart(tinyxml2::XMLElement* element, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context);
 TmxReturn _parseEnd(TmxMap* outMap, const std::string& tilesetPath);
 void _parseEndHelper(TmxImage& image, const std::string& tilesetPath);
-TmxReturn _parseMapNode(tinyxml2::XMLElement* element, TmxMap* outMap, std::string filesetPath);
-TmxReturn _parsePropertyNode(tinyxml2::XMLElement* element, TmxPropertyMap_t* outPropertyMap);
+TmxReturn _parseMapNode(tinyxml2::XMLElement* element, TmxMap* outMap, std::string filesetPath, const TmxParseOptions& options, TmxParseContext* context);
+TmxReturn _parseMapAttributes(tinyxml2::XMLElement* element, TmxMap* outMap);
+TmxReturn _parseStreaming(const char* xml, size_t length, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context);
+TmxReturn _parseStreamedMapChild(tinyxml2::XMLElement* element, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context, TmxTilesetLoads* tilesetLoads, bool* layersStarted);
+TmxReturn _parsePropertyNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxPropertyMap_t* outPropertyMap);
 TmxReturn _parseImageNode(tinyxml2::XMLElement* element, TmxImage* outImage);
-TmxReturn _parseTileset(tinyxml2::XMLElement* element, TmxTileset* outTileset);
-TmxReturn _parseTilesetNode(tinyxml2::XMLElement* element, TmxTileset* outTileset, std::string tilesetPath);
-TmxReturn _parseTileDefinitionNode(tinyxml2::XMLElement* element, TmxTileDefinition* outTileDefinition);
+TmxReturn _parseTileset(tinyxml2::XMLElement* element, const TmxParseFilter& tileDefinitionFilter, TmxParseContext* context, TmxTileset* outTileset);
+TmxReturn _parseTilesetNode(tinyxml2::XMLElement* element, TmxTileset* outTileset, std::string tilesetPath, const TmxParseOptions& options, TmxParseContext* context, bool deferExternal);
+TmxReturn _loadExternalTileset(const std::string& fileName, const TmxParseOptions& options, TmxParseContext* context, TmxTileset* outTileset);
+TmxReturn _parseCachedTilesetFile(const std::string& fileName, TmxParseContext* context, std::shared_ptr<const TmxTileset>* outTileset);
+TmxReturn _parseTilesetFile(const std::string& fileName, TmxParseContext* context, TmxTileset* outTileset);
+TmxReturn _parseTileDefinitionNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxTileDefinition* outTileDefinition);
 TmxReturn _parseTileAnimationNode(tinyxml2::XMLElement* element, TmxAnimationFrameCollection_t* outAnimationCollection);
-TmxReturn _parseLayerNode(tinyxml2::XMLElement* element, const TmxTilesetCollection_t& tilesets, TmxLayer* outLayer);
-TmxReturn _parseLayerDataNode(tinyxml2::XMLElement* element, const TmxTilesetCollection_t& tilesets, TmxLayerTileCollection_t* outTileCollection, unsigned int dataLength);
-TmxReturn _parseLayerXmlTileNode(tinyxml2::XMLElement* element, const TmxTilesetCollection_t& tilesets, TmxLayerTile* outTile);
-TmxReturn _calculateTileIndices(const TmxTilesetCollection_t& tilesets, TmxLayerTile* outTile);
-TmxReturn _parseObjectGroupNode(tinyxml2::XMLElement* element, TmxObjectGroup* outObjectGroup);
-TmxReturn _parseObjectNode(tinyxml2::XMLElement* element, TmxObject* outObj);
+TmxReturn _parseLayerNode(tinyxml2::XMLElement* element, const TmxTilesetLookup& lookup, bool infinite, const TmxParseOptions& options, TmxParseContext* context, ThreadPool* chunkPool, TmxLayer* outLayer);
+TmxReturn _parseLayerAttributes(tinyxml2::XMLElement* element, TmxParseContext* context, TmxLayer* outLayer);
+TmxReturn _keepLazyLayerData(tinyxml2::XMLElement* dataElement, tinyxml2::XMLElement* element, size_t count, TmxParseContext* context, std::shared_ptr<TmxLazyLayerData>* outLazyData);
+TmxReturn _parseLayerChunks(tinyxml2::XMLElement* dataElement, const TmxTilesetLookup& lookup, const TmxParseOptions& options, TmxParseContext* context, ThreadPool* pool, TmxLayer* outLayer);
+TmxReturn _parseLayerChunkAttributes(tinyxml2::XMLElement* element, TmxLayerChunk* outChunk);
+TmxReturn _parseLayerChunkData(tinyxml2::XMLElement* dataElement, tinyxml2::XMLElement* element, const TmxTilesetLookup& lookup, TmxLayerStorage storage, const TmxParseOptions& options, TmxParseContext* context, TmxLayerChunk* outChunk, bool* outUnknownGids);
+void _finishLayerChunks(TmxLayer* outLayer);
+static void _beginTilesetLoad(TmxTilesetLoads* tilesetLoads, const TmxTileset& tileset, size_t slot, const std::string& fileName, const TmxParseOptions& options, TmxParseContext* context);
+TmxReturn _parsePendingMapData(TmxTilesetLoads& tilesetLoads, const std::vector<TmxPendingLayer>& pendingLayers, TmxMap* outMap, const TmxParseOptions& options, TmxParseContext* context);
+TmxReturn _parsePendingLayers(const std::vector<TmxPendingLayer>& pendingLayers, TmxMap* outMap, const TmxParseOptions& options, TmxParseContext* context);
+TmxReturn _parsePendingLayer(const TmxPendingLayer& pendingLayer, const TmxTilesetLookup& lookup, bool infinite, const TmxParseOptions& options, TmxParseContext* context, ThreadPool* chunkPool, TmxLayer* outLayer);
+ThreadPool* _getLayerPool(TmxParseContext* context, unsigned int threadCount);
+static void _shareParseMemory(TmxParseContext* context);
+static void _useParseAllocator(TmxParseContext* context, TmxAllocator* allocator, bool budgeted);
+TmxReturn _parseLayerDataNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxLayerGidSink* sink);
+TmxReturn _beginLayerData(tinyxml2::XMLElement* dataElement, tinyxml2::XMLElement* element, TmxParseContext* context, TmxLayerDataCursor* outCursor);
+TmxReturn _beginLayerBase64Data(const char* text, size_t textLength, const char* compression, TmxParseContext* context, TmxLayerDataCursor* outCursor);
+TmxReturn _parseLayerDataChunk(TmxLayerDataCursor* cursor, TmxParseContext* context, TmxLayerGidSink* sink, size_t maxTiles);
+TmxReturn _parseLayerXmlChunk(TmxLayerDataCursor* cursor, TmxLayerGidSink* sink, size_t maxTiles);
+TmxReturn _parseLayerCsvChunk(TmxLayerDataCursor* cursor, TmxLayerGidSink* sink, size_t maxTiles);
+TmxReturn _parseLayerBase64Chunk(TmxLayerDataCursor* cursor, TmxParseContext* context, TmxLayerGidSink* sink, size_t maxTiles);
+const TmxTilesetRange* _findTilesetRange(const TmxTilesetLookup& lookup, unsigned int gid);
+TmxReturn _parseObjectGroupNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxObjectGroup* outObjectGroup);
+TmxReturn _parseObjectGroupAttributes(tinyxml2::XMLElement* element, TmxParseContext* context, TmxObjectGroup* outObjectGroup);
+TmxReturn _parseObjectNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxObject* outObj);
 TmxReturn _parseOffsetNode(tinyxml2::XMLElement* element, TmxOffset* offset);
-TmxReturn _parseImageLayerNode(tinyxml2::XMLElement* element, TmxImageLayer* outImageLayer);
+TmxReturn _parseImageLayerNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxImageLayer* outImageLayer);
+TmxReturn _finishTilesets(TmxMap* outMap, const TmxParseOptions& options);
+
+
+static inline bool _isCancelled(const TmxParseOptions& options)
+{
+	return options.cancel != NULL && options.cancel->load(std::memory_order_relaxed);
+}
 
-TmxReturn parseFromFile(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath)
+
+static inline void _reportProgress(const TmxParseOptions& options, TmxParsePhase phase, size_t done, size_t total)
 {
-	tinyxml2::XMLDocument doc;
-	if (doc.LoadFile(fileName.c_str()) != tinyxml2::XML_SUCCESS)
+	if (options.progress)
 	{
-		LOGE("Cannot read xml file");
-		return TmxReturn::kErrorParsing;
+		options.progress(phase, (unsigned int)done, (unsigned int)total);
 	}
+}
 
-	// parse the map node
-	return _parseStart(doc.FirstChildElement("map"), outMap, tilesetPath);
+
+bool _isFilterEmpty(const TmxParseFilter& filter)
+{
+	return filter.names.empty() && !filter.accept;
 }
 
 
-TmxReturn parseFromMemory(void* data, size_t length, TmxMap* outMap, const std::string& tilesetPath)
+bool _filterAccepts(const TmxParseFilter& filter, const std::string& name)
 {
-	tinyxml2::XMLDocument doc;
-	if (doc.Parse((char*)data, length))
+	if (_isFilterEmpty(filter) || std::find(filter.names.begin(), filter.names.end(), name) != filter.names.end())
 	{
-		LOGE("Cannot parse xml memory file...");
-		return TmxReturn::kErrorParsing;
+		return true;
 	}
 
-	return _parseStart(doc.FirstChildElement("map"), outMap, tilesetPath);
+	return filter.accept && filter.accept(name);
 }
 
 
-TmxReturn _parseStart(tinyxml2::XMLElement* element, TmxMap* outMap, const std::string& tilesetPath)
+// The name an element is filtered by, tiles go by their type
+static const char* _filterName(tinyxml2::XMLElement* element)
 {
-	TmxReturn retVal = _parseMapNode(element, outMap, tilesetPath);
-	return (retVal == TmxReturn::kSuccess) ? _parseEnd(outMap, tilesetPath) : retVal;
+	const char* name = NULL;
+	if (strcmp(element->Name(), "tile") == 0)
+	{
+		name = element->Attribute("type");
+		if (name == NULL)
+			name = element->Attribute("class");
+	}
+	else
+	{
+		name = element->Attribute("name");
+	}
+
+	return (name != NULL) ? name : "";
 }
 
 
-TmxReturn _parseEnd(TmxMap* outMap, const std::string& tilesetPath)
+// element, or the first of its following siblings named like it, that passes filter
+static tinyxml2::XMLElement* _firstAccepted(tinyxml2::XMLElement* element, const TmxParseFilter& filter)
 {
-	for (auto tileIt = outMap->tilesetCollection.begin(); tileIt != outMap->tilesetCollection.end(); ++tileIt)
-		_parseEndHelper(tileIt->image, tilesetPath);
-
-	for (auto tileIt = outMap->imageLayerCollection.begin(); tileIt != outMap->imageLayerCollection.end(); ++tileIt)
-		_parseEndHelper(tileIt->image, tilesetPath);
+	if (_isFilterEmpty(filter))
+	{
+		return element;
+	}
 
-	return TmxReturn::kSuccess;
+	while (element != NULL && !_filterAccepts(filter, _filterName(element)))
+	{
+		element = element->NextSiblingElement(element->Name());
+	}
+	return element;
 }
 
 
-std::string _updatePath(std::string path, const std::string& tilesetPath)
+static size_t _countChildElements(tinyxml2::XMLElement* element, const char* name, const TmxParseFilter& filter = TmxParseFilter())
 {
-	auto pathSeperatorMissing = (path.find(PATH_SEPARATOR) == std::string::npos);
-	auto pathSeperatorAltMissing = (path.find(PATH_SEPARATOR_ALT) == std::string::npos);
+	size_t count = 0;
+	for (tinyxml2::XMLElement* child = _firstAccepted(element->FirstChildElement(name), filter); child != NULL; child = _firstAccepted(child->NextSiblingElement(name), filter))
+		count++;
+	return count;
+}
 
-	if (pathSeperatorMissing && pathSeperatorAltMissing) // no path_seperator found --> relative path
-	{
-		std::string baseFilename = path.substr(path.find_last_of(PATH_SEPARATOR) + 1);
 
-		/*
-		 * here we find out what separator is used in tilesetPath and choose it
-		 * if both (alternative and normal) separators are used, we always use the normal separator
-		 **/
-		auto seperatorThere = (tilesetPath.find(PATH_SEPARATOR) != std::string::npos);
-		auto seperatorAltThere = (tilesetPath.find(PATH_SEPARATOR_ALT) != std::string::npos);
-		auto tileSetPathSeparator = PATH_SEPARATOR;
+// Map is an unordered_map wherever the compiler has one
+template <typename TKey, typename TValue, typename THash, typename TEqual, typename TAllocator>
+static void _reserveMap(std::unordered_map<TKey, TValue, THash, TEqual, TAllocator>& map, size_t count)
+{
+	map.reserve(count);
+}
 
-		if (!seperatorThere && seperatorAltThere) // only alternative separator exists in tilesetPath --> choose it
-			tileSetPathSeparator = PATH_SEPARATOR_ALT;
 
-		return tilesetPath + tileSetPathSeparator + baseFilename;
-	}
+template <typename TKey, typename TValue, typename TLess, typename TAllocator>
+static void _reserveMap(std::map<TKey, TValue, TLess, TAllocator>&, size_t)
+{
+}
 
-  return path;
+
+TmxReturn parseFromFile(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options)
+{
+	TmxParser parser;
+	return parser.parseFromFile(fileName, outMap, tilesetPath, options);
 }
 
 
-void _parseEndHelper(TmxImage& image, const std::string& tilesetPath)
+TmxReturn parseFromMemory(void* data, size_t length, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options)
 {
-  image.source = _updatePath(image.source, tilesetPath);
+	TmxParser parser;
+	return parser.parseFromMemory(data, length, outMap, tilesetPath, options);
 }
 
 
-TmxReturn _parseMapNode(tinyxml2::XMLElement* element, TmxMap* outMap, std::string tilesetPath)
+// Runs asynchronous parses that were not given an executor.  A worker waiting on the layers of its map may
+// start another map meanwhile, so contexts go to whichever parse needs one, as in parseBatchFromFiles.
+struct TmxAsyncPool
 {
-	if (element == NULL)
+	ThreadPool* pool;
+	std::mutex contextMutex;
+	std::vector<TmxParseContext*> freeContexts;
+	std::vector<TmxParseContext*> contexts;
+
+	TmxAsyncPool()
 	{
-		return TmxReturn::kMissingMapNode;
+		pool = new ThreadPool(std::max(1u, std::thread::hardware_concurrency()));
+	}
+	~TmxAsyncPool()
+	{
+		delete pool; // runs whatever is still queued first
+		for (size_t i = 0; i < contexts.size(); i++)
+			delete contexts[i];
 	}
 
-	outMap->version = element->Attribute("version");
-	const char* orientation = element->Attribute("orientation");
-	if (orientation != NULL)
+	// parses that leave the thread count to the library decode their layers on this pool rather than one each
+	TmxParseContext* acquireContext(unsigned int threadCount)
 	{
-		if (strcmp(orientation, "orthogonal") == 0)
+		TmxParseContext* context = NULL;
 		{
-			outMap->orientation = TmxOrientation::kOrthogonal;
+			std::lock_guard<std::mutex> lock(contextMutex);
+			if (freeContexts.empty())
+			{
+				context = new TmxParseContext();
+				contexts.push_back(context);
+			}
+			else
+			{
+				context = freeContexts.back();
+				freeContexts.pop_back();
+			}
 		}
-		else if (strcmp(orientation, "isometric") == 0)
+		context->sharedPool = (threadCount == 0) ? pool : NULL;
+		return context;
+	}
+
+	void releaseContext(TmxParseContext* context)
+	{
+		std::lock_guard<std::mutex> lock(contextMutex);
+		freeContexts.push_back(context);
+	}
+};
+
+
+static TmxAsyncPool& _asyncPool()
+{
+	static TmxAsyncPool asyncPool;
+	return asyncPool;
+}
+
+
+std::future<TmxReturn> parseFromFileAsync(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, const TmxParseCallback& onComplete, const TmxExecutor& executor)
+{
+	std::shared_ptr<std::promise<TmxReturn> > promise = std::make_shared<std::promise<TmxReturn> >();
+	std::future<TmxReturn> result = promise->get_future();
+
+	// the jobs hold copies of everything but the map, the caller's arguments may be gone by the time they run.
+	// Whatever the parse or onComplete throw ends up in the future, which becomes ready either way.
+	auto finish = [promise, onComplete](const std::function<TmxReturn()>& parse)
+	{
+		try
 		{
-			outMap->orientation = TmxOrientation::kIsometric;
+			TmxReturn retVal = parse();
+			if (onComplete)
+			{
+				onComplete(retVal);
+			}
+			promise->set_value(retVal);
 		}
-		else if (strcmp(orientation, "staggered") == 0)
+		catch (...)
 		{
-			outMap->orientation = TmxOrientation::kStaggered;
+			promise->set_exception(std::current_exception());
 		}
+	};
+
+	if (executor)
+	{
+		executor([=]()
+		{
+			finish([&]()
+			{
+				TmxParser parser;
+				return parser.parseFromFile(fileName, outMap, tilesetPath, options);
+			});
+		});
 	}
 	else
 	{
-		LOGW("Missing orientation attribute");
+		TmxAsyncPool& asyncPool = _asyncPool();
+		asyncPool.pool->enqueue([=, &asyncPool](unsigned int)
+		{
+			finish([&]()
+			{
+				// a context the parse threw out of is not reused, the pool still frees it
+				TmxParseContext* context = asyncPool.acquireContext(options.threadCount);
+				TmxReturn retVal = _parseFile(fileName, outMap, tilesetPath, options, context);
+				asyncPool.releaseContext(context);
+				return retVal;
+			});
+		});
 	}
 
-	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "width", &outMap->width);
-	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "height", &outMap->height);
-	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "tilewidth", &outMap->tileWidth);
-	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "tileheight", &outMap->tileHeight);
+	return result;
+}
 
-	CHECK_AND_RETRIEVE_OPT_ATTRIBUTE_STRING(element, "backgroundcolor", outMap->backgroundColor);
-	CHECK_AND_RETRIEVE_OPT_ATTRIBUTE_STRING(element, "renderorder", outMap->renderOrder);
 
+TmxReturn parseBatchFromFiles(const std::vector<std::string>& fileNames, std::vector<TmxMap>* outMaps, std::vector<TmxReturn>* outResults, const std::string& tilesetPath, const TmxParseOptions& options, TmxBatchStats* outStats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-	TmxReturn error = _parsePropertyNode(element->FirstChildElement("properties"), &outMap->propertyMap);
-	if (error)
+	outMaps->clear();
+	outMaps->resize(fileNames.size());
+	outResults->assign(fileNames.size(), TmxReturn::kSuccess);
+
+	unsigned int threadCount = options.threadCount;
+	if (threadCount == 0)
 	{
-		LOGE("Error processing map properties...");
-		return error;
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
 	}
 
-	for (tinyxml2::XMLElement* child = element->FirstChildElement("tileset"); child != NULL; child = child->NextSiblingElement("tileset"))
+	// progress is per map, it would just interleave here
+	TmxParseOptions mapOptions = options;
+	mapOptions.progress = TmxProgressCallback();
+
+	// a worker waiting on its map's layers may start another map meanwhile, so contexts go
+	// to whichever map job needs one rather than to a worker
+	std::mutex contextMutex;
+	std::vector<TmxParseContext*> freeContexts;
+	std::vector<TmxParseContext*> contexts;
+
+	// what a map job throws reaches the caller once every job is done, as it would without the pool
+	std::exception_ptr error;
 	{
-		TmxTileset set;
-		error = _parseTilesetNode(child, &set, tilesetPath);
-		if (error)
+		ThreadPool pool(threadCount);
+		ThreadPool::Group maps;
+		for (size_t i = 0; i < fileNames.size(); i++)
 		{
-			LOGE("Error processing tileset node...");
-			return error;
+			pool.enqueue([&, i](unsigned int)
+			{
+				if (_isCancelled(options))
+				{
+					(*outResults)[i] = TmxReturn::kCancelled;
+					return;
+				}
+
+				TmxParseContext* context = NULL;
+				{
+					std::lock_guard<std::mutex> lock(contextMutex);
+					if (freeContexts.empty())
+					{
+						context = new TmxParseContext();
+						context->sharedPool = &pool;
+						contexts.push_back(context);
+					}
+					else
+					{
+						context = freeContexts.back();
+						freeContexts.pop_back();
+					}
+				}
+
+				(*outResults)[i] = _parseFile(fileNames[i], &(*outMaps)[i], tilesetPath, mapOptions, context);
+
+				std::lock_guard<std::mutex> lock(contextMutex);
+				freeContexts.push_back(context);
+			}, &maps);
 		}
 
-		outMap->tilesetCollection.push_back(set);
+		try
+		{
+			pool.wait(maps);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
 	}
 
-	for (tinyxml2::XMLElement* child = element->FirstChildElement("layer"); child != NULL; child = child->NextSiblingElement("layer"))
+	for (size_t i = 0; i < contexts.size(); i++)
 	{
-		TmxLayer layer;
-		error = _parseLayerNode(child, outMap->tilesetCollection, &layer);
-		if (error)
-		{
-			LOGE("Error processing layer node...");
-			return error;
-		}
+		delete contexts[i];
+	}
 
-		outMap->layerCollection.push_back(layer);
+	if (error)
+	{
+		std::rethrow_exception(error);
 	}
 
-	for (tinyxml2::XMLElement* child = element->FirstChildElement("objectgroup"); child != NULL; child = child->NextSiblingElement("objectgroup"))
+	TmxReturn retVal = TmxReturn::kSuccess;
+	TmxBatchStats stats;
+	stats.mapCount = (unsigned int)fileNames.size();
+	for (size_t i = 0; i < fileNames.size(); i++)
 	{
-		TmxObjectGroup group;
-		error = _parseObjectGroupNode(child, &group);
-		if (error)
+		if ((*outResults)[i] != TmxReturn::kSuccess)
 		{
-			LOGE("Error processing objectgroup node...");
-			return error;
+			stats.failedCount++;
+			if (retVal == TmxReturn::kSuccess)
+			{
+				retVal = (*outResults)[i];
+			}
+			continue;
 		}
 
-		outMap->objectGroupCollection.push_back(group);
+		struct stat fileInfo;
+		if (stat(fileNames[i].c_str(), &fileInfo) == 0)
+		{
+			stats.byteCount += (unsigned long long)fileInfo.st_size;
+		}
 	}
 
-	for (tinyxml2::XMLElement* child = element->FirstChildElement("imagelayer"); child != NULL; child = child->NextSiblingElement("imagelayer"))
+	if (outStats != NULL)
 	{
-		TmxImageLayer imageLayer;
-		error = _parseImageLayerNode(child, &imageLayer);
-		if (error)
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (stats.seconds > 0.0)
 		{
-			LOGE("Error parsing imagelayer node...");
-			return error;
+			stats.mapsPerSecond = (stats.mapCount - stats.failedCount) / stats.seconds;
+			stats.megabytesPerSecond = (stats.byteCount / (1024.0 * 1024.0)) / stats.seconds;
 		}
-
-		outMap->imageLayerCollection.push_back(imageLayer);
+		*outStats = stats;
 	}
 
-	return error;
+	return retVal;
 }
 
 
-TmxReturn _parsePropertyNode(tinyxml2::XMLElement* element, TmxPropertyMap_t* outPropertyMap)
+TmxParser::TmxParser()
+	: _context(new TmxParseContext())
 {
-	if (element == NULL)
+}
+
+
+TmxParser::~TmxParser()
+{
+	delete _context;
+}
+
+
+TmxReturn TmxParser::parseFromFile(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options)
+{
+	return _parseFile(fileName, outMap, tilesetPath, options, _context);
+}
+
+
+TmxReturn _parseFile(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context)
+{
+	TMX_ARENA_SCOPE(options.arena);
+	MappedFile file;
+	if (!file.open(fileName))
 	{
-		// ignore this, not everything requires properties
-		return TmxReturn::kSuccess;
+		LOGE("Cannot read xml file");
+		return TmxReturn::kErrorParsing;
 	}
 
-	for (tinyxml2::XMLElement* child = element->FirstChildElement("property"); child != NULL; child = child->NextSiblingElement("property"))
+	TmxReturn error = _beginParseMemory(context, options, file.size());
+	if (error)
 	{
-		if (strcmp(child->Name(), "property") == 0)
-		{
-			if (child->Attribute("name") != NULL && child->Attribute("value") != NULL)
-			{
-				(*outPropertyMap)[child->Attribute("name")] = child->Attribute("value");
-			}
-			else
-			{
-				return TmxReturn::kMalformedPropertyNode;
-			}
-		}
+		return error;
 	}
 
-	return TmxReturn::kSuccess;
+	if (options.parseMode == kParseModeStreaming)
+	{
+		// scanned in place, only one child of <map> is ever copied out of the mapping
+		return _parseStreaming(file.data(), file.size(), outMap, tilesetPath, options, context);
+	}
+
+	tinyxml2::XMLDocument& doc = context->document;
+	if (doc.Parse(file.data(), file.size()) != tinyxml2::XML_SUCCESS)
+	{
+		LOGE("Cannot parse xml file");
+		doc.Clear();
+		return TmxReturn::kErrorParsing;
+	}
+	file.close();
+	_reportProgress(options, kParsePhaseXml, 1, 1);
+
+	// parse the map node
+	TmxReturn retVal = _parseStart(doc.FirstChildElement("map"), outMap, tilesetPath, options, context);
+	doc.Clear();
+	return retVal;
 }
 
 
-TmxReturn _parseImageNode(tinyxml2::XMLElement* element, TmxImage* outImage)
+TmxReturn TmxParser::parseFromMemory(void* data, size_t length, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options)
 {
-	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE_STRING(element, "source", outImage->source);
-	CHECK_AND_RETRIEVE_OPT_ATTRIBUTE_STRING(element, "format", outImage->format);
-	CHECK_AND_RETRIEVE_OPT_ATTRIBUTE_STRING(element, "trans", outImage->transparentColor);
+	TMX_ARENA_SCOPE(options.arena);
+	TmxReturn error = _beginParseMemory(_context, options, length);
+	if (error)
+	{
+		return error;
+	}
 
-	outImage->width = element->UnsignedAttribute("width");
-	outImage->height = element->UnsignedAttribute("height");
+	if (options.parseMode == kParseModeStreaming)
+	{
+		return _parseStreaming((const char*)data, length, outMap, tilesetPath, options, _context);
+	}
 
-	return TmxReturn::kSuccess;
-}
+	tinyxml2::XMLDocument& doc = _context->document;
+	if (doc.Parse((char*)data, length))
+	{
+		LOGE("Cannot parse xml memory file...");
+		doc.Clear();
+		return TmxReturn::kErrorParsing;
+	}
+	_reportProgress(options, kParsePhaseXml, 1, 1);
 
+	TmxReturn retVal = _parseStart(doc.FirstChildElement("map"), outMap, tilesetPath, options, _context);
+	doc.Clear();
+	return retVal;
+}
 
-TmxReturn _parseTileset(tinyxml2::XMLElement* element, TmxTileset* outTileset)
-{
-  char const* name = element->Attribute("name");
-  if (name != nullptr)
-  {
-    outTileset->name = name;
-  }
 
-  CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "tilewidth", &outTileset->tileWidth);
-  CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "tileheight", &outTileset->tileHeight);
-  outTileset->tileSpacingInImage = element->UnsignedAttribute("spacing");
-  outTileset->tileMarginInImage = element->UnsignedAttribute("margin");
+// A time budgeted step checks the clock after at most this many tiles, or objects
+#define LOAD_STEP_TILE_CHUNK 4096
+#define LOAD_STEP_OBJECT_CHUNK 64
 
-  // TODO - read TODO at end of this function
-  if (element->FirstChildElement("image") == NULL)
-  {
-    LOGE("We do not support maps with tilesets that have no image associated currently...");
-    return kErrorParsing;
-  }
 
-  TmxImage image;
-  TmxReturn error = _parseImageNode(element->FirstChildElement("image"), &outTileset->image);
-  if (error)
-  {
-    LOGE("Error parsing image node...");
-    return error;
-  }
+typedef enum
+{
+	kLoadStageXml,
+	kLoadStageTilesets,
+	kLoadStageLayers,
+	kLoadStageObjectGroups,
+	kLoadStageImageLayers,
+	kLoadStageDone,
+} TmxLoadStage;
 
-  outTileset->offset.x = 0;
-  outTileset->offset.y = 0;
 
-  if (element->FirstChildElement("tileoffset") != NULL)
-  {
+// Everything a TmxMapLoader needs to carry on where its last step stopped
+struct TmxMapLoadState
+{
+	TmxParseContext context;
+	MappedFile file;
+	TmxMap* map;
+	std::string tilesetPath;
+	TmxParseOptions options;
+
+	TmxLoadStage stage;
+	TmxReturn result;
+	tinyxml2::XMLElement* mapElement;
+	tinyxml2::XMLElement* next;			// next child of <map> for the current stage
+	bool childStarted;					// next is a layer or object group that is partly parsed
+	tinyxml2::XMLElement* nextObject;
+	tinyxml2::XMLElement* dataElement;	// <data> of the layer in progress
+	tinyxml2::XMLElement* nextChunk;	// infinite maps, <chunk> after the one in progress
+	TmxLayerGidSink sink;
+	TmxLayerDataCursor cursor;
+	size_t layersDone;
+	size_t layersTotal;
+	size_t objectsDone;
+	size_t objectsTotal;
+};
+
+
+static TmxReturn _stepMapLoadXml(TmxMapLoadState* state)
+{
+	tinyxml2::XMLDocument& doc = state->context.document;
+	if (doc.Parse(state->file.data(), state->file.size()) != tinyxml2::XML_SUCCESS)
+	{
+		LOGE("Cannot parse xml file");
+		return TmxReturn::kErrorParsing;
+	}
+	state->file.close();
+	_reportProgress(state->options, kParsePhaseXml, 1, 1);
+
+	tinyxml2::XMLElement* element = doc.FirstChildElement("map");
+	if (element == NULL)
+	{
+		return TmxReturn::kMissingMapNode;
+	}
+
+	TmxReturn error = _parseMapAttributes(element, state->map);
+	if (error)
+	{
+		return error;
+	}
+
+	error = _parsePropertyNode(element->FirstChildElement("properties"), &state->context, &state->map->propertyMap);
+	if (error)
+	{
+		LOGE("Error processing map properties...");
+		return error;
+	}
+
+	state->mapElement = element;
+	state->layersTotal = _countChildElements(element, "layer", state->options.layerFilter);
+	size_t objectGroupCount = _countChildElements(element, "objectgroup", state->options.objectGroupFilter);
+	size_t imageLayerCount = _countChildElements(element, "imagelayer", state->options.imageLayerFilter);
+	state->objectsTotal = objectGroupCount + imageLayerCount;
+
+	TmxMap* map = state->map;
+	map->tilesetCollection.reserve(_countChildElements(element, "tileset"));
+	map->layerCollection.reserve(state->layersTotal);
+	map->objectGroupCollection.reserve(objectGroupCount);
+	map->imageLayerCollection.reserve(imageLayerCount);
+	state->next = element->FirstChildElement("tileset");
+	state->stage = kLoadStageTilesets;
+	return error;
+}
+
+
+// Starts decoding the next chunk of the layer in progress, or the layer's own data if it has no chunks
+static TmxReturn _beginMapLoadLayerData(TmxMapLoadState* state)
+{
+	TmxLayer* layer = &state->map->layerCollection.back();
+	TmxLayerTileCollection_t* tiles = &layer->tiles;
+	TmxLayerGidCollection_t* gids = &layer->gids;
+	size_t count = (size_t)layer->width * layer->height;
+	tinyxml2::XMLElement* element = state->dataElement;
+
+	if (state->nextChunk != NULL)
+	{
+		layer->chunks.push_back(TmxLayerChunk());
+		TmxLayerChunk* chunk = &layer->chunks.back();
+
+		TmxReturn error = _parseLayerChunkAttributes(state->nextChunk, chunk);
+		if (error)
+		{
+			return error;
+		}
+
+		tiles = &chunk->tiles;
+		gids = &chunk->gids;
+		count = (size_t)chunk->width * chunk->height;
+		element = state->nextChunk;
+		state->nextChunk = state->nextChunk->NextSiblingElement("chunk");
+	}
+
+	TmxReturn error = _beginLayerGids(tiles, gids, count, state->options.layerStorage, state->map->tilesetLookup, &state->context, &state->sink);
+	if (error)
+	{
+		return error;
+	}
+	state->sink.cancel = state->options.cancel;
+
+	return _beginLayerData(state->dataElement, element, &state->context, &state->cursor);
+}
+
+
+// The layer in progress is complete, moves on to the next one
+static void _finishMapLoadLayer(TmxMapLoadState* state)
+{
+	_finishLayerChunks(&state->map->layerCollection.back());
+	state->childStarted = false;
+	state->next = _firstAccepted(state->next->NextSiblingElement("layer"), state->options.layerFilter);
+	_reportProgress(state->options, kParsePhaseLayers, ++state->layersDone, state->layersTotal);
+}
+
+
+static TmxReturn _stepMapLoadLayer(TmxMapLoadState* state, size_t maxUnits, size_t* outUnits)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+	TmxMap* map = state->map;
+
+	if (!state->childStarted)
+	{
+		map->layerCollection.push_back(TmxLayer());
+		TmxLayer* layer = &map->layerCollection.back();
+
+		error = _parseLayerAttributes(state->next, &state->context, layer);
+		if (error)
+		{
+			return error;
+		}
+
+		state->dataElement = state->next->FirstChildElement("data");
+		if (state->dataElement == NULL)
+		{
+			LOGE("Layer missing data node...");
+			return TmxReturn::kMissingDataNode;
+		}
+
+		state->nextChunk = state->dataElement->FirstChildElement("chunk");
+		if (map->infinite && state->nextChunk == NULL)
+		{
+			// an empty layer of an infinite map, it has no chunks to decode
+			_finishMapLoadLayer(state);
+			*outUnits += 1;
+			return error;
+		}
+
+		error = _beginMapLoadLayerData(state);
+		if (error)
+		{
+			return error;
+		}
+		state->childStarted = true;
+	}
+
+	size_t firstIndex = state->sink.index;
+	error = _parseLayerDataChunk(&state->cursor, &state->context, &state->sink, std::min(maxUnits, (size_t)LOAD_STEP_TILE_CHUNK));
+	if (error)
+	{
+		return error;
+	}
+	*outUnits += std::max((size_t)1, state->sink.index - firstIndex);
+
+	if (state->cursor.done && state->nextChunk != NULL)
+	{
+		bool unknownGids = state->sink.unknownGids;
+		error = _beginMapLoadLayerData(state);
+		state->sink.unknownGids |= unknownGids;
+		return error;
+	}
+
+	if (state->cursor.done)
+	{
+		if (state->sink.unknownGids)
+		{
+			LOGW("Layer references gids outside of every tileset...");
+		}
+
+		_finishMapLoadLayer(state);
+	}
+
+	return error;
+}
+
+
+static TmxReturn _stepMapLoadObjectGroup(TmxMapLoadState* state, size_t maxUnits, size_t* outUnits)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+	TmxMap* map = state->map;
+
+	if (!state->childStarted)
+	{
+		map->objectGroupCollection.push_back(TmxObjectGroup());
+		error = _parseObjectGroupAttributes(state->next, &state->context, &map->objectGroupCollection.back());
+		if (error)
+		{
+			LOGE("Error processing objectgroup node...");
+			return error;
+		}
+
+		map->objectGroupCollection.back().objects.reserve(_countChildElements(state->next, "object"));
+		state->nextObject = state->next->FirstChildElement("object");
+		state->childStarted = true;
+	}
+
+	TmxObjectGroup& group = map->objectGroupCollection.back();
+	size_t objectCount = 0;
+	size_t lastObjectCount = std::max((size_t)1, std::min(maxUnits, (size_t)LOAD_STEP_OBJECT_CHUNK));
+	for (; state->nextObject != NULL && objectCount < lastObjectCount; state->nextObject = state->nextObject->NextSiblingElement("object"), objectCount++)
+	{
+		group.objects.push_back(TmxObject());
+		error = _parseObjectNode(state->nextObject, &state->context, &group.objects.back());
+		if (error)
+		{
+			LOGE("Error parsing object node...");
+			return _parseMemoryError(&state->context);
+		}
+	}
+	*outUnits += std::max((size_t)1, objectCount);
+
+	if (state->nextObject == NULL)
+	{
+		state->childStarted = false;
+		state->next = _firstAccepted(state->next->NextSiblingElement("objectgroup"), state->options.objectGroupFilter);
+		_reportProgress(state->options, kParsePhaseObjects, ++state->objectsDone, state->objectsTotal);
+	}
+
+	return error;
+}
+
+
+// Does one chunk of work of the current stage, a stage moves on to the next once its elements run out
+static TmxReturn _stepMapLoadChunk(TmxMapLoadState* state, size_t maxUnits, size_t* outUnits)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+	TmxMap* map = state->map;
+
+	switch (state->stage)
+	{
+	case kLoadStageXml:
+		*outUnits += 1;
+		return _stepMapLoadXml(state);
+
+	case kLoadStageTilesets:
+		if (state->next == NULL)
+		{
+			state->next = _firstAccepted(state->mapElement->FirstChildElement("layer"), state->options.layerFilter);
+			state->stage = kLoadStageLayers;
+			return _finishTilesets(map, state->options);
+		}
+		else
+		{
+			map->tilesetCollection.push_back(TmxTileset());
+			error = _parseTilesetNode(state->next, &map->tilesetCollection.back(), state->tilesetPath, state->options, &state->context, false);
+			if (error)
+			{
+				LOGE("Error processing tileset node...");
+				return error;
+			}
+
+			state->next = state->next->NextSiblingElement("tileset");
+			*outUnits += 1;
+			return error;
+		}
+
+	case kLoadStageLayers:
+		if (state->next == NULL)
+		{
+			state->next = _firstAccepted(state->mapElement->FirstChildElement("objectgroup"), state->options.objectGroupFilter);
+			state->stage = kLoadStageObjectGroups;
+			return error;
+		}
+		return _stepMapLoadLayer(state, maxUnits, outUnits);
+
+	case kLoadStageObjectGroups:
+		if (state->next == NULL)
+		{
+			state->next = _firstAccepted(state->mapElement->FirstChildElement("imagelayer"), state->options.imageLayerFilter);
+			state->stage = kLoadStageImageLayers;
+			return error;
+		}
+		return _stepMapLoadObjectGroup(state, maxUnits, outUnits);
+
+	case kLoadStageImageLayers:
+		if (state->next == NULL)
+		{
+			state->stage = kLoadStageDone;
+			return _parseEnd(map, state->tilesetPath);
+		}
+		else
+		{
+			map->imageLayerCollection.push_back(TmxImageLayer());
+			error = _parseImageLayerNode(state->next, &state->context, &map->imageLayerCollection.back());
+			if (error)
+			{
+				LOGE("Error parsing imagelayer node...");
+				return error;
+			}
+
+			state->next = _firstAccepted(state->next->NextSiblingElement("imagelayer"), state->options.imageLayerFilter);
+			_reportProgress(state->options, kParsePhaseObjects, ++state->objectsDone, state->objectsTotal);
+			*outUnits += 1;
+			return error;
+		}
+
+	case kLoadStageDone:
+		break;
+	}
+
+	return error;
+}
+
+
+static TmxReturn _stepMapLoad(TmxMapLoadState* state, std::chrono::steady_clock::time_point deadline, size_t maxUnits)
+{
+	if (state == NULL)
+	{
+		return TmxReturn::kErrorParsing;
+	}
+
+	TMX_ARENA_SCOPE(state->options.arena);
+	size_t units = 0;
+	while (state->stage != kLoadStageDone)
+	{
+		TmxReturn error = _isCancelled(state->options) ? TmxReturn::kCancelled : _stepMapLoadChunk(state, maxUnits - units, &units);
+		if (error)
+		{
+			state->stage = kLoadStageDone;
+			state->result = error;
+		}
+
+		if (state->stage == kLoadStageDone)
+		{
+			// the document is only needed while loading
+			state->context.document.Clear();
+			return state->result;
+		}
+
+		if (units >= maxUnits || std::chrono::steady_clock::now() >= deadline)
+		{
+			return TmxReturn::kInProgress;
+		}
+	}
+
+	return state->result;
+}
+
+
+TmxMapLoader::TmxMapLoader()
+	: _state(NULL)
+{
+}
+
+
+TmxMapLoader::~TmxMapLoader()
+{
+	delete _state;
+}
+
+
+TmxReturn TmxMapLoader::begin(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options)
+{
+	delete _state;
+	_state = new TmxMapLoadState();
+	_state->map = outMap;
+	_state->tilesetPath = tilesetPath;
+	_state->options = options;
+	_state->stage = kLoadStageXml;
+	_state->result = TmxReturn::kSuccess;
+	_state->mapElement = NULL;
+	_state->next = NULL;
+	_state->childStarted = false;
+	_state->nextObject = NULL;
+	_state->dataElement = NULL;
+	_state->nextChunk = NULL;
+	_state->layersDone = 0;
+	_state->layersTotal = 0;
+	_state->objectsDone = 0;
+	_state->objectsTotal = 0;
+
+	if (!_state->file.open(fileName))
+	{
+		LOGE("Cannot read xml file");
+		_state->stage = kLoadStageDone;
+		_state->result = TmxReturn::kErrorParsing;
+	}
+	else
+	{
+		_state->result = _beginParseMemory(&_state->context, options, _state->file.size());
+		if (_state->result)
+		{
+			_state->stage = kLoadStageDone;
+		}
+	}
+
+	return _state->result;
+}
+
+
+TmxReturn TmxMapLoader::step(double seconds)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+	return _stepMapLoad(_state, deadline, SIZE_MAX);
+}
+
+
+TmxReturn TmxMapLoader::stepWork(size_t workUnits)
+{
+	return _stepMapLoad(_state, std::chrono::steady_clock::time_point::max(), std::max((size_t)1, workUnits));
+}
+
+
+bool TmxMapLoader::finished() const
+{
+	return _state == NULL || _state->stage == kLoadStageDone;
+}
+
+
+TmxReturn _parseStart(tinyxml2::XMLElement* element, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context)
+{
+	TmxReturn retVal = _parseMapNode(element, outMap, tilesetPath, options, context);
+	return (retVal == TmxReturn::kSuccess) ? _parseEnd(outMap, tilesetPath) : retVal;
+}
+
+
+TmxReturn _parseEnd(TmxMap* outMap, const std::string& tilesetPath)
+{
+	for (auto tileIt = outMap->tilesetCollection.begin(); tileIt != outMap->tilesetCollection.end(); ++tileIt)
+		_parseEndHelper(tileIt->image, tilesetPath);
+
+	for (auto tileIt = outMap->imageLayerCollection.begin(); tileIt != outMap->imageLayerCollection.end(); ++tileIt)
+		_parseEndHelper(tileIt->image, tilesetPath);
+
+	return TmxReturn::kSuccess;
+}
+
+
+std::string _updatePath(std::string path, const std::string& tilesetPath)
+{
+	auto pathSeperatorMissing = (path.find(PATH_SEPARATOR) == std::string::npos);
+	auto pathSeperatorAltMissing = (path.find(PATH_SEPARATOR_ALT) == std::string::npos);
+
+	if (pathSeperatorMissing && pathSeperatorAltMissing) // no path_seperator found --> relative path
+	{
+		std::string baseFilename = path.substr(path.find_last_of(PATH_SEPARATOR) + 1);
+
+		/*
+		 * here we find out what separator is used in tilesetPath and choose it
+		 * if both (alternative and normal) separators are used, we always use the normal separator
+		 **/
+		auto seperatorThere = (tilesetPath.find(PATH_SEPARATOR) != std::string::npos);
+		auto seperatorAltThere = (tilesetPath.find(PATH_SEPARATOR_ALT) != std::string::npos);
+		auto tileSetPathSeparator = PATH_SEPARATOR;
+
+		if (!seperatorThere && seperatorAltThere) // only alternative separator exists in tilesetPath --> choose it
+			tileSetPathSeparator = PATH_SEPARATOR_ALT;
+
+		return tilesetPath + tileSetPathSeparator + baseFilename;
+	}
+
+  return path;
+}
+
+
+void _parseEndHelper(TmxImage& image, const std::string& tilesetPath)
+{
+  std::string source = _updatePath(image.source.c_str(), tilesetPath);
+  image.source.assign(source.data(), source.size());
+}
+
+
+TmxReturn _parseMapNode(tinyxml2::XMLElement* element, TmxMap* outMap, std::string tilesetPath, const TmxParseOptions& options, TmxParseContext* context)
+{
+	if (element == NULL)
+	{
+		return TmxReturn::kMissingMapNode;
+	}
+
+	TmxReturn error = _parseMapAttributes(element, outMap);
+	if (error)
+	{
+		return error;
+	}
+
+	error = _parsePropertyNode(element->FirstChildElement("properties"), context, &outMap->propertyMap);
+	if (error)
+	{
+		LOGE("Error processing map properties...");
+		return error;
+	}
+
+	// with worker threads, tsx files load while the layers decode
+	TmxTilesetLoads tilesetLoads(_getLayerPool(context, options.threadCount));
+	bool deferTilesets = (tilesetLoads.pool != NULL);
+
+	// every element is parsed straight into its collection, sized up front so none of them move
+	outMap->tilesetCollection.reserve(outMap->tilesetCollection.size() + _countChildElements(element, "tileset"));
+	for (tinyxml2::XMLElement* child = element->FirstChildElement("tileset"); child != NULL; child = child->NextSiblingElement("tileset"))
+	{
+		if (_isCancelled(options))
+		{
+			return TmxReturn::kCancelled;
+		}
+
+		outMap->tilesetCollection.push_back(TmxTileset());
+		TmxTileset& set = outMap->tilesetCollection.back();
+		error = _parseTilesetNode(child, &set, tilesetPath, options, context, deferTilesets);
+		if (error)
+		{
+			LOGE("Error processing tileset node...");
+			return error;
+		}
+
+		if (deferTilesets && !set.source.empty())
+		{
+			_beginTilesetLoad(&tilesetLoads, set, outMap->tilesetCollection.size() - 1, _updatePath(set.source.c_str(), tilesetPath), options, context);
+		}
+	}
+
+	std::vector<TmxPendingLayer> pendingLayers;
+	for (tinyxml2::XMLElement* child = _firstAccepted(element->FirstChildElement("layer"), options.layerFilter); child != NULL; child = _firstAccepted(child->NextSiblingElement("layer"), options.layerFilter))
+	{
+		TmxPendingLayer pendingLayer = { child, NULL, 0 };
+		pendingLayers.push_back(pendingLayer);
+	}
+
+	error = _parsePendingMapData(tilesetLoads, pendingLayers, outMap, options, context);
+	if (error)
+	{
+		return error;
+	}
+
+	size_t objectsDone = 0;
+	size_t objectGroupCount = _countChildElements(element, "objectgroup", options.objectGroupFilter);
+	size_t imageLayerCount = _countChildElements(element, "imagelayer", options.imageLayerFilter);
+	size_t objectsTotal = objectGroupCount + imageLayerCount;
+
+	outMap->objectGroupCollection.reserve(outMap->objectGroupCollection.size() + objectGroupCount);
+	for (tinyxml2::XMLElement* child = _firstAccepted(element->FirstChildElement("objectgroup"), options.objectGroupFilter); child != NULL; child = _firstAccepted(child->NextSiblingElement("objectgroup"), options.objectGroupFilter))
+	{
+		if (_isCancelled(options))
+		{
+			return TmxReturn::kCancelled;
+		}
+
+		outMap->objectGroupCollection.push_back(TmxObjectGroup());
+		error = _parseObjectGroupNode(child, context, &outMap->objectGroupCollection.back());
+		if (error)
+		{
+			LOGE("Error processing objectgroup node...");
+			return error;
+		}
+
+		_reportProgress(options, kParsePhaseObjects, ++objectsDone, objectsTotal);
+	}
+
+	outMap->imageLayerCollection.reserve(outMap->imageLayerCollection.size() + imageLayerCount);
+	for (tinyxml2::XMLElement* child = _firstAccepted(element->FirstChildElement("imagelayer"), options.imageLayerFilter); child != NULL; child = _firstAccepted(child->NextSiblingElement("imagelayer"), options.imageLayerFilter))
+	{
+		if (_isCancelled(options))
+		{
+			return TmxReturn::kCancelled;
+		}
+
+		outMap->imageLayerCollection.push_back(TmxImageLayer());
+		error = _parseImageLayerNode(child, context, &outMap->imageLayerCollection.back());
+		if (error)
+		{
+			LOGE("Error parsing imagelayer node...");
+			return error;
+		}
+
+		_reportProgress(options, kParsePhaseObjects, ++objectsDone, objectsTotal);
+	}
+
+	return error;
+}
+
+
+TmxReturn _parseMapAttributes(tinyxml2::XMLElement* element, TmxMap* outMap)
+{
+	outMap->version = element->Attribute("version");
+	const char* orientation = element->Attribute("orientation");
+	if (orientation != NULL)
+	{
+		if (strcmp(orientation, "orthogonal") == 0)
+		{
+			outMap->orientation = TmxOrientation::kOrthogonal;
+		}
+		else if (strcmp(orientation, "isometric") == 0)
+		{
+			outMap->orientation = TmxOrientation::kIsometric;
+		}
+		else if (strcmp(orientation, "staggered") == 0)
+		{
+			outMap->orientation = TmxOrientation::kStaggered;
+		}
+	}
+	else
+	{
+		LOGW("Missing orientation attribute");
+	}
+
+	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "width", &outMap->width);
+	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "height", &outMap->height);
+	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "tilewidth", &outMap->tileWidth);
+	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "tileheight", &outMap->tileHeight);
+
+	CHECK_AND_RETRIEVE_OPT_ATTRIBUTE_STRING(element, "backgroundcolor", outMap->backgroundColor);
+	CHECK_AND_RETRIEVE_OPT_ATTRIBUTE_STRING(element, "renderorder", outMap->renderOrder);
+	outMap->infinite = (element->IntAttribute("infinite") == 1);
+
+	return TmxReturn::kSuccess;
+}
+
+
+typedef enum
+{
+	kXmlTagStart,
+	kXmlTagEnd,
+	kXmlTagEmpty,
+	kXmlTagOther,	// comments, processing instructions, cdata, doctype
+} TmxXmlTagType;
+
+
+static const char* _findXml(const char* p, const char* end, const char* token)
+{
+	size_t tokenLength = strlen(token);
+	for (; p + tokenLength <= end; p++)
+	{
+		if (memcmp(p, token, tokenLength) == 0)
+		{
+			return p + tokenLength;
+		}
+	}
+
+	return NULL;
+}
+
+
+static bool _startsWithXml(const char* p, const char* end, const char* token)
+{
+	size_t tokenLength = strlen(token);
+	return (size_t)(end - p) >= tokenLength && memcmp(p, token, tokenLength) == 0;
+}
+
+
+// p points at a '<', returns the position just past the matching '>' or NULL if the xml ends first
+static const char* _scanXmlTag(const char* p, const char* end, TmxXmlTagType* outType)
+{
+	*outType = kXmlTagOther;
+
+	if (_startsWithXml(p, end, "<!--"))
+	{
+		return _findXml(p + 4, end, "-->");
+	}
+	if (_startsWithXml(p, end, "<![CDATA["))
+	{
+		return _findXml(p + 9, end, "]]>");
+	}
+	if (_startsWithXml(p, end, "<?"))
+	{
+		return _findXml(p + 2, end, "?>");
+	}
+	if (_startsWithXml(p, end, "<!"))
+	{
+		// doctype, possibly with an internal subset in brackets
+		int brackets = 0;
+		for (p += 2; p < end; p++)
+		{
+			if (*p == '[') brackets++;
+			else if (*p == ']') brackets--;
+			else if (*p == '>' && brackets <= 0) return p + 1;
+		}
+		return NULL;
+	}
+
+	*outType = _startsWithXml(p, end, "</") ? kXmlTagEnd : kXmlTagStart;
+
+	// attribute values may contain '>'
+	char quote = 0;
+	for (p++; p < end; p++)
+	{
+		if (quote)
+		{
+			if (*p == quote) quote = 0;
+		}
+		else if (*p == '"' || *p == '\'')
+		{
+			quote = *p;
+		}
+		else if (*p == '>')
+		{
+			if (*outType == kXmlTagStart && p[-1] == '/')
+			{
+				*outType = kXmlTagEmpty;
+			}
+			return p + 1;
+		}
+	}
+
+	return NULL;
+}
+
+
+// p points at the '<' of a start tag, returns the position just past the element's end tag
+static const char* _scanXmlElement(const char* p, const char* end)
+{
+	int depth = 0;
+	do
+	{
+		p = (const char*)memchr(p, '<', end - p);
+		if (p == NULL)
+		{
+			return NULL;
+		}
+
+		TmxXmlTagType type;
+		p = _scanXmlTag(p, end, &type);
+		if (p == NULL)
+		{
+			return NULL;
+		}
+
+		if (type == kXmlTagStart) depth++;
+		else if (type == kXmlTagEnd) depth--;
+	} while (depth > 0);
+
+	return p;
+}
+
+
+static bool _isXmlTagName(const char* p, const char* end, const char* name)
+{
+	size_t nameLength = strlen(name);
+	if ((size_t)(end - p) <= nameLength + 1 || memcmp(p + 1, name, nameLength) != 0)
+	{
+		return false;
+	}
+
+	char next = p[nameLength + 1];
+	return next == '>' || next == '/' || next == ' ' || next == '\t' || next == '\r' || next == '\n';
+}
+
+
+// Checks a child of <map> against the filters from its start tag alone, so skipped children are never parsed
+static bool _isStreamedChildAccepted(const char* tagStart, const char* tagEnd, const TmxParseOptions& options, TmxParseContext* context)
+{
+	const TmxParseFilter* filter = NULL;
+	if (_isXmlTagName(tagStart, tagEnd, "layer"))
+		filter = &options.layerFilter;
+	else if (_isXmlTagName(tagStart, tagEnd, "objectgroup"))
+		filter = &options.objectGroupFilter;
+	else if (_isXmlTagName(tagStart, tagEnd, "imagelayer"))
+		filter = &options.imageLayerFilter;
+
+	if (filter == NULL || _isFilterEmpty(*filter))
+	{
+		return true;
+	}
+
+	// the start tag closed on its own is a whole element tinyxml2 can read the name from
+	std::string tag(tagStart, tagEnd - 1);
+	if (tag[tag.size() - 1] != '/')
+	{
+		tag += '/';
+	}
+	tag += '>';
+
+	tinyxml2::XMLDocument& doc = context->document;
+	bool accepted = true;
+	if (doc.Parse(tag.c_str(), tag.size()) == tinyxml2::XML_SUCCESS)
+	{
+		accepted = _filterAccepts(*filter, _filterName(doc.FirstChildElement()));
+	}
+	doc.Clear();
+	return accepted;
+}
+
+
+TmxReturn _parseStreaming(const char* xml, size_t length, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context)
+{
+	const char* end = xml + length;
+	const char* p = xml;
+
+	// find the <map> start tag, skipping the prolog
+	const char* tagStart = NULL;
+	const char* tagEnd = NULL;
+	TmxXmlTagType type = kXmlTagOther;
+	while (type == kXmlTagOther)
+	{
+		tagStart = (p < end) ? (const char*)memchr(p, '<', end - p) : NULL;
+		if (tagStart == NULL)
+		{
+			return TmxReturn::kMissingMapNode;
+		}
+
+		tagEnd = _scanXmlTag(tagStart, end, &type);
+		if (tagEnd == NULL)
+		{
+			LOGE("Cannot parse xml, unexpected end of data...");
+			return TmxReturn::kErrorParsing;
+		}
+		p = tagEnd;
+	}
+
+	if (type == kXmlTagEnd || !_isXmlTagName(tagStart, end, "map"))
+	{
+		return TmxReturn::kMissingMapNode;
+	}
+
+	// the map start tag on its own, closed so it forms a document
+	std::string& mapTag = context->mapTag;
+	mapTag.assign(tagStart, tagEnd - tagStart - 1);
+	if (type == kXmlTagStart)
+	{
+		mapTag += "/";
+	}
+	mapTag += ">";
+
+	// one small document is reused for every child of <map>
+	tinyxml2::XMLDocument& doc = context->document;
+	if (doc.Parse(mapTag.c_str(), mapTag.size()) != tinyxml2::XML_SUCCESS)
+	{
+		LOGE("Cannot parse xml map node...");
+		doc.Clear();
+		return TmxReturn::kErrorParsing;
+	}
+
+	TmxReturn error = _parseMapAttributes(doc.FirstChildElement("map"), outMap);
+	doc.Clear();
+	if (error)
+	{
+		return error;
+	}
+
+	// with worker threads, layers are only cut out while scanning and decoded together at the end.
+	// The tsx files start loading as soon as their <tileset> is scanned.
+	TmxTilesetLoads tilesetLoads(_getLayerPool(context, options.threadCount));
+	bool deferLayers = (tilesetLoads.pool != NULL);
+	std::vector<TmxPendingLayer> pendingLayers;
+
+	// an empty <map/> has no children to walk
+	bool layersStarted = false;
+	while (type == kXmlTagStart)
+	{
+		if (_isCancelled(options))
+		{
+			return TmxReturn::kCancelled;
+		}
+
+		const char* childStart = (p < end) ? (const char*)memchr(p, '<', end - p) : NULL;
+		if (childStart == NULL)
+		{
+			LOGE("Cannot parse xml, map node is not closed...");
+			return TmxReturn::kErrorParsing;
+		}
+
+		TmxXmlTagType childType;
+		const char* childEnd = _scanXmlTag(childStart, end, &childType);
+		const char* childTagEnd = childEnd;
+		if (childEnd != NULL && childType == kXmlTagStart)
+		{
+			childEnd = _scanXmlElement(childStart, end);
+		}
+		if (childEnd == NULL)
+		{
+			LOGE("Cannot parse xml, unexpected end of data...");
+			return TmxReturn::kErrorParsing;
+		}
+		p = childEnd;
+
+		if (childType == kXmlTagEnd)
+		{
+			break;
+		}
+		if (childType == kXmlTagOther)
+		{
+			continue;
+		}
+
+		if (!_isStreamedChildAccepted(childStart, childTagEnd, options, context))
+		{
+			continue;
+		}
+
+		if (deferLayers && _isXmlTagName(childStart, end, "layer"))
+		{
+			layersStarted = true;
+
+			TmxPendingLayer pendingLayer = { NULL, childStart, (size_t)(childEnd - childStart) };
+			pendingLayers.push_back(pendingLayer);
+			continue;
+		}
+
+		if (doc.Parse(childStart, childEnd - childStart) != tinyxml2::XML_SUCCESS)
+		{
+			LOGE("Cannot parse xml map child node...");
+			doc.Clear();
+			return TmxReturn::kErrorParsing;
+		}
+
+		error = _parseStreamedMapChild(doc.FirstChildElement(), outMap, tilesetPath, options, context, deferLayers ? &tilesetLoads : NULL, &layersStarted);
+		doc.Clear();
+		if (error)
+		{
+			return error;
+		}
+	}
+
+	_reportProgress(options, kParsePhaseXml, 1, 1);
+
+	if (deferLayers)
+	{
+		error = _parsePendingMapData(tilesetLoads, pendingLayers, outMap, options, context);
+	}
+	else if (!layersStarted)
+	{
+		error = _finishTilesets(outMap, options);
+	}
+
+	if (error)
+	{
+		return error;
+	}
+
+	return _parseEnd(outMap, tilesetPath);
+}
+
+
+TmxReturn _parseStreamedMapChild(tinyxml2::XMLElement* element, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context, TmxTilesetLoads* tilesetLoads, bool* layersStarted)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	if (strcmp(element->Name(), "properties") == 0)
+	{
+		error = _parsePropertyNode(element, context, &outMap->propertyMap);
+		if (error)
+		{
+			LOGE("Error processing map properties...");
+		}
+	}
+	else if (strcmp(element->Name(), "tileset") == 0)
+	{
+		if (*layersStarted)
+		{
+			LOGE("Tileset after the first layer, not supported when streaming...");
+			return TmxReturn::kErrorParsing;
+		}
+
+		outMap->tilesetCollection.push_back(TmxTileset());
+		TmxTileset& set = outMap->tilesetCollection.back();
+		error = _parseTilesetNode(element, &set, tilesetPath, options, context, tilesetLoads != NULL);
+		if (error)
+		{
+			LOGE("Error processing tileset node...");
+			outMap->tilesetCollection.pop_back();
+			return error;
+		}
+
+		if (tilesetLoads != NULL && !set.source.empty())
+		{
+			_beginTilesetLoad(tilesetLoads, set, outMap->tilesetCollection.size() - 1, _updatePath(set.source.c_str(), tilesetPath), options, context);
+		}
+	}
+	else if (strcmp(element->Name(), "layer") == 0)
+	{
+		if (!*layersStarted)
+		{
+			*layersStarted = true;
+			error = _finishTilesets(outMap, options);
+			if (error)
+			{
+				return error;
+			}
+		}
+
+		outMap->layerCollection.push_back(TmxLayer());
+		error = _parseLayerNode(element, outMap->tilesetLookup, outMap->infinite, options, context, NULL, &outMap->layerCollection.back());
+		if (error)
+		{
+			LOGE("Error processing layer node...");
+			outMap->layerCollection.pop_back();
+		}
+		else
+		{
+			_reportProgress(options, kParsePhaseLayers, outMap->layerCollection.size(), 0);
+		}
+	}
+	else if (strcmp(element->Name(), "objectgroup") == 0)
+	{
+		outMap->objectGroupCollection.push_back(TmxObjectGroup());
+		error = _parseObjectGroupNode(element, context, &outMap->objectGroupCollection.back());
+		if (error)
+		{
+			LOGE("Error processing objectgroup node...");
+			outMap->objectGroupCollection.pop_back();
+			return error;
+		}
+
+		_reportProgress(options, kParsePhaseObjects, outMap->objectGroupCollection.size() + outMap->imageLayerCollection.size(), 0);
+	}
+	else if (strcmp(element->Name(), "imagelayer") == 0)
+	{
+		outMap->imageLayerCollection.push_back(TmxImageLayer());
+		error = _parseImageLayerNode(element, context, &outMap->imageLayerCollection.back());
+		if (error)
+		{
+			LOGE("Error parsing imagelayer node...");
+			outMap->imageLayerCollection.pop_back();
+			return error;
+		}
+
+		_reportProgress(options, kParsePhaseObjects, outMap->objectGroupCollection.size() + outMap->imageLayerCollection.size(), 0);
+	}
+
+	return error;
+}
+
+
+// Every name, type and property name any parse in the process has seen, see internString
+struct TmxStringTable
+{
+	std::mutex mutex;
+	std::unordered_map<std::string, TmxStringId> ids;
+	std::vector<const char*> strings;	// by id, the keys of ids, which stay put as it grows
+
+	TmxStringTable()
+	{
+		ids[""] = kEmptyStringId;
+		strings.push_back(ids.begin()->first.c_str());
+	}
+};
+
+
+static TmxStringTable& _stringTable()
+{
+	static TmxStringTable table;
+	return table;
+}
+
+
+// outAddedBytes is roughly what the table grew by, 0 if string was already in it
+static TmxStringId _internString(const char* string, size_t* outAddedBytes)
+{
+	TmxStringTable& table = _stringTable();
+
+	std::string key(string);
+
+	std::lock_guard<std::mutex> lock(table.mutex);
+	auto it = table.ids.find(key);
+	if (it != table.ids.end())
+	{
+		*outAddedBytes = 0;
+		return it->second;
+	}
+
+	*outAddedBytes = key.size() + 1 + sizeof(std::pair<const std::string, TmxStringId>) + 3 * sizeof(void*);
+
+	TmxStringId id = (TmxStringId)table.strings.size();
+	it = table.ids.emplace(std::move(key), id).first;
+	table.strings.push_back(it->first.c_str());
+	return id;
+}
+
+
+TmxStringId internString(const char* string)
+{
+	size_t addedBytes;
+	return _internString(string, &addedBytes);
+}
+
+
+// Strings a parse adds to the table count against its budget, strings some earlier parse added are free
+static TmxReturn _internParseString(const char* string, TmxParseContext* context, TmxStringId* outId)
+{
+	size_t addedBytes;
+	*outId = _internString(string, &addedBytes);
+	return _chargeParseMemory(context, addedBytes) ? TmxReturn::kSuccess : TmxReturn::kMemoryBudgetExceeded;
+}
+
+
+void clearStringTable()
+{
+	// cached tilesets hold ids too
+	clearTilesetCache();
+
+	TmxStringTable& table = _stringTable();
+
+	std::lock_guard<std::mutex> lock(table.mutex);
+	std::unordered_map<std::string, TmxStringId>().swap(table.ids);
+	std::vector<const char*>().swap(table.strings);
+	table.ids[""] = kEmptyStringId;
+	table.strings.push_back(table.ids.begin()->first.c_str());
+}
+
+
+TmxStringId findStringId(const char* string)
+{
+	TmxStringTable& table = _stringTable();
+
+	std::lock_guard<std::mutex> lock(table.mutex);
+	auto it = table.ids.find(string);
+	return (it != table.ids.end()) ? it->second : kInvalidStringId;
+}
+
+
+const char* getInternedString(TmxStringId id)
+{
+	TmxStringTable& table = _stringTable();
+
+	std::lock_guard<std::mutex> lock(table.mutex);
+	return (id < table.strings.size()) ? table.strings[id] : NULL;
+}
+
+
+static bool _propertyLess(const TmxProperty& lhs, const TmxProperty& rhs)
+{
+	return lhs.name < rhs.name;
+}
+
+
+static bool _propertyNameEqual(const TmxProperty& lhs, const TmxProperty& rhs)
+{
+	return lhs.name == rhs.name;
+}
+
+
+const TmxProperty* findProperty(const TmxPropertyMap_t& properties, TmxStringId name)
+{
+	TmxProperty key;
+	key.name = name;
+	auto it = std::lower_bound(properties.begin(), properties.end(), key, _propertyLess);
+	return (it != properties.end() && it->name == name) ? &(*it) : NULL;
+}
+
+
+const TmxProperty* findProperty(const TmxPropertyMap_t& properties, const char* name)
+{
+	TmxStringId id = findStringId(name);
+	return (id != kInvalidStringId) ? findProperty(properties, id) : NULL;
+}
+
+
+int getIntProperty(const TmxPropertyMap_t& properties, TmxStringId name, int defaultValue)
+{
+	const TmxProperty* property = findProperty(properties, name);
+	if (property == NULL)
+		return defaultValue;
+
+	switch (property->type)
+	{
+		case kPropertyInt:
+			return property->intValue;
+		case kPropertyFloat:
+			return (int)property->floatValue;
+		case kPropertyObject:
+			return (int)property->objectId;
+		default:
+			return defaultValue;
+	}
+}
+
+
+float getFloatProperty(const TmxPropertyMap_t& properties, TmxStringId name, float defaultValue)
+{
+	const TmxProperty* property = findProperty(properties, name);
+	if (property == NULL)
+		return defaultValue;
+
+	switch (property->type)
+	{
+		case kPropertyFloat:
+			return property->floatValue;
+		case kPropertyInt:
+			return (float)property->intValue;
+		default:
+			return defaultValue;
+	}
+}
+
+
+bool getBoolProperty(const TmxPropertyMap_t& properties, TmxStringId name, bool defaultValue)
+{
+	const TmxProperty* property = findProperty(properties, name);
+	return (property != NULL && property->type == kPropertyBool) ? property->boolValue : defaultValue;
+}
+
+
+unsigned int getColorProperty(const TmxPropertyMap_t& properties, TmxStringId name, unsigned int defaultValue)
+{
+	const TmxProperty* property = findProperty(properties, name);
+	return (property != NULL && property->type == kPropertyColor) ? property->colorValue : defaultValue;
+}
+
+
+// Tiled writes colors as #AARRGGBB, or #RRGGBB when they are opaque
+static bool _parseColor(const char* text, unsigned int* outColor)
+{
+	if (*text == '#')
+		text++;
+
+	size_t length = strlen(text);
+	if (length == 0)
+	{
+		*outColor = 0;
+		return true;
+	}
+
+	if ((length != 6 && length != 8) || strspn(text, "0123456789abcdefABCDEF") != length)
+	{
+		return false;
+	}
+
+	unsigned int argb = (unsigned int)strtoul(text, NULL, 16);
+	if (length == 6)
+		argb |= 0xFF000000;
+
+	*outColor = (argb << 8) | (argb >> 24);
+	return true;
+}
+
+
+// strtol and strtoul on their own clamp or wrap what does not fit, these fail instead
+static bool _parseInt(const char* text, int* outValue)
+{
+	char* end = NULL;
+	errno = 0;
+	long value = strtol(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || value < INT_MIN || value > INT_MAX)
+	{
+		return false;
+	}
+
+	*outValue = (int)value;
+	return true;
+}
+
+
+static bool _parseUnsigned(const char* text, unsigned int* outValue)
+{
+	char* end = NULL;
+	errno = 0;
+	unsigned long value = strtoul(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || value > UINT_MAX || strchr(text, '-') != NULL)
+	{
+		return false;
+	}
+
+	*outValue = (unsigned int)value;
+	return true;
+}
+
+
+// Fills the typed member of property from its text, false if the text does not fit the type
+static bool _parsePropertyValue(const char* type, const char* text, TmxProperty* outProperty)
+{
+	outProperty->type = kPropertyString;
+	if (type == NULL || strcmp(type, "string") == 0)
+	{
+		return true;
+	}
+	else if (strcmp(type, "int") == 0)
+	{
+		outProperty->type = kPropertyInt;
+		return _parseInt(text, &outProperty->intValue);
+	}
+	else if (strcmp(type, "float") == 0)
+	{
+		// Tiled always writes a '.', whatever the locale of the process reading the map
+		std::istringstream stream(text);
+		stream.imbue(std::locale::classic());
+		outProperty->type = kPropertyFloat;
+		stream >> outProperty->floatValue;
+		return !stream.fail() && stream.peek() == std::char_traits<char>::eof();
+	}
+	else if (strcmp(type, "bool") == 0)
+	{
+		outProperty->type = kPropertyBool;
+		outProperty->boolValue = (strcmp(text, "true") == 0);
+		return outProperty->boolValue || strcmp(text, "false") == 0;
+	}
+	else if (strcmp(type, "color") == 0)
+	{
+		outProperty->type = kPropertyColor;
+		return _parseColor(text, &outProperty->colorValue);
+	}
+	else if (strcmp(type, "file") == 0)
+	{
+		outProperty->type = kPropertyFile;
+		return true;
+	}
+	else if (strcmp(type, "object") == 0)
+	{
+		outProperty->type = kPropertyObject;
+		return _parseUnsigned(text, &outProperty->objectId);
+	}
+
+	// types of later Tiled versions are kept as their text
+	LOGW("Unknown property type: %s", type);
+	return true;
+}
+
+
+TmxReturn _parsePropertyNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxPropertyMap_t* outPropertyMap)
+{
+	if (element == NULL)
+	{
+		// ignore this, not everything requires properties
+		return TmxReturn::kSuccess;
+	}
+
+	outPropertyMap->reserve(outPropertyMap->size() + _countChildElements(element, "property"));
+	for (tinyxml2::XMLElement* child = element->FirstChildElement("property"); child != NULL; child = child->NextSiblingElement("property"))
+	{
+		if (strcmp(child->Name(), "property") == 0)
+		{
+			if (child->Attribute("name") != NULL && child->Attribute("value") != NULL)
+			{
+				outPropertyMap->emplace_back();
+				TmxProperty& property = outPropertyMap->back();
+				TmxReturn error = _internParseString(child->Attribute("name"), context, &property.name);
+				if (error)
+				{
+					return error;
+				}
+
+				property.value = child->Attribute("value");
+				if (!_parsePropertyValue(child->Attribute("type"), child->Attribute("value"), &property))
+				{
+					// one mistyped value should not cost the whole map, it is kept as text
+					LOGW("Property %s is not a valid %s, kept as a string: %s", child->Attribute("name"), child->Attribute("type"), child->Attribute("value"));
+					property.type = kPropertyString;
+				}
+			}
+			else
+			{
+				return TmxReturn::kMalformedPropertyNode;
+			}
+		}
+	}
+
+	// sorted for findProperty.  Stable, so a name given twice keeps its last value.  Tiled writes properties in
+	// name order, which is usually id order as well, and then the sort and its buffer are skipped
+	if (!std::is_sorted(outPropertyMap->begin(), outPropertyMap->end(), _propertyLess))
+	{
+		std::stable_sort(outPropertyMap->begin(), outPropertyMap->end(), _propertyLess);
+	}
+	auto kept = std::unique(outPropertyMap->rbegin(), outPropertyMap->rend(), _propertyNameEqual);
+	outPropertyMap->erase(outPropertyMap->begin(), kept.base());
+
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _parseImageNode(tinyxml2::XMLElement* element, TmxImage* outImage)
+{
+	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE_STRING(element, "source", outImage->source);
+	CHECK_AND_RETRIEVE_OPT_ATTRIBUTE_STRING(element, "format", outImage->format);
+	CHECK_AND_RETRIEVE_OPT_ATTRIBUTE_STRING(element, "trans", outImage->transparentColor);
+
+	outImage->width = element->UnsignedAttribute("width");
+	outImage->height = element->UnsignedAttribute("height");
+
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _parseTileset(tinyxml2::XMLElement* element, const TmxParseFilter& tileDefinitionFilter, TmxParseContext* context, TmxTileset* outTileset)
+{
+  char const* name = element->Attribute("name");
+  if (name != nullptr)
+  {
+    outTileset->name = name;
+  }
+
+  CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "tilewidth", &outTileset->tileWidth);
+  CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "tileheight", &outTileset->tileHeight);
+  outTileset->tileSpacingInImage = element->UnsignedAttribute("spacing");
+  outTileset->tileMarginInImage = element->UnsignedAttribute("margin");
+
+  // TODO - read TODO at end of this function
+  if (element->FirstChildElement("image") == NULL)
+  {
+    LOGE("We do not support maps with tilesets that have no image associated currently...");
+    return kErrorParsing;
+  }
+
+  TmxImage image;
+  TmxReturn error = _parseImageNode(element->FirstChildElement("image"), &outTileset->image);
+  if (error)
+  {
+    LOGE("Error parsing image node...");
+    return error;
+  }
+
+  outTileset->offset.x = 0;
+  outTileset->offset.y = 0;
+
+  if (element->FirstChildElement("tileoffset") != NULL)
+  {
     error = _parseOffsetNode(element->FirstChildElement("tileoffset"), &outTileset->offset);
   }
 
-  for (tinyxml2::XMLElement* child = element->FirstChildElement("tile"); child != NULL; child = child->NextSiblingElement("tile"))
-  {
-    TmxTileDefinition tileDef;
+  _reserveMap(outTileset->tileDefinitions, _countChildElements(element, "tile", tileDefinitionFilter));
+  for (tinyxml2::XMLElement* child = _firstAccepted(element->FirstChildElement("tile"), tileDefinitionFilter); child != NULL; child = _firstAccepted(child->NextSiblingElement("tile"), tileDefinitionFilter))
+  {
+    // parsed in place, a repeated id still replaces the earlier definition
+    TmxTileDefinition& tileDef = outTileset->tileDefinitions[child->UnsignedAttribute("id")];
+    tileDef = TmxTileDefinition();
+
+    error = _parseTileDefinitionNode(child, context, &tileDef);
+    if (error)
+    {
+      LOGE("Error parsing tile definition");
+      return error;
+    }
+  }
+
+  // derive row/col count, calculate tile indices
+  // TODO - this is why we do not accept tilesets without image tag atm
+  outTileset->colCount = (outTileset->image.width - outTileset->tileMarginInImage) / (outTileset->tileWidth + outTileset->tileSpacingInImage);
+  outTileset->rowCount = (outTileset->image.height - outTileset->tileMarginInImage) / (outTileset->tileHeight + outTileset->tileSpacingInImage);
+
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _parseTilesetNode(tinyxml2::XMLElement* element, TmxTileset* outTileset, std::string tilesetPath, const TmxParseOptions& options, TmxParseContext* context, bool deferExternal)
+{
+	if (strcmp(element->Name(), "tileset") == 0)
+	{
+		CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "firstgid", &outTileset->firstgid);
+
+    // External tileset file
+    char const* source = element->Attribute("source");
+    if (source != nullptr)
+    {
+      outTileset->source = source;
+      outTileset->name = outTileset->source.substr(0, outTileset->source.rfind('.'));
+
+      // the caller loads the tsx later, on a worker
+      if (deferExternal)
+      {
+        return TmxReturn::kSuccess;
+      }
+
+      return _loadExternalTileset(_updatePath(source, tilesetPath), options, context, outTileset);
+    }
+
+    // Embedded tileset
+    else
+    {
+      return _parseTileset(element, options.tileDefinitionFilter, context, outTileset);
+    }
+
+	}
+
+	return TmxReturn::kSuccess;
+}
+
+
+// External tilesets parsed so far by any parser in the process, keyed by canonical path
+typedef struct
+{
+	long long modifiedTime;
+	long long size;
+	std::shared_future<std::shared_ptr<const TmxTileset> > tileset; // NULL if its parse failed
+} TmxCachedTileset;
+
+
+typedef struct
+{
+	std::mutex mutex;
+	Map<std::string, TmxCachedTileset>::type entries;
+} TmxTilesetCache;
+
+
+static TmxTilesetCache& _tilesetCache()
+{
+	TMX_ARENA_SCOPE(NULL); // the cache outlives any arena
+	static TmxTilesetCache cache;
+	return cache;
+}
+
+
+void clearTilesetCache()
+{
+	TmxTilesetCache& cache = _tilesetCache();
+
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.entries.clear();
+}
+
+
+// Fills outTileset from a tsx file, keeping the firstgid, source and name the map gave it
+TmxReturn _loadExternalTileset(const std::string& fileName, const TmxParseOptions& options, TmxParseContext* context, TmxTileset* outTileset)
+{
+	if (!options.useTilesetCache)
+	{
+		unsigned int firstgid = outTileset->firstgid;
+		TmxString source = std::move(outTileset->source);
+		TmxString name = std::move(outTileset->name);
+
+		TmxReturn retVal = _parseTilesetFile(fileName, context, outTileset);
+
+		outTileset->firstgid = firstgid;
+		outTileset->source = std::move(source);
+		outTileset->name = std::move(name);
+
+		if (retVal == TmxReturn::kSuccess && !_isFilterEmpty(options.tileDefinitionFilter))
+		{
+			for (auto it = outTileset->tileDefinitions.begin(); it != outTileset->tileDefinitions.end(); )
+			{
+				if (_filterAccepts(options.tileDefinitionFilter, getInternedString(it->second.type)))
+					++it;
+				else
+					it = outTileset->tileDefinitions.erase(it);
+			}
+		}
+		return retVal;
+	}
+
+	std::shared_ptr<const TmxTileset> cached;
+	TmxReturn retVal = _parseCachedTilesetFile(fileName, context, &cached);
+	if (retVal != TmxReturn::kSuccess)
+	{
+		return retVal;
+	}
+
+	outTileset->tileWidth = cached->tileWidth;
+	outTileset->tileHeight = cached->tileHeight;
+	outTileset->tileSpacingInImage = cached->tileSpacingInImage;
+	outTileset->tileMarginInImage = cached->tileMarginInImage;
+	outTileset->offset = cached->offset;
+	outTileset->rowCount = cached->rowCount;
+	outTileset->colCount = cached->colCount;
+	outTileset->image = cached->image;
+
+	// the cache keeps every tile definition, a filtered tileset copies the ones it accepts
+	if (_isFilterEmpty(options.tileDefinitionFilter))
+	{
+		if (options.shareTileDefinitions)
+			outTileset->sharedTileDefinitions = std::shared_ptr<const TmxTileDefinitionMap_t>(cached, &cached->tileDefinitions);
+		else
+			outTileset->tileDefinitions.insert(cached->tileDefinitions.begin(), cached->tileDefinitions.end());
+		return TmxReturn::kSuccess;
+	}
+
+	for (auto it = cached->tileDefinitions.begin(); it != cached->tileDefinitions.end(); ++it)
+	{
+		if (_filterAccepts(options.tileDefinitionFilter, getInternedString(it->second.type)))
+		{
+			outTileset->tileDefinitions.insert(*it);
+		}
+	}
+	return TmxReturn::kSuccess;
+}
+
+
+// The cache key of a file, so the same tsx reached through different relative paths is parsed once
+std::string _canonicalPath(const std::string& fileName)
+{
+#if defined(WIN32) || defined(_WIN32)
+	char* path = _fullpath(NULL, fileName.c_str(), 0);
+#else
+	char* path = realpath(fileName.c_str(), NULL);
+#endif
+	if (path == NULL)
+	{
+		return fileName;
+	}
+
+	std::string canonicalPath(path);
+	free(path);
+	return canonicalPath;
+}
+
+
+// In nanoseconds where the platform has them, so a tsx rewritten within the same second is still seen as changed
+long long _modifiedTime(const struct stat& fileInfo)
+{
+#if defined(__APPLE__)
+	return (long long)fileInfo.st_mtimespec.tv_sec * 1000000000LL + fileInfo.st_mtimespec.tv_nsec;
+#elif defined(WIN32) || defined(_WIN32)
+	return (long long)fileInfo.st_mtime * 1000000000LL;
+#else
+	return (long long)fileInfo.st_mtim.tv_sec * 1000000000LL + fileInfo.st_mtim.tv_nsec;
+#endif
+}
+
+
+// Parses a tileset on its own, outside of the cache
+static TmxReturn _parseSharedTilesetFile(const std::string& fileName, TmxParseContext* context, std::shared_ptr<const TmxTileset>* outTileset)
+{
+	TMX_ARENA_SCOPE(NULL); // shared tilesets outlive any arena
+	std::shared_ptr<TmxTileset> tileset = std::make_shared<TmxTileset>();
+	TmxReturn retVal = _parseTilesetFile(fileName, context, tileset.get());
+	if (retVal == TmxReturn::kSuccess)
+	{
+		*outTileset = tileset;
+	}
+	return retVal;
+}
+
+
+TmxReturn _parseCachedTilesetFile(const std::string& fileName, TmxParseContext* context, std::shared_ptr<const TmxTileset>* outTileset)
+{
+	struct stat fileInfo;
+	if (stat(fileName.c_str(), &fileInfo) != 0)
+	{
+		return _parseSharedTilesetFile(fileName, context, outTileset);
+	}
+
+	std::string key = _canonicalPath(fileName);
+	long long modifiedTime = _modifiedTime(fileInfo);
+
+	// the first parser to ask for a file parses it, any other asking meanwhile waits for that parse
+	TmxTilesetCache& cache = _tilesetCache();
+	std::promise<std::shared_ptr<const TmxTileset> > promise;
+	std::shared_future<std::shared_ptr<const TmxTileset> > cached;
+	{
+		std::lock_guard<std::mutex> lock(cache.mutex);
+		auto it = cache.entries.find(key);
+		if (it != cache.entries.end() && it->second.modifiedTime == modifiedTime && it->second.size == (long long)fileInfo.st_size)
+		{
+			cached = it->second.tileset;
+		}
+		else
+		{
+			TmxCachedTileset entry;
+			entry.modifiedTime = modifiedTime;
+			entry.size = (long long)fileInfo.st_size;
+			entry.tileset = promise.get_future().share();
+			cache.entries[key] = entry;
+		}
+	}
+
+	if (cached.valid())
+	{
+		std::shared_ptr<const TmxTileset> tileset = cached.get();
+		if (tileset == NULL)
+		{
+			// failed for whoever parsed it, parse again for our own error
+			return _parseSharedTilesetFile(fileName, context, outTileset);
+		}
+
+		*outTileset = tileset;
+		return TmxReturn::kSuccess;
+	}
+
+	// drops the failed entry so the next load retries, unless the file was replaced meanwhile
+	auto dropEntry = [&]()
+	{
+		std::lock_guard<std::mutex> lock(cache.mutex);
+		auto it = cache.entries.find(key);
+		if (it != cache.entries.end() && it->second.modifiedTime == modifiedTime && it->second.size == (long long)fileInfo.st_size)
+		{
+			cache.entries.erase(it);
+		}
+	};
+
+	std::shared_ptr<const TmxTileset> tileset;
+	TmxReturn retVal;
+	try
+	{
+		retVal = _parseSharedTilesetFile(fileName, context, &tileset);
+	}
+	catch (...)
+	{
+		// waiters parse again for themselves, as after a failed parse
+		dropEntry();
+		promise.set_value(std::shared_ptr<const TmxTileset>());
+		throw;
+	}
+
+	if (retVal != TmxReturn::kSuccess)
+	{
+		dropEntry();
+		promise.set_value(std::shared_ptr<const TmxTileset>());
+		return retVal;
+	}
+
+	*outTileset = tileset;
+	promise.set_value(tileset);
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _parseTilesetFile(const std::string& fileName, TmxParseContext* context, TmxTileset* outTileset)
+{
+	MappedFile tileFile;
+	if (!tileFile.open(fileName))
+	{
+		LOGE("Cannot read tileset xml file");
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (!_chargeParseMemory(context, tileFile.size()))
+	{
+		return TmxReturn::kMemoryBudgetExceeded;
+	}
+
+	tinyxml2::XMLDocument& tileDoc = context->tilesetDocument;
+	if (tileDoc.Parse(tileFile.data(), tileFile.size()) != tinyxml2::XML_SUCCESS)
+	{
+		LOGE("Cannot parse tileset xml file");
+		tileDoc.Clear();
+		return TmxReturn::kErrorParsing;
+	}
+	tileFile.close();
+
+	tinyxml2::XMLElement* tileElement = tileDoc.FirstChildElement("tileset");
+
+	TmxReturn retVal = (tileElement != NULL) ? _parseTileset(tileElement, TmxParseFilter(), context, outTileset) : TmxReturn::kMissingTilesetNode;
+	tileDoc.Clear();
+	return retVal;
+}
+
+
+TmxReturn _parseTileDefinitionNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxTileDefinition* outTileDefinition)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	outTileDefinition->id = element->UnsignedAttribute("id");
+	error = _internParseString(_filterName(element), context, &outTileDefinition->type);
+	if (error)
+	{
+		return error;
+	}
+
+	error = _parsePropertyNode(element->FirstChildElement("properties"), context, &outTileDefinition->propertyMap);
+	if (error)
+	{
+		return error;
+	}
+
+	if (element->FirstChildElement("animation") != NULL)
+	{
+		error = _parseTileAnimationNode(element->FirstChildElement("animation"), &outTileDefinition->animations);
+	}
+
+	outTileDefinition->objectgroups.reserve(_countChildElements(element, "objectgroup"));
+	for (tinyxml2::XMLElement* child = element->FirstChildElement("objectgroup"); child != NULL; child = child->NextSiblingElement("objectgroup"))
+	{
+		outTileDefinition->objectgroups.push_back(TmxObjectGroup());
+		error = _parseObjectGroupNode(child, context, &outTileDefinition->objectgroups.back());
+		if (error)
+		{
+			LOGE("Error processing objectgroup node...");
+			return error;
+		}
+	}
+
+	return error;
+}
+
+
+TmxReturn _parseTileAnimationNode(tinyxml2::XMLElement* element, TmxAnimationFrameCollection_t* outAnimationCollection)
+{
+	outAnimationCollection->reserve(outAnimationCollection->size() + _countChildElements(element, "frame"));
+	for (tinyxml2::XMLElement* child = element->FirstChildElement("frame"); child != NULL; child = child->NextSiblingElement("frame"))
+	{
+		TmxAnimationFrame frame;
+		frame.duration = child->FloatAttribute("duration");
+		frame.tileId = child->UnsignedAttribute("tileid");
+
+		outAnimationCollection->push_back(frame);
+	}
+
+	return kSuccess;
+}
+
+
+TmxReturn _parseLayerNode(tinyxml2::XMLElement* element, const TmxTilesetLookup& lookup, bool infinite, const TmxParseOptions& options, TmxParseContext* context, ThreadPool* chunkPool, TmxLayer* outLayer)
+{
+	TmxReturn error = _parseLayerAttributes(element, context, outLayer);
+	if (error)
+	{
+		return error;
+	}
+
+	// check data node and type
+	tinyxml2::XMLElement* dataElement = element->FirstChildElement("data");
+	if (dataElement != NULL)
+	{
+		// Tiled writes an empty layer of an infinite map as <data> without any chunks
+		if (infinite || dataElement->FirstChildElement("chunk") != NULL)
+		{
+			return _parseLayerChunks(dataElement, lookup, options, context, chunkPool, outLayer);
+		}
+
+		TmxLayerStorage storage = options.layerStorage;
+		if (storage == kLayerStorageLazy)
+		{
+			// <tile> elements have no encoded text worth keeping, they are kept as gids instead
+			if (dataElement->Attribute("encoding") != NULL)
+			{
+				return _keepLazyLayerData(dataElement, dataElement, (size_t)outLayer->width * outLayer->height, context, &outLayer->lazyData);
+			}
+			storage = kLayerStorageGids;
+		}
+
+		TmxLayerGidSink sink;
+		error = _beginLayerGids(&outLayer->tiles, &outLayer->gids, (size_t)outLayer->width * outLayer->height, storage, lookup, context, &sink);
+		if (error)
+		{
+			return error;
+		}
+		sink.cancel = options.cancel;
+
+		error = _parseLayerDataNode(dataElement, context, &sink);
+		if (error)
+		{
+			return error;
+		}
+
+		if (sink.unknownGids)
+		{
+			LOGW("Layer references gids outside of every tileset...");
+		}
+	}
+	else
+	{
+		LOGE("Layer missing data node...");
+		return TmxReturn::kMissingDataNode;
+	}
+
+	return error;
+}
+
+
+TmxReturn _parseLayerAttributes(tinyxml2::XMLElement* element, TmxParseContext* context, TmxLayer* outLayer)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	outLayer->name = element->Attribute("name");
+	if (element->Attribute("opacity"))
+		outLayer->opacity = element->FloatAttribute("opacity");
+	else
+		outLayer->opacity = 1.f;
+	if (element->Attribute("visible"))
+		outLayer->visible = (element->IntAttribute("visible") == 1 ? true : false);
+	else
+		outLayer->visible = true;
+	outLayer->width = element->UnsignedAttribute("width");
+	outLayer->height = element->UnsignedAttribute("height");
+	outLayer->chunkWidth = 0;
+	outLayer->chunkHeight = 0;
+
+	error = _parsePropertyNode(element->FirstChildElement("properties"), context, &outLayer->propertyMap);
+	if (error)
+	{
+		LOGE("Error parsing layer property node...");
+		return error;
+	}
+
+	return error;
+}
+
+
+TmxReturn _keepLazyLayerData(tinyxml2::XMLElement* dataElement, tinyxml2::XMLElement* element, size_t count, TmxParseContext* context, std::shared_ptr<TmxLazyLayerData>* outLazyData)
+{
+	const char* encoding = dataElement->Attribute("encoding");
+	if (strcmp(encoding, "csv") != 0 && strcmp(encoding, "base64") != 0)
+	{
+		LOGE("Unsupported encoding: %s", encoding);
+		return TmxReturn::kErrorParsing;
+	}
+
+	const char* text = element->GetText();
+	if (text == NULL)
+	{
+		LOGE("Layer data node is empty...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (!_chargeParseMemory(context, strlen(text)))
+	{
+		return TmxReturn::kMemoryBudgetExceeded;
+	}
+
+#ifdef TMXPARSER_USE_ARENA
+	std::shared_ptr<TmxLazyLayerData> lazyData = std::allocate_shared<TmxLazyLayerData>(TmxArenaAllocator<TmxLazyLayerData>());
+#else
+	std::shared_ptr<TmxLazyLayerData> lazyData = std::make_shared<TmxLazyLayerData>();
+#endif
+	lazyData->encoding = encoding;
+	if (dataElement->Attribute("compression") != NULL)
+	{
+		lazyData->compression = dataElement->Attribute("compression");
+	}
+	lazyData->text = text;
+	lazyData->count = count;
+	lazyData->result = TmxReturn::kSuccess;
+	lazyData->allocator = context->allocator;
+	*outLazyData = lazyData;
+
+	return TmxReturn::kSuccess;
+}
+
+
+static void _decodeLazyLayer(const TmxTilesetLookup& lookup, TmxLazyLayerData* lazyData)
+{
+	// the parse is long over, its allocator still serves the decode but there is no budget left to charge
+	TmxParseContext context;
+	_useParseAllocator(&context, lazyData->allocator, false);
+	TmxLayerGidCollection_t unusedGids;
+	TmxLayerGidSink sink;
+	// the context has no budget, so this cannot fail
+	_beginLayerGids(&lazyData->tiles, &unusedGids, lazyData->count, kLayerStorageTiles, lookup, &context, &sink);
+
+	if (lazyData->encoding == "csv")
+	{
+		lazyData->result = _parseLayerCsvData(lazyData->text.c_str(), &sink);
+	}
+	else
+	{
+		const char* compression = lazyData->compression.empty() ? NULL : lazyData->compression.c_str();
+		lazyData->result = _parseLayerBase64Data(lazyData->text.data(), lazyData->text.size(), compression, &context, &sink);
+	}
+
+	if (lazyData->result)
+	{
+		LOGE("Error decoding lazy layer data...");
+		TmxLayerTileCollection_t().swap(lazyData->tiles);
+	}
+	else if (sink.unknownGids)
+	{
+		LOGW("Layer references gids outside of every tileset...");
+	}
+
+	TmxString().swap(lazyData->text);
+}
+
+
+TmxReturn _parseLayerChunks(tinyxml2::XMLElement* dataElement, const TmxTilesetLookup& lookup, const TmxParseOptions& options, TmxParseContext* context, ThreadPool* pool, TmxLayer* outLayer)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	std::vector<tinyxml2::XMLElement*> chunkElements;
+	for (tinyxml2::XMLElement* child = dataElement->FirstChildElement("chunk"); child != NULL; child = child->NextSiblingElement("chunk"))
+	{
+		chunkElements.push_back(child);
+	}
+
+	outLayer->chunks.resize(chunkElements.size());
+	for (size_t i = 0; i < chunkElements.size(); i++)
+	{
+		error = _parseLayerChunkAttributes(chunkElements[i], &outLayer->chunks[i]);
+		if (error)
+		{
+			return error;
+		}
+	}
+
+	TmxLayerStorage storage = options.layerStorage;
+	if (storage == kLayerStorageLazy)
+	{
+		// every chunk keeps its own text, so reading one part of the world only decodes that part
+		if (dataElement->Attribute("encoding") != NULL)
+		{
+			for (size_t i = 0; i < chunkElements.size() && !error; i++)
+			{
+				TmxLayerChunk& chunk = outLayer->chunks[i];
+				error = _keepLazyLayerData(dataElement, chunkElements[i], (size_t)chunk.width * chunk.height, context, &chunk.lazyData);
+			}
+
+			_finishLayerChunks(outLayer);
+			return error;
+		}
+		storage = kLayerStorageGids;
+	}
+
+	// chunks are small and independent, with threads each one is a job of its own
+	std::vector<TmxReturn> results(chunkElements.size(), TmxReturn::kSuccess);
+	std::vector<char> unknownGids(chunkElements.size(), 0);
+	if (pool == NULL || chunkElements.size() < 2)
+	{
+		for (size_t i = 0; i < chunkElements.size(); i++)
+		{
+			bool unknown = false;
+			results[i] = _parseLayerChunkData(dataElement, chunkElements[i], lookup, storage, options, context, &outLayer->chunks[i], &unknown);
+			unknownGids[i] = unknown;
+			if (results[i])
+			{
+				break;
+			}
+		}
+	}
+	else
+	{
+		ThreadPool::Group jobs;
+		for (size_t i = 0; i < chunkElements.size(); i++)
+		{
+			pool->enqueue([&, i](unsigned int worker)
+			{
+				TMX_ARENA_SCOPE(options.arena);
+				bool unknown = false;
+				results[i] = _parseLayerChunkData(dataElement, chunkElements[i], lookup, storage, options, context->workerContexts[worker], &outLayer->chunks[i], &unknown);
+				unknownGids[i] = unknown;
+			}, &jobs);
+		}
+		pool->wait(jobs);
+	}
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		if (results[i])
+		{
+			LOGE("Error processing layer chunk...");
+			return results[i];
+		}
+	}
+
+	if (std::find(unknownGids.begin(), unknownGids.end(), 1) != unknownGids.end())
+	{
+		LOGW("Layer references gids outside of every tileset...");
+	}
+
+	_finishLayerChunks(outLayer);
+	return error;
+}
+
+
+TmxReturn _parseLayerChunkAttributes(tinyxml2::XMLElement* element, TmxLayerChunk* outChunk)
+{
+	outChunk->x = element->IntAttribute("x");
+	outChunk->y = element->IntAttribute("y");
+	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "width", &outChunk->width);
+	CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "height", &outChunk->height);
+
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _parseLayerChunkData(tinyxml2::XMLElement* dataElement, tinyxml2::XMLElement* element, const TmxTilesetLookup& lookup, TmxLayerStorage storage, const TmxParseOptions& options, TmxParseContext* context, TmxLayerChunk* outChunk, bool* outUnknownGids)
+{
+	if (_isCancelled(options))
+	{
+		return TmxReturn::kCancelled;
+	}
+
+	TmxLayerGidSink sink;
+	TmxReturn error = _beginLayerGids(&outChunk->tiles, &outChunk->gids, (size_t)outChunk->width * outChunk->height, storage, lookup, context, &sink);
+	if (error)
+	{
+		return error;
+	}
+	sink.cancel = options.cancel;
+
+	TmxLayerDataCursor cursor;
+	error = _beginLayerData(dataElement, element, context, &cursor);
+	if (error)
+	{
+		return error;
+	}
+
+	error = _parseLayerDataChunk(&cursor, context, &sink, SIZE_MAX);
+	*outUnknownGids = sink.unknownGids;
+	return error;
+}
+
+
+static bool _layerChunkLess(const TmxLayerChunk& lhs, const TmxLayerChunk& rhs)
+{
+	return (lhs.y != rhs.y) ? (lhs.y < rhs.y) : (lhs.x < rhs.x);
+}
+
+
+void _finishLayerChunks(TmxLayer* outLayer)
+{
+	if (outLayer->chunks.empty())
+	{
+		return;
+	}
+
+	// Tiled gives every chunk of a map the same size and already writes them in row order
+	outLayer->chunkWidth = outLayer->chunks[0].width;
+	outLayer->chunkHeight = outLayer->chunks[0].height;
+	if (!std::is_sorted(outLayer->chunks.begin(), outLayer->chunks.end(), _layerChunkLess))
+	{
+		std::sort(outLayer->chunks.begin(), outLayer->chunks.end(), _layerChunkLess);
+	}
+}
+
+
+ThreadPool* _getLayerPool(TmxParseContext* context, unsigned int threadCount)
+{
+	if (context->sharedPool != NULL)
+	{
+		threadCount = context->sharedPool->threadCount();
+		if (threadCount <= 1)
+		{
+			return NULL;
+		}
+
+		while (context->workerContexts.size() < threadCount)
+		{
+			context->workerContexts.push_back(new TmxParseContext());
+		}
+		_shareParseMemory(context);
+
+		return context->sharedPool;
+	}
+
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+	}
+
+	if (threadCount <= 1)
+	{
+		return NULL;
+	}
+
+	if (context->layerPool != NULL && context->layerPool->threadCount() != threadCount)
+	{
+		delete context->layerPool;
+		context->layerPool = NULL;
+	}
+
+	if (context->layerPool == NULL)
+	{
+		context->layerPool = new ThreadPool(threadCount);
+	}
+
+	while (context->workerContexts.size() < threadCount)
+	{
+		context->workerContexts.push_back(new TmxParseContext());
+	}
+	_shareParseMemory(context);
+
+	return context->layerPool;
+}
+
+
+void* _allocateParseMemory(void* opaque, size_t size)
+{
+	TmxParseContext* context = (TmxParseContext*)opaque;
+	if (!_chargeParseMemory(context, size))
+	{
+		return NULL;
+	}
+
+	void* p = context->allocator ? context->allocator->allocate(size) : malloc(size);
+	if (p == NULL)
+	{
+		LOGE("Out of memory allocating %zu bytes...", size);
+		context->budget->exceeded = true;
+	}
+	return p;
+}
+
+
+void _freeParseMemory(void* opaque, void* address)
+{
+	TmxParseContext* context = (TmxParseContext*)opaque;
+	if (address == NULL)
+	{
+		return;
+	}
+
+	if (context->allocator)
+		context->allocator->deallocate(address);
+	else
+		free(address);
+}
+
+
+static bool _reserveScratchBuffer(TmxParseContext* context, TmxScratchBuffer* buffer, size_t size)
+{
+	if (buffer->size >= size)
+	{
+		return true;
+	}
+
+	_freeParseMemory(context, buffer->data);
+	buffer->data = (unsigned char*)_allocateParseMemory(context, size);
+	buffer->size = buffer->data ? size : 0;
+	return buffer->data != NULL;
+}
+
+
+// Frees what the context allocated with its previous allocator, so nothing outlives the allocator it came from.
+// The decompression streams only go through the context when there is an allocator or a budget to answer to,
+// otherwise zlib and zstd keep their own defaults.
+static void _useParseAllocator(TmxParseContext* context, TmxAllocator* allocator, bool budgeted)
+{
+	bool hookDecompressor = (allocator != NULL || budgeted);
+	if (context->allocator == allocator && context->decompressorHooked == hookDecompressor)
+	{
+		return;
+	}
+
+	if (hookDecompressor)
+		context->decompressor.setAllocator(_allocateParseMemory, _freeParseMemory, context);
+	else
+		context->decompressor.setAllocator(NULL, NULL, NULL);
+	context->decompressorHooked = hookDecompressor;
+
+	if (context->allocator == allocator)
+	{
+		return;
+	}
+
+	_freeParseMemory(context, context->gidChunk.data);
+	_freeParseMemory(context, context->encodedChunk.data);
+	context->gidChunk.data = NULL;
+	context->gidChunk.size = 0;
+	context->encodedChunk.data = NULL;
+	context->encodedChunk.size = 0;
+	context->allocator = allocator;
+}
+
+
+// Pool workers allocate with the parse's allocator and charge its budget
+static void _shareParseMemory(TmxParseContext* context)
+{
+	for (size_t i = 0; i < context->workerContexts.size(); i++)
+	{
+		_useParseAllocator(context->workerContexts[i], context->allocator, context->budget->limit != 0);
+		context->workerContexts[i]->budget = context->budget;
+	}
+}
+
+
+TmxReturn _beginParseMemory(TmxParseContext* context, const TmxParseOptions& options, size_t xmlLength)
+{
+	_useParseAllocator(context, options.allocator, options.memoryBudget != 0);
+	context->budget = &context->ownBudget;
+	context->ownBudget.limit = options.memoryBudget;
+	context->ownBudget.used = 0;
+	context->ownBudget.exceeded = false;
+
+	// tinyxml2 allocates on its own, its documents are charged at the size of the xml they are built from
+	if (!_chargeParseMemory(context, xmlLength))
+	{
+		return TmxReturn::kMemoryBudgetExceeded;
+	}
+	return TmxReturn::kSuccess;
+}
+
+
+bool _chargeParseMemory(TmxParseContext* context, size_t bytes)
+{
+	TmxMemoryBudget* budget = context->budget;
+	if (budget->limit == 0)
+	{
+		return true;
+	}
+
+	if (bytes <= budget->limit && budget->used.fetch_add(bytes) + bytes <= budget->limit)
+	{
+		return true;
+	}
+
+	if (!budget->exceeded.exchange(true))
+	{
+		LOGE("Map needs more than its memory budget of %zu bytes...", budget->limit);
+	}
+	return false;
+}
+
+
+TmxReturn _parseMemoryError(TmxParseContext* context)
+{
+	return context->budget->exceeded ? TmxReturn::kMemoryBudgetExceeded : TmxReturn::kErrorParsing;
+}
+
+
+// Turns the raw gids of a layer or chunk decoded before its tilesets were known into tiles
+static TmxReturn _resolveStoredGids(const TmxTilesetLookup& lookup, TmxParseContext* context, TmxLayerTileCollection_t* tiles, TmxLayerGidCollection_t* gids)
+{
+	if (!_chargeParseMemory(context, gids->size() * sizeof(TmxLayerTile)))
+	{
+		return TmxReturn::kMemoryBudgetExceeded;
+	}
+
+	tiles->resize(gids->size());
+	TmxReturn resolved = resolveLayerGids(lookup, gids->data(), gids->size(), tiles->data());
+	TmxLayerGidCollection_t().swap(*gids);
+	return resolved;
+}
+
+
+TmxReturn _parsePendingMapData(TmxTilesetLoads& tilesetLoads, const std::vector<TmxPendingLayer>& pendingLayers, TmxMap* outMap, const TmxParseOptions& options, TmxParseContext* context)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	if (tilesetLoads.pending.empty())
+	{
+		error = _finishTilesets(outMap, options);
+		return error ? error : _parsePendingLayers(pendingLayers, outMap, options, context);
+	}
+
+	// the tsx loads are already running.  Layers only need the tilesets to resolve their gids,
+	// so they decode into raw gids meanwhile and are resolved once every load is done.
+	ThreadPool* pool = tilesetLoads.pool;
+	ThreadPool::Group& jobs = tilesetLoads.jobs;
+
+	TmxParseOptions gidOptions = options;
+	if (options.layerStorage == kLayerStorageTiles)
+	{
+		gidOptions.layerStorage = kLayerStorageGids;
+	}
+
+	size_t firstSlot = outMap->layerCollection.size();
+	outMap->layerCollection.resize(firstSlot + pendingLayers.size());
+
+	TmxTilesetLookup noLookup;
+	std::vector<TmxReturn> layerResults(pendingLayers.size(), TmxReturn::kSuccess);
+	std::mutex progressMutex;
+	size_t layersDone = 0;
+	if (outMap->infinite)
+	{
+		// as in _parsePendingLayers, one layer at a time with its chunks spread over the threads
+		for (size_t i = 0; i < pendingLayers.size(); i++)
+		{
+			layerResults[i] = _parsePendingLayer(pendingLayers[i], noLookup, outMap->infinite, gidOptions, context, pool, &outMap->layerCollection[firstSlot + i]);
+			if (layerResults[i])
+			{
+				break;
+			}
+
+			std::lock_guard<std::mutex> lock(progressMutex);
+			_reportProgress(options, kParsePhaseLayers, ++layersDone, pendingLayers.size());
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < pendingLayers.size(); i++)
+		{
+			pool->enqueue([&, i](unsigned int worker)
+			{
+				TMX_ARENA_SCOPE(options.arena);
+				layerResults[i] = _parsePendingLayer(pendingLayers[i], noLookup, outMap->infinite, gidOptions, context->workerContexts[worker], NULL, &outMap->layerCollection[firstSlot + i]);
+				if (layerResults[i] == TmxReturn::kSuccess)
+				{
+					std::lock_guard<std::mutex> lock(progressMutex);
+					_reportProgress(options, kParsePhaseLayers, ++layersDone, pendingLayers.size());
+				}
+			}, &jobs);
+		}
+	}
+	pool->wait(jobs);
+
+	for (auto it = tilesetLoads.pending.begin(); it != tilesetLoads.pending.end(); ++it)
+	{
+		if (it->result)
+		{
+			LOGE("Error processing tileset node...");
+			return it->result;
+		}
+		outMap->tilesetCollection[it->slot] = std::move(it->tileset);
+	}
+
+	for (size_t i = 0; i < layerResults.size(); i++)
+	{
+		if (layerResults[i])
+		{
+			LOGE("Error processing layer node...");
+			return layerResults[i];
+		}
+	}
+
+	error = _finishTilesets(outMap, options);
+	if (error)
+	{
+		return error;
+	}
+
+	if (options.layerStorage == kLayerStorageTiles)
+	{
+		std::atomic<bool> unknownGids(false);
+		for (size_t i = firstSlot; i < outMap->layerCollection.size(); i++)
+		{
+			TmxLayer* layer = &outMap->layerCollection[i];
+			if (layer->chunks.empty())
+			{
+				pool->enqueue([&, layer](unsigned int)
+				{
+					TMX_ARENA_SCOPE(options.arena);
+					TmxReturn resolved = _resolveStoredGids(outMap->tilesetLookup, context, &layer->tiles, &layer->gids);
+					if (resolved == TmxReturn::kUnknownTileIndices)
+						unknownGids = true;
+				}, &jobs);
+			}
+
+			for (size_t c = 0; c < layer->chunks.size(); c++)
+			{
+				TmxLayerChunk* chunk = &layer->chunks[c];
+				pool->enqueue([&, chunk](unsigned int)
+				{
+					TMX_ARENA_SCOPE(options.arena);
+					TmxReturn resolved = _resolveStoredGids(outMap->tilesetLookup, context, &chunk->tiles, &chunk->gids);
+					if (resolved == TmxReturn::kUnknownTileIndices)
+						unknownGids = true;
+				}, &jobs);
+			}
+		}
+		pool->wait(jobs);
+
+		if (context->budget->exceeded)
+		{
+			return TmxReturn::kMemoryBudgetExceeded;
+		}
+
+		if (unknownGids)
+		{
+			LOGW("Layer references gids outside of every tileset...");
+		}
+	}
+
+	return error;
+}
+
+
+// Queues the tsx load of tileset, which keeps the firstgid, source and name the map gave it
+static void _beginTilesetLoad(TmxTilesetLoads* tilesetLoads, const TmxTileset& tileset, size_t slot, const std::string& fileName, const TmxParseOptions& options, TmxParseContext* context)
+{
+	tilesetLoads->pending.push_back(TmxPendingTileset());
+	TmxPendingTileset* pending = &tilesetLoads->pending.back();
+	pending->slot = slot;
+	pending->fileName = fileName;
+	pending->tileset.firstgid = tileset.firstgid;
+	pending->tileset.source = tileset.source;
+	pending->tileset.name = tileset.name;
+	pending->result = TmxReturn::kSuccess;
+
+	tilesetLoads->pool->enqueue([&options, context, pending](unsigned int worker)
+	{
+		TMX_ARENA_SCOPE(options.arena);
+		if (_isCancelled(options))
+		{
+			pending->result = TmxReturn::kCancelled;
+			return;
+		}
+
+		pending->result = _loadExternalTileset(pending->fileName, options, context->workerContexts[worker], &pending->tileset);
+	}, &tilesetLoads->jobs);
+}
+
+
+TmxReturn _parsePendingLayers(const std::vector<TmxPendingLayer>& pendingLayers, TmxMap* outMap, const TmxParseOptions& options, TmxParseContext* context)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	// every layer decodes into its own preallocated slot, so the order is kept however the work is split
+	size_t firstSlot = outMap->layerCollection.size();
+	outMap->layerCollection.resize(firstSlot + pendingLayers.size());
+
+	// infinite maps have few layers but many chunks, the chunks of one layer at a time are spread over the threads instead
+	ThreadPool* pool = (pendingLayers.size() > 1 || outMap->infinite) ? _getLayerPool(context, options.threadCount) : NULL;
+	if (pool == NULL || outMap->infinite)
+	{
+		for (size_t i = 0; i < pendingLayers.size(); i++)
+		{
+			error = _parsePendingLayer(pendingLayers[i], outMap->tilesetLookup, outMap->infinite, options, context, pool, &outMap->layerCollection[firstSlot + i]);
+			if (error)
+			{
+				LOGE("Error processing layer node...");
+				return error;
+			}
+
+			_reportProgress(options, kParsePhaseLayers, i + 1, pendingLayers.size());
+		}
+
+		return error;
+	}
+
+	ThreadPool::Group jobs;
+	std::vector<TmxReturn> results(pendingLayers.size(), TmxReturn::kSuccess);
+	std::mutex progressMutex;
+	size_t layersDone = 0;
+	for (size_t i = 0; i < pendingLayers.size(); i++)
+	{
+		pool->enqueue([&, i](unsigned int worker)
+		{
+			TMX_ARENA_SCOPE(options.arena);
+			results[i] = _parsePendingLayer(pendingLayers[i], outMap->tilesetLookup, outMap->infinite, options, context->workerContexts[worker], NULL, &outMap->layerCollection[firstSlot + i]);
+			if (results[i] == TmxReturn::kSuccess)
+			{
+				std::lock_guard<std::mutex> lock(progressMutex);
+				_reportProgress(options, kParsePhaseLayers, ++layersDone, pendingLayers.size());
+			}
+		}, &jobs);
+	}
+	pool->wait(jobs);
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		if (results[i])
+		{
+			LOGE("Error processing layer node...");
+			return results[i];
+		}
+	}
+
+	return error;
+}
+
+
+TmxReturn _parsePendingLayer(const TmxPendingLayer& pendingLayer, const TmxTilesetLookup& lookup, bool infinite, const TmxParseOptions& options, TmxParseContext* context, ThreadPool* chunkPool, TmxLayer* outLayer)
+{
+	if (_isCancelled(options))
+	{
+		return TmxReturn::kCancelled;
+	}
+
+	if (pendingLayer.element != NULL)
+	{
+		return _parseLayerNode(pendingLayer.element, lookup, infinite, options, context, chunkPool, outLayer);
+	}
+
+	tinyxml2::XMLDocument& doc = context->document;
+	if (doc.Parse(pendingLayer.xml, pendingLayer.xmlLength) != tinyxml2::XML_SUCCESS)
+	{
+		LOGE("Cannot parse xml layer node...");
+		doc.Clear();
+		return TmxReturn::kErrorParsing;
+	}
+
+	TmxReturn error = _parseLayerNode(doc.FirstChildElement(), lookup, infinite, options, context, chunkPool, outLayer);
+	doc.Clear();
+	return error;
+}
+
+
+TmxReturn _parseLayerDataNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxLayerGidSink* sink)
+{
+	TmxLayerDataCursor cursor;
+	TmxReturn error = _beginLayerData(element, element, context, &cursor);
+	if (error)
+	{
+		return error;
+	}
+
+	return _parseLayerDataChunk(&cursor, context, sink, SIZE_MAX);
+}
+
+
+TmxReturn _beginLayerData(tinyxml2::XMLElement* dataElement, tinyxml2::XMLElement* element, TmxParseContext* context, TmxLayerDataCursor* outCursor)
+{
+	const char* encoding = dataElement->Attribute("encoding");
+	const char* compression = dataElement->Attribute("compression");
+
+	if (encoding == NULL)
+	{
+		memset(outCursor, 0, sizeof(*outCursor));
+		outCursor->nextTile = element->FirstChildElement("tile");
+		return TmxReturn::kSuccess;
+	}
+
+	if (strcmp(encoding, "csv") != 0 && strcmp(encoding, "base64") != 0)
+	{
+		LOGE("Unsupported encoding: %s", encoding);
+		return TmxReturn::kErrorParsing;
+	}
+
+	const char* text = element->GetText();
+	if (text == NULL)
+	{
+		LOGE("Layer data node is empty...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (strcmp(encoding, "base64") == 0)
+	{
+		return _beginLayerBase64Data(text, strlen(text), compression, context, outCursor);
+	}
+
+	memset(outCursor, 0, sizeof(*outCursor));
+	outCursor->encoding = encoding;
+	outCursor->text = text;
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _parseLayerDataChunk(TmxLayerDataCursor* cursor, TmxParseContext* context, TmxLayerGidSink* sink, size_t maxTiles)
+{
+	if (cursor->encoding == NULL)
+	{
+		return _parseLayerXmlChunk(cursor, sink, maxTiles);
+	}
+	else if (strcmp(cursor->encoding, "csv") == 0)
+	{
+		return _parseLayerCsvChunk(cursor, sink, maxTiles);
+	}
+
+	return _parseLayerBase64Chunk(cursor, context, sink, maxTiles);
+}
+
+
+TmxReturn _parseLayerXmlChunk(TmxLayerDataCursor* cursor, TmxLayerGidSink* sink, size_t maxTiles)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	unsigned int gids[LAYER_GID_BATCH_SIZE];
+	size_t gidCount = 0;
+	size_t tileCount = 0;
+	tinyxml2::XMLElement* child = cursor->nextTile;
+	for (; child != NULL && tileCount < maxTiles; child = child->NextSiblingElement("tile"), tileCount++)
+	{
+		gids[gidCount++] = child->UnsignedAttribute("gid");
+		if (gidCount == LAYER_GID_BATCH_SIZE)
+		{
+			error = _storeLayerGids(sink, gids, gidCount);
+			if (error)
+			{
+				return error;
+			}
+			gidCount = 0;
+		}
+	}
+
+	cursor->nextTile = child;
+	cursor->done = (child == NULL);
+	return _storeLayerGids(sink, gids, gidCount);
+}
+
+
+TmxReturn _beginLayerGids(TmxLayerTileCollection_t* tiles, TmxLayerGidCollection_t* gids, size_t count, TmxLayerStorage storage, const TmxTilesetLookup& lookup, TmxParseContext* context, TmxLayerGidSink* outSink)
+{
+	// the size comes straight from the file, so it is charged before anything is allocated
+	size_t elementSize = (storage == kLayerStorageGids) ? sizeof(unsigned int) : sizeof(TmxLayerTile);
+	if (count > SIZE_MAX / elementSize || !_chargeParseMemory(context, count * elementSize))
+	{
+		return TmxReturn::kMemoryBudgetExceeded;
+	}
+
+	outSink->storage = storage;
+	outSink->lookup = &lookup;
+	outSink->tiles = tiles;
+	outSink->gids = gids;
+	outSink->count = count;
+	outSink->index = 0;
+	outSink->unknownGids = false;
+	outSink->cancel = NULL;
+
+	if (storage == kLayerStorageGids)
+		gids->resize(count);
+	else
+		tiles->resize(count);
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _storeLayerGids(TmxLayerGidSink* sink, const unsigned int* gids, size_t gidCount)
+{
+	if (sink->cancel != NULL && sink->cancel->load(std::memory_order_relaxed))
+	{
+		return TmxReturn::kCancelled;
+	}
+
+	if (sink->index + gidCount > sink->count)
+	{
+		LOGE("Layer data has more tiles than the layer...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (sink->storage == kLayerStorageGids)
+	{
+		std::copy(gids, gids + gidCount, sink->gids->begin() + sink->index);
+		sink->index += gidCount;
+		return TmxReturn::kSuccess;
+	}
+
+	// tiles are resolved batch by batch while the layer is still being decoded
+	if (resolveLayerGids(*sink->lookup, gids, gidCount, sink->tiles->data() + sink->index) != TmxReturn::kSuccess)
+	{
+		sink->unknownGids = true;
+	}
+
+	sink->index += gidCount;
+	return TmxReturn::kSuccess;
+}
+
+
+static inline bool _isCsvWhitespace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+
+static void _logCsvError(const char* text, const char* at, const char* reason)
+{
+	unsigned int line = 1;
+	const char* lineStart = text;
+	for (const char* p = text; p < at; p++)
+	{
+		if (*p == '\n')
+		{
+			line++;
+			lineStart = p + 1;
+		}
+	}
+
+	LOGE("Malformed csv layer data at offset %u (line %u, column %u): %s", (unsigned int)(at - text), line, (unsigned int)(at - lineStart) + 1, reason);
+}
+
+
+TmxReturn _parseLayerCsvData(const char* text, TmxLayerGidSink* sink)
+{
+	TmxLayerDataCursor cursor;
+	memset(&cursor, 0, sizeof(cursor));
+	cursor.encoding = "csv";
+	cursor.text = text;
+	return _parseLayerCsvChunk(&cursor, sink, SIZE_MAX);
+}
+
+
+TmxReturn _parseLayerCsvChunk(TmxLayerDataCursor* cursor, TmxLayerGidSink* sink, size_t maxTiles)
+{
+	unsigned int gids[LAYER_GID_BATCH_SIZE];
+	size_t gidCount = 0;
+
+	const char* text = cursor->text;
+	const char* p = text + cursor->textPos;
+	size_t tileIndex = sink->index;
+	size_t lastTileIndex = (maxTiles < sink->count - tileIndex) ? tileIndex + maxTiles : SIZE_MAX;
+
+	while (_isCsvWhitespace(*p))
+		p++;
+
+	while (*p != '\0')
+	{
+		if (tileIndex == lastTileIndex)
+		{
+			// stopped before the next gid, picked up from here by the next chunk
+			cursor->textPos = p - text;
+			return _storeLayerGids(sink, gids, gidCount);
+		}
+
+		if (*p < '0' || *p > '9')
+		{
+			_logCsvError(text, p, "expected a tile gid");
+			return TmxReturn::kErrorParsing;
+		}
+
+		if (tileIndex == sink->count)
+		{
+			_logCsvError(text, p, "more tiles than the layer holds");
+			return TmxReturn::kErrorParsing;
+		}
+
+		const char* numberStart = p;
+		unsigned long long gid = 0;
+		do
+		{
+			gid = gid * 10 + (unsigned int)(*p - '0');
+			if (gid > 0xFFFFFFFFull)
+			{
+				_logCsvError(text, numberStart, "tile gid out of range");
+				return TmxReturn::kErrorParsing;
+			}
+			p++;
+		}
+		while (*p >= '0' && *p <= '9');
+
+		gids[gidCount++] = (unsigned int)gid;
+		tileIndex++;
+		if (gidCount == LAYER_GID_BATCH_SIZE)
+		{
+			TmxReturn error = _storeLayerGids(sink, gids, gidCount);
+			if (error)
+			{
+				return error;
+			}
+			gidCount = 0;
+		}
+
+		while (_isCsvWhitespace(*p))
+			p++;
+
+		if (*p == ',')
+		{
+			p++;
+			while (_isCsvWhitespace(*p))
+				p++;
+
+			if (*p == '\0')
+			{
+				_logCsvError(text, p, "trailing separator");
+				return TmxReturn::kErrorParsing;
+			}
+		}
+		else if (*p != '\0')
+		{
+			_logCsvError(text, p, "expected a separator");
+			return TmxReturn::kErrorParsing;
+		}
+	}
+
+	if (tileIndex != sink->count)
+	{
+		_logCsvError(text, p, "fewer tiles than the layer holds");
+		return TmxReturn::kErrorParsing;
+	}
+
+	cursor->textPos = p - text;
+	cursor->done = true;
+	return _storeLayerGids(sink, gids, gidCount);
+}
+
+
+// base64 text is decoded, decompressed and turned into tiles one chunk at a time, so
+// besides the xml text itself only the final tile collection is ever fully in memory.
+// The chunk size is a multiple of 3 (base64 groups) and 4 (gids).
+#define LAYER_DATA_CHUNK_SIZE 12288
+
+
+static void _gidsFromLittleEndian(unsigned int* gids, size_t count)
+{
+	// tiled base64 layer data is an unsigned 32bit array little endian
+	const unsigned char* bytes = (const unsigned char*)gids;
+	for (size_t i = 0; i < count; i++, bytes += 4)
+	{
+		gids[i] = (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) | ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+	}
+}
+
+
+static TmxReturn _flushGidChunk(TmxLayerGidSink* sink, unsigned int* gidChunk, size_t byteCount)
+{
+	_gidsFromLittleEndian(gidChunk, byteCount / 4);
+	return _storeLayerGids(sink, gidChunk, byteCount / 4);
+}
+
+
+TmxReturn _parseLayerBase64Data(const char* text, size_t textLength, const char* compression, TmxParseContext* context, TmxLayerGidSink* sink)
+{
+	TmxLayerDataCursor cursor;
+	TmxReturn error = _beginLayerBase64Data(text, textLength, compression, context, &cursor);
+	if (error)
+	{
+		return error;
+	}
+
+	return _parseLayerBase64Chunk(&cursor, context, sink, SIZE_MAX);
+}
+
+
+TmxReturn _beginLayerBase64Data(const char* text, size_t textLength, const char* compression, TmxParseContext* context, TmxLayerDataCursor* outCursor)
+{
+	Decompressor& decompressor = context->decompressor;
+	if (compression)
+	{
+		bool started = false;
+		if (strcmp(compression, "gzip") == 0)
+			started = decompressor.begin(Gzip);
+		else if (strcmp(compression, "zlib") == 0)
+			started = decompressor.begin(Zlib);
+		else if (strcmp(compression, "zstd") == 0)
+			started = decompressor.begin(Zstandard);
+		else
+		{
+			LOGE("Unsupported compression format: %s", compression);
+			return TmxReturn::kErrorParsing;
+		}
+
+		if (!started)
+		{
+			return _parseMemoryError(context);
+		}
+	}
+
+	// sized once per parser, later layers and maps reuse them
+	if (!_reserveScratchBuffer(context, &context->gidChunk, LAYER_DATA_CHUNK_SIZE))
+	{
+		return _parseMemoryError(context);
+	}
+	if (compression && !_reserveScratchBuffer(context, &context->encodedChunk, LAYER_DATA_CHUNK_SIZE))
+	{
+		return _parseMemoryError(context);
+	}
+
+	memset(outCursor, 0, sizeof(*outCursor));
+	outCursor->encoding = "base64";
+	outCursor->compression = compression;
+	outCursor->text = text;
+	outCursor->textLength = textLength;
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _parseLayerBase64Chunk(TmxLayerDataCursor* cursor, TmxParseContext* context, TmxLayerGidSink* sink, size_t maxTiles)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	Decompressor& decompressor = context->decompressor;
+	unsigned int* gidChunk = (unsigned int*)context->gidChunk.data;
+	TmxScratchBuffer& encodedChunk = context->encodedChunk;
+	unsigned char* gidBytes = context->gidChunk.data;
+	const char* compression = cursor->compression;
+	size_t firstIndex = sink->index;
+	bool finished = false;
+
+	// state lives in the cursor and the context, so a chunk may stop after any flush
+	while (!finished)
+	{
+		if (sink->index - firstIndex >= maxTiles)
+		{
+			return error;
+		}
+
+		if (cursor->draining)
+		{
+			size_t room = LAYER_DATA_CHUNK_SIZE - cursor->gidChunkFill;
+			int inflated = decompressor.decompress(gidBytes + cursor->gidChunkFill, room);
+			if (inflated < 0)
+			{
+				return _parseMemoryError(context);
+			}
+
+			cursor->gidChunkFill += inflated;
+			bool outputFull = ((size_t)inflated == room);
+
+			if (cursor->gidChunkFill == LAYER_DATA_CHUNK_SIZE)
+			{
+				error = _flushGidChunk(sink, gidChunk, cursor->gidChunkFill);
+				if (error)
+				{
+					return error;
+				}
+				cursor->gidChunkFill = 0;
+			}
+
+			cursor->draining = !decompressor.finished() && (outputFull || !decompressor.inputConsumed());
+			finished = decompressor.finished();
+			continue;
+		}
+
+		if (cursor->textPos >= cursor->textLength)
+		{
+			break;
+		}
+
+		// uncompressed data decodes straight into the gid chunk
+		unsigned char* decodeTarget = compression ? encodedChunk.data : gidBytes + cursor->gidChunkFill;
+		size_t decodeCapacity = compression ? encodedChunk.size : LAYER_DATA_CHUNK_SIZE - cursor->gidChunkFill;
+
+		size_t consumed = 0;
+		size_t decoded = base64_decode(cursor->text + cursor->textPos, cursor->textLength - cursor->textPos, decodeTarget, decodeCapacity, &consumed);
+		if (decoded == BASE64_DECODE_ERROR)
+		{
+			LOGE("Malformed base64 layer data...");
+			return TmxReturn::kErrorParsing;
+		}
+
+		cursor->textPos += consumed;
+		if (decoded == 0)
+		{
+			// only trailing whitespace was left
+			break;
+		}
+
+		if (!compression)
+		{
+			cursor->gidChunkFill += decoded;
+			if (cursor->gidChunkFill == LAYER_DATA_CHUNK_SIZE)
+			{
+				error = _flushGidChunk(sink, gidChunk, cursor->gidChunkFill);
+				if (error)
+				{
+					return error;
+				}
+				cursor->gidChunkFill = 0;
+			}
+		}
+		else
+		{
+			decompressor.setInput(encodedChunk.data, decoded);
+			cursor->draining = true;
+		}
+	}
+
+	if (compression && !decompressor.finished())
+	{
+		LOGE("Compressed layer data is truncated...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (cursor->gidChunkFill % 4 != 0)
+	{
+		LOGE("Layer data is not a whole number of tiles...");
+		return TmxReturn::kErrorParsing;
+	}
 
-    tileDef.id = 0;
+	error = _flushGidChunk(sink, gidChunk, cursor->gidChunkFill);
+	if (error)
+	{
+		return error;
+	}
+	cursor->gidChunkFill = 0;
 
-    error = _parseTileDefinitionNode(child, &tileDef);
-    if (error)
-    {
-      LOGE("Error parsing tile definition");
-      return error;
-    }
+	if (sink->index != sink->count)
+	{
+		LOGE("Layer data has %u tiles, expected %u...", (unsigned int)sink->index, (unsigned int)sink->count);
+		return TmxReturn::kErrorParsing;
+	}
 
-    outTileset->tileDefinitions[tileDef.id] = tileDef;
-  }
+	cursor->done = true;
+	return error;
+}
 
-  // derive row/col count, calculate tile indices
-  // TODO - this is why we do not accept tilesets without image tag atm
-  outTileset->colCount = (outTileset->image.width - outTileset->tileMarginInImage) / (outTileset->tileWidth + outTileset->tileSpacingInImage);
-  outTileset->rowCount = (outTileset->image.height - outTileset->tileMarginInImage) / (outTileset->tileHeight + outTileset->tileSpacingInImage);
 
-	return TmxReturn::kSuccess;
-}
+// Above this many gids the lookup falls back to a binary search over the ranges.
+#define TILESET_LOOKUP_DENSE_LIMIT (1 << 20)
 
 
-TmxReturn _parseTilesetNode(tinyxml2::XMLElement* element, TmxTileset* outTileset, std::string tilesetPath)
+static bool _tilesetRangeLess(const TmxTilesetRange& lhs, const TmxTilesetRange& rhs)
 {
-	if (strcmp(element->Name(), "tileset") == 0)
-	{
-		CHECK_AND_RETRIEVE_REQ_ATTRIBUTE(element->QueryUnsignedAttribute, "firstgid", &outTileset->firstgid);
+	return lhs.firstgid < rhs.firstgid;
+}
 
-    // External tileset file
-    char const* source = element->Attribute("source");
-    if (source != nullptr)
-    {
-      outTileset->source = source;
 
-      tinyxml2::XMLDocument tileDoc;
-      if (tileDoc.LoadFile(_updatePath(source, tilesetPath).c_str()) != tinyxml2::XML_SUCCESS)
-      {
-        LOGE("Cannot read tileset xml file");
-        return TmxReturn::kErrorParsing;
-      }
+// Every tileset is loaded, layers can be resolved from here on
+TmxReturn _finishTilesets(TmxMap* outMap, const TmxParseOptions& options)
+{
+	buildTilesetLookup(outMap->tilesetCollection, &outMap->tilesetLookup);
+	_reportProgress(options, kParsePhaseTilesets, outMap->tilesetCollection.size(), outMap->tilesetCollection.size());
 
-      tinyxml2::XMLElement* tileElement = tileDoc.FirstChildElement("tileset");
+	return _isCancelled(options) ? TmxReturn::kCancelled : TmxReturn::kSuccess;
+}
 
-      if (tileElement == NULL)
-      {
-        return TmxReturn::kMissingTilesetNode;
-      }
 
-      TmxReturn retVal = _parseTileset(tileElement, outTileset);
-      if (retVal != TmxReturn::kSuccess)
-      {
-        return retVal;
-      }
+void buildTilesetLookup(const TmxTilesetCollection_t& tilesets, TmxTilesetLookup* outLookup)
+{
+	TmxTilesetRangeCollection_t ranges;
+	ranges.reserve(tilesets.size());
 
-      outTileset->name = outTileset->source.substr(0, outTileset->source.rfind('.'));
+	// a tile's flat index counts from the end of the previous tileset
+	unsigned int lastEndIndex = 1;
+	for (unsigned int index = 0; index < tilesets.size(); index++)
+	{
+		const TmxTileset& tileset = tilesets[index];
 
-    }
+		TmxTilesetRange range;
+		range.firstgid = tileset.firstgid;
+		range.endgid = tileset.firstgid + (tileset.colCount * tileset.rowCount);
+		range.flatIndexBase = lastEndIndex;
+		range.tilesetIndex = index;
 
-    // Embedded tileset
-    else
-    {
-      return _parseTileset(element, outTileset);
-    }
+		if (range.endgid > range.firstgid)
+		{
+			ranges.push_back(range);
+		}
 
+		lastEndIndex = range.endgid;
 	}
 
-	return TmxReturn::kSuccess;
+	_buildTilesetLookupFromRanges(ranges, outLookup);
 }
 
 
-TmxReturn _parseTileDefinitionNode(tinyxml2::XMLElement* element, TmxTileDefinition* outTileDefinition)
+// Sorts the ranges of every tileset, clips overlaps and fills the dense table when the gids allow it
+void _buildTilesetLookupFromRanges(TmxTilesetRangeCollection_t& ranges, TmxTilesetLookup* outLookup)
 {
-	TmxReturn error = TmxReturn::kSuccess;
+	std::stable_sort(ranges.begin(), ranges.end(), _tilesetRangeLess);
 
-	outTileDefinition->id = element->UnsignedAttribute("id");
-	error = _parsePropertyNode(element->FirstChildElement("properties"), &outTileDefinition->propertyMap);
-	if (error)
+	// where ranges overlap the lower one keeps the gids
+	outLookup->ranges.clear();
+	outLookup->ranges.reserve(ranges.size());
+	for (auto it = ranges.begin(); it != ranges.end(); ++it)
 	{
-		return error;
+		TmxTilesetRange range = *it;
+		if (!outLookup->ranges.empty() && range.firstgid < outLookup->ranges.back().endgid)
+		{
+			range.firstgid = outLookup->ranges.back().endgid;
+		}
+
+		if (range.firstgid < range.endgid)
+		{
+			outLookup->ranges.push_back(range);
+		}
 	}
 
-	if (element->FirstChildElement("animation") != NULL)
+	outLookup->rangeByGid.clear();
+	if (!outLookup->ranges.empty() && outLookup->ranges.back().endgid <= TILESET_LOOKUP_DENSE_LIMIT)
 	{
-		error = _parseTileAnimationNode(element->FirstChildElement("animation"), &outTileDefinition->animations);
+		outLookup->rangeByGid.assign(outLookup->ranges.back().endgid, 0);
+		for (unsigned int i = 0; i < outLookup->ranges.size(); i++)
+		{
+			const TmxTilesetRange& range = outLookup->ranges[i];
+			std::fill(outLookup->rangeByGid.begin() + range.firstgid, outLookup->rangeByGid.begin() + range.endgid, i + 1);
+		}
 	}
+}
 
-	for (tinyxml2::XMLElement* child = element->FirstChildElement("objectgroup"); child != NULL; child = child->NextSiblingElement("objectgroup"))
+
+const TmxTilesetRange* _findTilesetRange(const TmxTilesetLookup& lookup, unsigned int gid)
+{
+	if (!lookup.rangeByGid.empty())
 	{
-		TmxObjectGroup group;
-		error = _parseObjectGroupNode(child, &group);
-		if (error)
+		if (gid >= lookup.rangeByGid.size())
 		{
-			LOGE("Error processing objectgroup node...");
-			return error;
+			return NULL;
 		}
 
-		outTileDefinition->objectgroups.push_back(group);
+		unsigned int rangeIndex = lookup.rangeByGid[gid];
+		return (rangeIndex != 0) ? &lookup.ranges[rangeIndex - 1] : NULL;
 	}
 
-	return error;
+	// last range starting at or before gid
+	unsigned int low = 0;
+	unsigned int high = lookup.ranges.size();
+	while (low < high)
+	{
+		unsigned int mid = low + (high - low) / 2;
+		if (lookup.ranges[mid].firstgid <= gid)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low == 0 || gid >= lookup.ranges[low - 1].endgid)
+	{
+		return NULL;
+	}
+
+	return &lookup.ranges[low - 1];
 }
 
 
-TmxReturn _parseTileAnimationNode(tinyxml2::XMLElement* element, TmxAnimationFrameCollection_t* outAnimationCollection)
+TmxReturn resolveTileIndices(const TmxTilesetLookup& lookup, TmxLayerTile* tiles, size_t count)
 {
-	for (tinyxml2::XMLElement* child = element->FirstChildElement("frame"); child != NULL; child = child->NextSiblingElement("frame"))
+	TmxReturn error = TmxReturn::kSuccess;
+
+	for (TmxLayerTile* tile = tiles; tile != tiles + count; ++tile)
 	{
-		TmxAnimationFrame frame;
-		frame.duration = child->FloatAttribute("duration");
-		frame.tileId = child->UnsignedAttribute("tileid");
+		tile->tilesetIndex = 0;
+		tile->tileFlatIndex = 0;
 
-		outAnimationCollection->push_back(frame);
+		if (tile->gid == 0)
+		{
+			continue;
+		}
+
+		const TmxTilesetRange* range = _findTilesetRange(lookup, tile->gid);
+		if (range == NULL)
+		{
+			error = TmxReturn::kUnknownTileIndices;
+			continue;
+		}
+
+		tile->tilesetIndex = range->tilesetIndex;
+		tile->tileFlatIndex = tile->gid - range->flatIndexBase;
 	}
 
-	return kSuccess;
+	return error;
 }
 
 
-TmxReturn _parseLayerNode(tinyxml2::XMLElement* element, const TmxTilesetCollection_t& tilesets, TmxLayer* outLayer)
+typedef size_t (*TmxResolveGidsKernel)(const TmxTilesetLookup& lookup, const unsigned int* gids, size_t count, TmxLayerTile* outTiles, bool* outUnknown);
+
+
+static inline void _resolveGid(const TmxTilesetLookup& lookup, unsigned int rawGid, TmxLayerTile* outTile, bool* outUnknown)
 {
-	TmxReturn error = TmxReturn::kSuccess;
+	unsigned int gid = rawGid & ~kGidFlagsMask;
 
-	outLayer->name = element->Attribute("name");
-	if (element->Attribute("opacity"))
-		outLayer->opacity = element->FloatAttribute("opacity");
-	else
-		outLayer->opacity = 1.f;
-	if (element->Attribute("visible"))
-		outLayer->visible = (element->IntAttribute("visible") == 1 ? true : false);
-	else
-		outLayer->visible = true;
-	outLayer->width = element->UnsignedAttribute("width");
-	outLayer->height = element->UnsignedAttribute("height");
+	outTile->gid = gid;
+	outTile->flipX = (rawGid & kGidFlipX ? true : false);
+	outTile->flipY = (rawGid & kGidFlipY ? true : false);
+	outTile->flipDiagonal = (rawGid & kGidFlipDiagonal ? true : false);
+	outTile->tilesetIndex = 0;
+	outTile->tileFlatIndex = 0;
 
-	error = _parsePropertyNode(element->FirstChildElement("properties"), &outLayer->propertyMap);
-	if (error)
+	if (gid == 0)
 	{
-		LOGE("Error parsing layer property node...");
-		return error;
+		return;
 	}
 
-	// check data node and type
-	tinyxml2::XMLElement* dataElement = element->FirstChildElement("data");
-	if (dataElement != NULL)
+	const TmxTilesetRange* range = _findTilesetRange(lookup, gid);
+	if (range == NULL)
 	{
-		error = _parseLayerDataNode(dataElement, tilesets, &outLayer->tiles, outLayer->width * outLayer->height * 4);
+		*outUnknown = true;
+		return;
 	}
-	else
+
+	outTile->tilesetIndex = range->tilesetIndex;
+	outTile->tileFlatIndex = gid - range->flatIndexBase;
+}
+
+
+static size_t _resolveGidsScalar(const TmxTilesetLookup& lookup, const unsigned int* gids, size_t count, TmxLayerTile* outTiles, bool* outUnknown)
+{
+	for (size_t i = 0; i < count; i++)
 	{
-		LOGE("Layer missing data node...");
-		return TmxReturn::kMissingDataNode;
+		_resolveGid(lookup, gids[i], &outTiles[i], outUnknown);
 	}
 
-	return error;
+	return count;
 }
 
 
-TmxReturn _parseLayerDataNode(tinyxml2::XMLElement* element, const TmxTilesetCollection_t& tilesets, TmxLayerTileCollection_t* outTileCollection, unsigned int dataLength)
+#if TMX_X86_DISPATCH
+
+// Resolves 8 tiles per iteration through the dense gid table using gathers, then
+// transposes gid/tileset/flat/flags lanes into 8 whole TmxLayerTile structs.
+// Leaves the remainder and sparse lookups to the scalar code.
+__attribute__((target("avx2")))
+static size_t _resolveGidsAvx2(const TmxTilesetLookup& lookup, const unsigned int* gids, size_t count, TmxLayerTile* outTiles, bool* outUnknown)
 {
-	TmxReturn error = TmxReturn::kSuccess;
+	if (lookup.rangeByGid.empty())
+	{
+		return 0;
+	}
 
-	const char* encoding = element->Attribute("encoding");
-	const char* compression = element->Attribute("compression");
+	const int* table = (const int*)lookup.rangeByGid.data();
+	const int* rangeFields = (const int*)lookup.ranges.data();
 
-	if (encoding == NULL)
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i gidMask = _mm256_set1_epi32((int)~kGidFlagsMask);
+	const __m256i tableSize = _mm256_set1_epi32((int)lookup.rangeByGid.size());
+	__m256i unknown = zero;
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
 	{
-		for (tinyxml2::XMLElement* child = element->FirstChildElement("tile"); child != NULL; child = child->NextSiblingElement("tile"))
-		{
-			TmxLayerTile tile;
-			error = _parseLayerXmlTileNode(child, tilesets, &tile);
-			outTileCollection->push_back(tile);
-		}
+		__m256i raw = _mm256_loadu_si256((const __m256i*)(gids + i));
+		__m256i gid = _mm256_and_si256(raw, gidMask);
+
+		// flipX, flipY, flipDiagonal as the bytes of the last dword of a tile
+		__m256i flags = _mm256_srli_epi32(raw, 31);
+		flags = _mm256_or_si256(flags, _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(raw, 30), one), 8));
+		flags = _mm256_or_si256(flags, _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(raw, 29), one), 16));
+
+		__m256i inTable = _mm256_cmpgt_epi32(tableSize, gid);
+		__m256i rangeIndex = _mm256_mask_i32gather_epi32(zero, table, gid, inTable, 4);
+		__m256i found = _mm256_cmpgt_epi32(rangeIndex, zero);
+
+		// TmxTilesetRange is 4 dwords: firstgid, endgid, flatIndexBase, tilesetIndex
+		__m256i field = _mm256_slli_epi32(_mm256_sub_epi32(rangeIndex, one), 2);
+		__m256i flatBase = _mm256_mask_i32gather_epi32(zero, rangeFields + 2, field, found, 4);
+		__m256i tileset = _mm256_mask_i32gather_epi32(zero, rangeFields + 3, field, found, 4);
+		__m256i flat = _mm256_and_si256(_mm256_sub_epi32(gid, flatBase), found);
+
+		__m256i nonZero = _mm256_xor_si256(_mm256_cmpeq_epi32(gid, zero), _mm256_set1_epi32(-1));
+		unknown = _mm256_or_si256(unknown, _mm256_andnot_si256(found, nonZero));
+
+		__m256i a = _mm256_unpacklo_epi32(gid, tileset);
+		__m256i b = _mm256_unpackhi_epi32(gid, tileset);
+		__m256i c = _mm256_unpacklo_epi32(flat, flags);
+		__m256i d = _mm256_unpackhi_epi32(flat, flags);
+		__m256i t0 = _mm256_unpacklo_epi64(a, c);
+		__m256i t1 = _mm256_unpackhi_epi64(a, c);
+		__m256i t2 = _mm256_unpacklo_epi64(b, d);
+		__m256i t3 = _mm256_unpackhi_epi64(b, d);
+
+		__m256i* out = (__m256i*)(outTiles + i);
+		_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(t0, t1, 0x20));
+		_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(t2, t3, 0x20));
+		_mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(t0, t1, 0x31));
+		_mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(t2, t3, 0x31));
 	}
-	else if (strcmp(encoding, "csv") == 0)
+
+	if (!_mm256_testz_si256(unknown, unknown))
 	{
-		std::stringstream csvss(element->FirstChild()->Value());
-		//LOGE("TEXT = %s", csv.c_str());
+		*outUnknown = true;
+	}
 
-		unsigned int gid = 0;
-		while (csvss >> gid)
-		{
-			if (csvss.peek() == ',' || csvss.peek() == '\n')
-			{
-				csvss.ignore();
-			}
+	return i;
+}
 
-			TmxLayerTile tile;
+#endif
 
-			tile.gid = gid;
-			error = _calculateTileIndices(tilesets, &tile);
-			if (error == TmxReturn::kErrorParsing)
-			{
-				return error;
-			}
 
-			outTileCollection->push_back(tile);
-		}
+static TmxResolveGidsKernel _selectResolveGidsKernel()
+{
+#if TMX_X86_DISPATCH
+	// the vector kernel writes whole tiles, so it relies on the usual struct layout
+	bool tileLayout = sizeof(TmxLayerTile) == 16 &&
+		offsetof(TmxLayerTile, tilesetIndex) == 4 && offsetof(TmxLayerTile, tileFlatIndex) == 8 &&
+		offsetof(TmxLayerTile, flipX) == 12 && offsetof(TmxLayerTile, flipY) == 13 && offsetof(TmxLayerTile, flipDiagonal) == 14 &&
+		sizeof(bool) == 1 && sizeof(TmxTilesetRange) == 16;
+
+	__builtin_cpu_init();
+	if (tileLayout && __builtin_cpu_supports("avx2"))
+	{
+		return _resolveGidsAvx2;
+	}
+#endif
+	return _resolveGidsScalar;
+}
+
+
+TmxReturn resolveLayerGids(const TmxTilesetLookup& lookup, const unsigned int* gids, size_t count, TmxLayerTile* outTiles)
+{
+	static const TmxResolveGidsKernel resolveGids = _selectResolveGidsKernel();
+
+	bool unknown = false;
+	size_t done = resolveGids(lookup, gids, count, outTiles, &unknown);
+	_resolveGidsScalar(lookup, gids + done, count - done, outTiles + done, &unknown);
+
+	return unknown ? TmxReturn::kUnknownTileIndices : TmxReturn::kSuccess;
+}
+
+
+// Layers and the chunks of infinite maps keep their tiles the same way
+template <typename T>
+static unsigned int _storedTileCount(const T& stored)
+{
+	if (stored.lazyData != NULL)
+	{
+		return (unsigned int)stored.lazyData->count;
 	}
-	else if (strcmp(encoding, "base64") == 0)
+
+	return (unsigned int)(stored.gids.empty() ? stored.tiles.size() : stored.gids.size());
+}
+
+
+template <typename T>
+static const TmxLayerTileCollection_t* _storedTiles(const TmxMap& map, const T& stored)
+{
+	TmxLazyLayerData* lazyData = stored.lazyData.get();
+	if (lazyData == NULL)
 	{
-		std::string csvbase64 = element->FirstChild()->Value();
+		return stored.gids.empty() ? &stored.tiles : NULL;
+	}
 
-		csvbase64.erase(std::remove(csvbase64.begin(), csvbase64.end(), '\n'), csvbase64.end());
-		csvbase64.erase(std::remove(csvbase64.begin(), csvbase64.end(), '\r'), csvbase64.end());
-		csvbase64.erase(std::remove(csvbase64.begin(), csvbase64.end(), ' '), csvbase64.end());
+	std::call_once(lazyData->decoded, _decodeLazyLayer, std::cref(map.tilesetLookup), lazyData);
+	return (lazyData->result == TmxReturn::kSuccess) ? &lazyData->tiles : NULL;
+}
 
-		std::string data = base64_decode(csvbase64);
-		std::vector<char> uncompressed_data;
 
-		// tiled base64 layer data is an unsigned 32bit array little endian
-		// TODO - verify this on other platforms, write some tests
-		unsigned int* p;
+template <typename T>
+static TmxReturn _storedTile(const TmxMap& map, const T& stored, unsigned int index, TmxLayerTile* outTile)
+{
+	if (stored.lazyData != NULL)
+	{
+		const TmxLayerTileCollection_t* tiles = _storedTiles(map, stored);
+		if (tiles == NULL)
+		{
+			return TmxReturn::kErrorParsing;
+		}
 
-		if (compression)
+		if (index >= tiles->size())
 		{
-			if (strcmp(compression, "gzip") == 0)
-				uncompressed_data = decompress(data, dataLength, Gzip);
-			else if (strcmp(compression, "zlib") == 0)
-				uncompressed_data = decompress(data, dataLength, Zlib);
-			else if (strcmp(compression, "zstd") == 0)
-				uncompressed_data = decompress(data, dataLength, Zstandard);
-			else
-			{
-				LOGE("Unsupported compression format: %s", compression);
-				return TmxReturn::kErrorParsing;
-			}
-			p = (unsigned int*) uncompressed_data.data();
+			return TmxReturn::kInvalidTileIndex;
 		}
-		else
-			p = (unsigned int*) data.data();
 
-		unsigned int length = dataLength / 4;
+		*outTile = (*tiles)[index];
+		return TmxReturn::kSuccess;
+	}
 
-		for (unsigned int i = 0; i < length; i++)
+	if (stored.gids.empty())
+	{
+		if (index >= stored.tiles.size())
 		{
-			TmxLayerTile tile;
-			tile.gid = p[i];
-			error = _calculateTileIndices(tilesets, &tile);
-			if (error == TmxReturn::kErrorParsing)
-			{
-				return error;
-			}
-
-			outTileCollection->push_back(tile);
+			return TmxReturn::kInvalidTileIndex;
 		}
+
+		*outTile = stored.tiles[index];
+		return TmxReturn::kSuccess;
 	}
-	else
+
+	if (index >= stored.gids.size())
 	{
-		LOGE("Unsupported encoding: %s", encoding);
-		return TmxReturn::kErrorParsing;
+		return TmxReturn::kInvalidTileIndex;
 	}
 
-	return error;
+	resolveLayerGids(map.tilesetLookup, &stored.gids[index], 1, outTile);
+	return TmxReturn::kSuccess;
 }
 
 
+unsigned int getLayerTileCount(const TmxLayer& layer)
+{
+	return _storedTileCount(layer);
+}
+
 
-TmxReturn _parseLayerXmlTileNode(tinyxml2::XMLElement* element, const TmxTilesetCollection_t& tilesets, TmxLayerTile* outTile)
+unsigned int getLayerTileCount(const TmxLayerChunk& chunk)
 {
-	TmxReturn error = TmxReturn::kSuccess;
+	return _storedTileCount(chunk);
+}
 
-	unsigned int gid = element->UnsignedAttribute("gid");
 
-	unsigned int flipXFlag = 0x80000000;
-	unsigned int flipYFlag = 0x40000000;
-	unsigned int flipDiagonalFlag = 0x20000000;
+const TmxTileDefinitionMap_t& getTileDefinitions(const TmxTileset& tileset)
+{
+	return (tileset.sharedTileDefinitions != NULL) ? *tileset.sharedTileDefinitions : tileset.tileDefinitions;
+}
 
-	outTile->flipX = (gid & flipXFlag ? true : false);
-	outTile->flipY = (gid & flipYFlag ? true : false);
-	outTile->flipDiagonal = (gid & flipDiagonalFlag ? true : false);
-	outTile->gid = (gid & ~(flipXFlag | flipYFlag | flipDiagonalFlag));
 
-	return _calculateTileIndices(tilesets, outTile);
+const TmxLayerTileCollection_t* getLayerTiles(const TmxMap& map, const TmxLayer& layer)
+{
+	return _storedTiles(map, layer);
 }
 
 
-TmxReturn _calculateTileIndices(const TmxTilesetCollection_t& tilesets, TmxLayerTile* outTile)
+const TmxLayerTileCollection_t* getLayerTiles(const TmxMap& map, const TmxLayerChunk& chunk)
 {
-	outTile->tilesetIndex = 0;
-	outTile->tileFlatIndex = 0;
+	return _storedTiles(map, chunk);
+}
 
-	// exit quickly
-	if (outTile->gid == 0)
+
+TmxReturn getLayerTile(const TmxMap& map, const TmxLayer& layer, unsigned int index, TmxLayerTile* outTile)
+{
+	return _storedTile(map, layer, index, outTile);
+}
+
+
+TmxReturn getLayerTile(const TmxMap& map, const TmxLayerChunk& chunk, unsigned int index, TmxLayerTile* outTile)
+{
+	return _storedTile(map, chunk, index, outTile);
+}
+
+
+const TmxLayerChunk* getLayerChunk(const TmxLayer& layer, int chunkX, int chunkY)
+{
+	if (layer.chunks.empty())
 	{
-		return TmxReturn::kSuccess;
+		return NULL;
 	}
 
-	// search for tilesetindex
-	// O(n) where n = number of tilesets
-	// Generally n will never be high but this method is called from an O(m) method.
-	unsigned int index = 0;
-	unsigned int lastEndIndex = 1;
-	for (auto it = tilesets.begin(); it != tilesets.end(); ++it)
+	TmxLayerChunk key;
+	key.x = chunkX * (int)layer.chunkWidth;
+	key.y = chunkY * (int)layer.chunkHeight;
+
+	TmxLayerChunkCollection_t::const_iterator it = std::lower_bound(layer.chunks.begin(), layer.chunks.end(), key, _layerChunkLess);
+	if (it == layer.chunks.end() || it->x != key.x || it->y != key.y)
 	{
-		unsigned int colCount = it->colCount;
-		unsigned int rowCount = it->rowCount;
-		unsigned int startIndex = it->firstgid;
-		unsigned int endIndex = it->firstgid + ( colCount * rowCount );
+		return NULL;
+	}
 
-		if (outTile->gid >= startIndex && outTile->gid < endIndex)
-		{
-			outTile->tilesetIndex = index;
-			outTile->tileFlatIndex = (outTile->gid) - lastEndIndex;
+	return &*it;
+}
 
-			// done
-			return TmxReturn::kSuccess;
-		}
 
-		lastEndIndex = endIndex;
+TmxReturn _parseObjectGroupNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxObjectGroup* outObjectGroup)
+{
+	TmxReturn error = _parseObjectGroupAttributes(element, context, outObjectGroup);
+	if (error)
+	{
+		return error;
+	}
 
-		index++;
+	outObjectGroup->objects.reserve(_countChildElements(element, "object"));
+	for (tinyxml2::XMLElement* child = element->FirstChildElement("object"); child != NULL; child = child->NextSiblingElement("object"))
+	{
+		outObjectGroup->objects.push_back(TmxObject());
+		error = _parseObjectNode(child, context, &outObjectGroup->objects.back());
+		if (error)
+		{
+			LOGE("Error parsing object node...");
+			return _parseMemoryError(context);
+		}
 	}
 
-	// if we made it here, tile indices could not be found
-	return TmxReturn::kUnknownTileIndices;
+	return error;
 }
 
 
-TmxReturn _parseObjectGroupNode(tinyxml2::XMLElement* element, TmxObjectGroup* outObjectGroup)
+TmxReturn _parseObjectGroupAttributes(tinyxml2::XMLElement* element, TmxParseContext* context, TmxObjectGroup* outObjectGroup)
 {
 	TmxReturn error = TmxReturn::kSuccess;
 
@@ -747,41 +4194,24 @@ TmxReturn _parseObjectGroupNode(tinyxml2::XMLElement* element, TmxObjectGroup* o
 		outObjectGroup->visible = true;
 	}
 
-	error = _parsePropertyNode(element->FirstChildElement("properties"), &outObjectGroup->propertyMap);
-	if (error)
-	{
-		return error;
-	}
-
-	for (tinyxml2::XMLElement* child = element->FirstChildElement("object"); child != NULL; child = child->NextSiblingElement("object"))
-	{
-		TmxObject obj;
-		error = _parseObjectNode(child, &obj);
-		if (error)
-		{
-			LOGE("Error parsing object node...");
-			return TmxReturn::kErrorParsing;
-		}
-		outObjectGroup->objects.push_back(obj);
-	}
-
-	return error;
+	return _parsePropertyNode(element->FirstChildElement("properties"), context, &outObjectGroup->propertyMap);
 }
 
 
-TmxReturn _parseObjectNode(tinyxml2::XMLElement* element, TmxObject* outObj)
+TmxReturn _parseObjectNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxObject* outObj)
 {
 	TmxReturn error = TmxReturn::kSuccess;
 
-	if (element->Attribute("name"))
+	error = _internParseString(element->Attribute("name") ? element->Attribute("name") : "", context, &outObj->name);
+	if (error == TmxReturn::kSuccess)
 	{
-		outObj->name = element->Attribute("name");
+		error = _internParseString(element->Attribute("type") ? element->Attribute("type") : "", context, &outObj->type);
 	}
-
-	if (element->Attribute("type"))
+	if (error)
 	{
-		outObj->type = element->Attribute("type");
+		return error;
 	}
+
 	outObj->x = element->FloatAttribute("x");
 	outObj->y = element->FloatAttribute("y");
 	outObj->width = element->FloatAttribute("width");
@@ -790,7 +4220,7 @@ TmxReturn _parseObjectNode(tinyxml2::XMLElement* element, TmxObject* outObj)
 	outObj->referenceGid = element->UnsignedAttribute("gid");
 	outObj->visible = element->BoolAttribute("visible");
 
-	error = _parsePropertyNode(element->FirstChildElement("properties"), &outObj->propertyMap);
+	error = _parsePropertyNode(element->FirstChildElement("properties"), context, &outObj->propertyMap);
 	if (error)
 	{
 		return error;
@@ -898,7 +4328,7 @@ tmxparser::TmxReturn _parseOffsetNode(tinyxml2::XMLElement* element, TmxOffset*
 	return error;
 }
 
-tmxparser::TmxReturn _parseImageLayerNode(tinyxml2::XMLElement* element, TmxImageLayer* outImageLayer)
+tmxparser::TmxReturn _parseImageLayerNode(tinyxml2::XMLElement* element, TmxParseContext* context, TmxImageLayer* outImageLayer)
 {
 	TmxReturn error = TmxReturn::kSuccess;
 
@@ -931,7 +4361,7 @@ tmxparser::TmxReturn _parseImageLayerNode(tinyxml2::XMLElement* element, TmxImag
 	// properties: optional
 	if (element->FirstChildElement("properties") != NULL)
 	{
-		error = _parsePropertyNode(element->FirstChildElement("properties"), &outImageLayer->propertyMap);
+		error = _parsePropertyNode(element->FirstChildElement("properties"), context, &outImageLayer->propertyMap);
 		if (error != kSuccess)
 		{
 			LOGE("Error parsing image layer property node...");
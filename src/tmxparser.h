@@ -26,9 +26,21 @@ THE SOFTWARE.
 #define _LIB_TMX_PARSER_H_
 
 
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 
-#if defined __GXX_EXPERIMENTAL_CXX0X__ || (_MSC_VER >= 1800)
+#if defined TMXPARSER_USE_ARENA
+#include <unordered_map>
+#include "tmxarena.h"
+template <typename TKey, typename TValue>
+struct Map
+{
+	typedef std::unordered_map<TKey, TValue, tmxparser::TmxArenaHash<TKey>, std::equal_to<TKey>, tmxparser::TmxArenaAllocator<std::pair<const TKey, TValue> > > type;
+};
+#elif defined __GXX_EXPERIMENTAL_CXX0X__ || (_MSC_VER >= 1800)
 #include <unordered_map>
 template <typename TKey, typename TValue>
 struct Map
@@ -64,10 +76,43 @@ typedef enum
 	kMalformedPropertyNode,
 	kInvalidTileIndex,
 	kUnknownTileIndices,
+	kStaleBinaryMap,
+	kCancelled,
+	kInProgress,
+	kMemoryBudgetExceeded,
 } TmxReturn;
 
 
-typedef Map<std::string, std::string>::type TmxPropertyMap_t;
+/**
+ * Strings and collections of a TmxMap.  Plain std::string and std::vector, unless the library and everything
+ * including it are built with TMXPARSER_USE_ARENA, see tmxarena.h.
+ */
+#ifdef TMXPARSER_USE_ARENA
+typedef TmxArenaString TmxString;
+template <typename T>
+struct Vector
+{
+	typedef std::vector<T, TmxArenaAllocator<T> > type;
+};
+#else
+typedef std::string TmxString;
+template <typename T>
+struct Vector
+{
+	typedef std::vector<T> type;
+};
+#endif
+
+
+/**
+ * Handle of a string in the process wide string table, see internString.  Object names and types, tile types and
+ * property names are kept as handles, so comparing them is comparing integers.
+ */
+typedef unsigned int TmxStringId;
+
+
+const TmxStringId kEmptyStringId = 0; /// "", the name or type of an object that has none
+const TmxStringId kInvalidStringId = 0xFFFFFFFF; /// what findStringId returns for a string no map used
 
 
 typedef unsigned int TileId_t;
@@ -99,13 +144,43 @@ typedef struct
 } TmxRect;
 
 
+/// The type attribute of a property, kPropertyString when it has none
+typedef enum
+{
+	kPropertyString,
+	kPropertyInt,
+	kPropertyFloat,
+	kPropertyBool,
+	kPropertyColor,
+	kPropertyFile,
+	kPropertyObject,
+} TmxPropertyType;
+
+
+/**
+ * A property, its value parsed once while loading.  type says which member of the union holds it, value keeps the
+ * text as written in the file for every type.
+ */
 typedef struct
 {
-	std::string name;
-	std::string value;
+	TmxStringId name;
+	TmxPropertyType type;
+	union
+	{
+		int intValue;
+		float floatValue;
+		bool boolValue;
+		unsigned int colorValue; /// packed 0xRRGGBBAA, 0 for a color left empty
+		unsigned int objectId; /// 0 for no object
+	};
+	TmxString value;
 } TmxProperty;
 
 
+/// Sorted by name id, each name at most once, see findProperty
+typedef Vector<TmxProperty>::type TmxPropertyMap_t;
+
+
 typedef struct
 {
 	TileId_t tileId;
@@ -113,19 +188,19 @@ typedef struct
 } TmxAnimationFrame;
 
 
-typedef std::vector<TmxAnimationFrame> TmxAnimationFrameCollection_t;
+typedef Vector<TmxAnimationFrame>::type TmxAnimationFrameCollection_t;
 
 
 typedef std::pair<float, float> TmxShapePoint;
 
 
-typedef std::vector<TmxShapePoint> TmxShapePointCollection_t;
+typedef Vector<TmxShapePoint>::type TmxShapePointCollection_t;
 
 
 typedef struct
 {
-	std::string name;
-	std::string type;
+	TmxStringId name;
+	TmxStringId type;
 	float x;
 	float y;
 	float width;
@@ -139,13 +214,13 @@ typedef struct
 } TmxObject;
 
 
-typedef std::vector<TmxObject> TmxObjectCollection_t;
+typedef Vector<TmxObject>::type TmxObjectCollection_t;
 
 
 typedef struct
 {
-	std::string name;
-	std::string color;
+	TmxString name;
+	TmxString color;
 	float opacity;
 	bool visible;
 	TmxPropertyMap_t propertyMap;
@@ -153,12 +228,13 @@ typedef struct
 } TmxObjectGroup;
 
 
-typedef std::vector<TmxObjectGroup> TmxObjectGroupCollection_t;
+typedef Vector<TmxObjectGroup>::type TmxObjectGroupCollection_t;
 
 
 typedef struct
 {
 	TileId_t id;
+	TmxStringId type; /// "class" since Tiled 1.9, kEmptyStringId if the tile has none
 	TmxPropertyMap_t propertyMap;
 	TmxAnimationFrameCollection_t animations;
 	TmxObjectGroupCollection_t objectgroups;
@@ -177,9 +253,9 @@ typedef struct
 
 typedef struct
 {
-	std::string format;
-	std::string source;
-	std::string transparentColor;
+	TmxString format;
+	TmxString source;
+	TmxString transparentColor;
 	unsigned int width;
 	unsigned int height;
 } TmxImage;
@@ -187,7 +263,7 @@ typedef struct
 
 typedef struct
 {
-	std::string name;
+	TmxString name;
 	unsigned int x;
 	unsigned int y;
 	unsigned int widthInTiles;
@@ -199,14 +275,14 @@ typedef struct
 } TmxImageLayer;
 
 
-typedef std::vector<TmxImageLayer> TmxImageLayerCollection_t;
+typedef Vector<TmxImageLayer>::type TmxImageLayerCollection_t;
 
 
 typedef struct
 {
-  std::string source;
+  TmxString source;
 	unsigned int firstgid;
-	std::string name;
+	TmxString name;
 	unsigned int tileWidth;
 	unsigned int tileHeight;
 	unsigned int tileSpacingInImage;
@@ -218,10 +294,11 @@ typedef struct
 
 	TmxImage image;
 	TmxTileDefinitionMap_t tileDefinitions;
+	std::shared_ptr<const TmxTileDefinitionMap_t> sharedTileDefinitions; /// set instead of tileDefinitions for tsx files from the tileset cache with options.shareTileDefinitions, see getTileDefinitions
 } TmxTileset;
 
 
-typedef std::vector<TmxTileset> TmxTilesetCollection_t;
+typedef Vector<TmxTileset>::type TmxTilesetCollection_t;
 
 
 typedef struct
@@ -233,50 +310,194 @@ typedef struct
 } TmxLayerTile;
 
 
-typedef std::vector<TmxLayerTile> TmxLayerTileCollection_t;
+typedef Vector<TmxLayerTile>::type TmxLayerTileCollection_t;
+
+
+/// flip bits tiled stores in the top of a gid
+typedef enum
+{
+	kGidFlipX = 0x80000000,
+	kGidFlipY = 0x40000000,
+	kGidFlipDiagonal = 0x20000000,
+	kGidFlagsMask = 0xE0000000,
+} TmxGidFlags;
+
+
+typedef Vector<unsigned int>::type TmxLayerGidCollection_t;
+
+
+typedef enum
+{
+	kLayerStorageTiles, /// TmxLayer::tiles, one resolved TmxLayerTile per tile
+	kLayerStorageGids, /// TmxLayer::gids only, raw gids with their flip bits, resolved on access
+	kLayerStorageLazy, /// csv and base64 layers keep their encoded data and are decoded on first access, see getLayerTiles.  Layers of <tile> elements are kept as gids.
+} TmxLayerStorage;
+
+
+struct TmxLazyLayerData;
+
+
+/// One block of an infinite map's layer, stored the same way as a whole layer of a finite map
+typedef struct
+{
+	int x; /// in tiles, may be negative
+	int y;
+	unsigned int width;
+	unsigned int height;
+	TmxLayerTileCollection_t tiles;
+	TmxLayerGidCollection_t gids; /// filled instead of tiles with kLayerStorageGids
+	std::shared_ptr<TmxLazyLayerData> lazyData; /// set instead of tiles with kLayerStorageLazy
+} TmxLayerChunk;
+
+
+typedef Vector<TmxLayerChunk>::type TmxLayerChunkCollection_t;
 
 
 typedef struct
 {
-	std::string name;
+	TmxString name;
 	unsigned int width;
 	unsigned int height;
 	float opacity;
 	bool visible;
 	TmxPropertyMap_t propertyMap;
 	TmxLayerTileCollection_t tiles;
+	TmxLayerGidCollection_t gids; /// filled instead of tiles with kLayerStorageGids
+	std::shared_ptr<TmxLazyLayerData> lazyData; /// set instead of tiles with kLayerStorageLazy, shared by copies of the layer
+	unsigned int chunkWidth; /// infinite maps, size of the chunks in tiles, 0 for layers without chunks
+	unsigned int chunkHeight;
+	TmxLayerChunkCollection_t chunks; /// infinite maps, hold the tiles instead of the layer itself.  Sorted by y then x, see getLayerChunk.
 } TmxLayer;
 
 
-typedef std::vector<TmxLayer> TmxLayerCollection_t;
+typedef Vector<TmxLayer>::type TmxLayerCollection_t;
 
 
 typedef struct
 {
-	std::string version;
+	unsigned int firstgid;
+	unsigned int endgid; /// one past the last gid of the tileset
+	unsigned int flatIndexBase; /// subtracted from a gid to get its tileFlatIndex
+	unsigned int tilesetIndex;
+} TmxTilesetRange;
+
+
+typedef Vector<TmxTilesetRange>::type TmxTilesetRangeCollection_t;
+
+
+typedef struct
+{
+	TmxTilesetRangeCollection_t ranges; /// sorted by firstgid, never overlapping
+	Vector<unsigned int>::type rangeByGid; /// gid -> index into ranges + 1, 0 for none. Empty if the gids are too sparse, ranges are binary searched then.
+} TmxTilesetLookup;
+
+
+typedef struct
+{
+	TmxString version;
 	TmxOrientation orientation;
 	unsigned int width;
 	unsigned int height;
 	unsigned int tileWidth;
 	unsigned int tileHeight;
-	std::string backgroundColor;
-	std::string renderOrder;
+	TmxString backgroundColor;
+	TmxString renderOrder;
+	bool infinite; /// the layers are made of chunks, width and height are only the size Tiled shows
 	TmxPropertyMap_t propertyMap;
 	TmxTilesetCollection_t tilesetCollection;
+	TmxTilesetLookup tilesetLookup;
 	TmxLayerCollection_t layerCollection;
 	TmxObjectGroupCollection_t objectGroupCollection;
 	TmxImageLayerCollection_t imageLayerCollection;
 } TmxMap;
 
 
+typedef enum
+{
+	kParseModeDocument,		/// build the whole tinyxml2 document first, then walk it
+	kParseModeStreaming,	/// walk the raw xml and only build a document for one child of <map> at a time
+} TmxParseMode;
+
+
+typedef enum
+{
+	kParsePhaseXml,			/// the xml text, reported once it is read
+	kParsePhaseTilesets,	/// reported once every tileset, external ones included, is loaded
+	kParsePhaseLayers,		/// one step per decoded layer
+	kParsePhaseObjects,		/// one step per object group or image layer
+} TmxParsePhase;
+
+
+/**
+ * Progress of a parse.  total is 0 when it is not known up front, as for layers and objects when streaming.
+ * Called on the parsing thread, or on a layer thread with more than one thread, but never twice at once.
+ */
+typedef std::function<void(TmxParsePhase phase, unsigned int done, unsigned int total)> TmxProgressCallback;
+
+
+/**
+ * Chooses which elements of one kind are parsed, by name.  An element is parsed if the filter is empty, its name is
+ * listed in names, or accept returns true for it.  Skipped elements are left out of the map altogether, so the
+ * collections only hold what passed.
+ */
+typedef struct
+{
+	std::vector<std::string> names;
+	std::function<bool(const std::string& name)> accept;
+} TmxParseFilter;
+
+
+/**
+ * Memory for the parser's own buffers: the decompression streams and the scratch space layer data is decoded
+ * through.  allocate returns memory aligned like malloc, or NULL when out of memory, which fails the parse with
+ * kMemoryBudgetExceeded.  Called from the layer threads too, so it has to be thread safe with more than one thread.
+ * A TmxParser keeps these buffers between parses, so its allocator has to outlive the parser.  kLayerStorageLazy
+ * layers decode through it when first read, so it also has to outlive maps parsed with that storage.
+ */
+class TmxAllocator
+{
+public:
+	virtual ~TmxAllocator() {}
+	virtual void* allocate(size_t size) = 0;
+	virtual void deallocate(void* p) = 0;
+};
+
+
+/**
+ * Streaming keeps peak memory close to the size of the finished map.  Each layer's data text is freed as
+ * soon as it is decoded.  Tilesets have to come before the layers that use them, which is how Tiled saves maps.
+ * With more than one thread, streamed layers are decoded together once the whole map has been scanned.
+ */
+typedef struct
+{
+	TmxLayerStorage layerStorage = kLayerStorageTiles;
+	TmxParseMode parseMode = kParseModeDocument;
+	bool useTilesetCache = true; /// share parsed external tilesets with every other parse in the process, see clearTilesetCache
+	bool shareTileDefinitions = false; /// with the tileset cache, tsx tilesets point at the cached tile definitions through sharedTileDefinitions instead of copying them into tileDefinitions, see getTileDefinitions
+	unsigned int threadCount = 1; /// threads decoding layers side by side, 0 for one per core.  A TmxParser keeps its threads between parses.
+	const std::atomic<bool>* cancel = NULL; /// polled while parsing, the parse stops with kCancelled once it turns true.  The map is left half filled.
+	TmxProgressCallback progress; /// optional, see TmxProgressCallback
+	TmxParseFilter layerFilter; /// layers by name, skipped layers are never decoded
+	TmxParseFilter objectGroupFilter; /// object groups by name
+	TmxParseFilter imageLayerFilter; /// image layers by name
+	TmxParseFilter tileDefinitionFilter; /// tile definitions by their type (class since Tiled 1.9), "" for tiles without one.  Map views do not use it.
+	TmxAllocator* allocator = NULL; /// optional, used instead of malloc for the parser's buffers, see TmxAllocator
+	size_t memoryBudget = 0; /// bytes a parse may allocate for xml, layer tiles and buffers before failing with kMemoryBudgetExceeded, 0 for no limit
+#ifdef TMXPARSER_USE_ARENA
+	TmxArena* arena = NULL; /// the map's strings and collections allocate from it, see TmxArena.  It must outlive the map.  Map views do not use it.
+#endif
+} TmxParseOptions;
+
+
 
 /**
  * Parse a tmx from a filename.
  * @param fileName Relative or Absolute filename to the TMX file to load.
  * @param outMap An allocated TmxMap object ready to be populated.
+ * @param options Optional parse settings.
  * @return kSuccess on success.
  */
-TmxReturn parseFromFile(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath);
+TmxReturn parseFromFile(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options = TmxParseOptions());
 
 
 /**
@@ -284,9 +505,199 @@ TmxReturn parseFromFile(const std::string& fileName, TmxMap* outMap, const std::
  * @param data Tmx file in memory, still in its xml format just already loaded.
  * @param length Size of the data buffer.
  * @param outMap An allocated TmxMap object ready to be populated.
+ * @param options Optional parse settings.
  * @return kSuccess on success.
  */
-TmxReturn parseFromMemory(void* data, size_t length, TmxMap* outMap, const std::string& tilesetPath);
+TmxReturn parseFromMemory(void* data, size_t length, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options = TmxParseOptions());
+
+
+/**
+ * Runs a job on some thread, see parseFromFileAsync.
+ */
+typedef std::function<void(const std::function<void()>& job)> TmxExecutor;
+
+
+/**
+ * Called with the result of an asynchronous parse, on the thread that ran it.
+ */
+typedef std::function<void(TmxReturn result)> TmxParseCallback;
+
+
+/**
+ * Parse a tmx from a filename without blocking the caller.
+ * @param fileName Relative or Absolute filename to the TMX file to load.
+ * @param outMap An allocated TmxMap object, it must stay alive until the parse is done.
+ * @param tilesetPath Path to search for external tilesets, as for parseFromFile.
+ * @param options Optional parse settings.  Cancel it through options.cancel, which must stay alive as well.
+ * @param onComplete Optional, called with the result just before the future becomes ready.  If it throws, the
+ *                   future holds the exception instead of the result.
+ * @param executor Optional, runs the parse.  Without one the parse runs on a thread pool of the library, one
+ *                 thread per core, which keeps parser state between parses.  Parses there that leave
+ *                 options.threadCount at 0 decode their layers on the same pool instead of starting their own.
+ * @return The result of the parse once it is done.
+ */
+std::future<TmxReturn> parseFromFileAsync(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options = TmxParseOptions(), const TmxParseCallback& onComplete = TmxParseCallback(), const TmxExecutor& executor = TmxExecutor());
+
+
+/**
+ * Throughput of a parseBatchFromFiles call.
+ */
+typedef struct
+{
+	unsigned int mapCount = 0;
+	unsigned int failedCount = 0;
+	unsigned long long byteCount = 0; /// size of the tmx files that parsed, not counting external tilesets
+	double seconds = 0.0;
+	double mapsPerSecond = 0.0;
+	double megabytesPerSecond = 0.0;
+} TmxBatchStats;
+
+
+/**
+ * Parse many tmx files at once, such as every map of a world.  Maps run on one work stealing pool with
+ * options.threadCount threads (0 for one per core), large maps are further split into a job per layer,
+ * and external tilesets used by several maps are parsed once when options.useTilesetCache is set.
+ * @param fileNames Relative or Absolute filenames of the TMX files to load.
+ * @param outMaps Filled with one map per file, in the same order.
+ * @param outResults Filled with the result of each file.
+ * @param options Optional parse settings, progress is not reported.
+ * @param outStats Optional, filled with the throughput of the batch.
+ * @return kSuccess if every map parsed, otherwise the error of the first that did not.
+ */
+TmxReturn parseBatchFromFiles(const std::vector<std::string>& fileNames, std::vector<TmxMap>* outMaps, std::vector<TmxReturn>* outResults, const std::string& tilesetPath, const TmxParseOptions& options = TmxParseOptions(), TmxBatchStats* outStats = NULL);
+
+
+struct TmxParseContext;
+
+
+/**
+ * Parser that keeps its xml document, decode buffers and decompression streams between parses, so
+ * loading many maps in a row does not allocate them all over again.  Not thread safe, use one per thread.
+ */
+class TmxParser
+{
+public:
+	TmxParser();
+	~TmxParser();
+
+	/**
+	 * Same as the free parseFromFile, reusing this parser's buffers.
+	 */
+	TmxReturn parseFromFile(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options = TmxParseOptions());
+
+	/**
+	 * Same as the free parseFromMemory, reusing this parser's buffers.
+	 */
+	TmxReturn parseFromMemory(void* data, size_t length, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options = TmxParseOptions());
+
+private:
+	TmxParser(const TmxParser&);
+	TmxParser& operator=(const TmxParser&);
+
+	TmxParseContext* _context;
+};
+
+
+struct TmxMapLoadState;
+
+
+/**
+ * Loads a map a slice at a time, for clients that can only spend a few milliseconds per frame on it.  Each step
+ * carries on where the last one stopped, a large layer or object group is spread over as many steps as it needs.
+ * Only the xml parse of the map document itself cannot be split, it is done by the first step on its own.
+ * Always single threaded, options.threadCount is ignored, and layers are always decoded, kLayerStorageLazy loads as kLayerStorageTiles.
+ */
+class TmxMapLoader
+{
+public:
+	TmxMapLoader();
+	~TmxMapLoader();
+
+	/**
+	 * Opens a tmx file for loading, nothing is parsed until the first step.  Any load in progress is dropped.
+	 * @param outMap An allocated TmxMap object, it must stay alive until the load is done.  It is only complete once
+	 *               a step returned kSuccess.
+	 * @return kSuccess if the file could be opened.
+	 */
+	TmxReturn begin(const std::string& fileName, TmxMap* outMap, const std::string& tilesetPath, const TmxParseOptions& options = TmxParseOptions());
+
+	/**
+	 * Loads until about seconds have passed.  At least one chunk of work is done, and a chunk is at most a few
+	 * thousand tiles or a few dozen objects, so a step overruns its budget by no more than that.
+	 * @return kInProgress while there is more to load, kSuccess once the map is complete, or the error that
+	 *         stopped the load.  Later steps keep returning the same result.
+	 */
+	TmxReturn step(double seconds);
+
+	/**
+	 * Same as step, bounded by work instead of time.  A tile, an object, a tileset or an image layer is one unit of work.
+	 */
+	TmxReturn stepWork(size_t workUnits);
+
+	bool finished() const;
+
+private:
+	TmxMapLoader(const TmxMapLoader&);
+	TmxMapLoader& operator=(const TmxMapLoader&);
+
+	TmxMapLoadState* _state;
+};
+
+
+/**
+ * Drops every external tileset kept by the process wide cache.  Cached tilesets are reparsed anyway once their
+ * file's modification time or size changes, this just frees the memory.
+ */
+void clearTilesetCache();
+
+
+/**
+ * Adds a string to the process wide string table, or finds it there.  Ids stay valid until clearStringTable and
+ * are the same for every map.  Strings a parse adds count against its options.memoryBudget.  Thread safe.
+ * @return The id of string.
+ */
+TmxStringId internString(const char* string);
+
+
+/**
+ * Drops every string in the table, and the tileset cache whose tilesets refer to them.  The table otherwise only
+ * grows, so a long running process that loads many unrelated maps calls this between them.  Every id handed out
+ * before, and every map parsed before, is invalid afterwards, and no parse may run meanwhile.
+ */
+void clearStringTable();
+
+
+/**
+ * Like internString, but never adds to the table.
+ * @return The id of string, or kInvalidStringId if no map or caller has used it yet.
+ */
+TmxStringId findStringId(const char* string);
+
+
+/**
+ * @return The string of an id, valid until clearStringTable, or NULL for an id internString never returned.
+ */
+const char* getInternedString(TmxStringId id);
+
+
+/**
+ * Looks up a property by name with a binary search.  Gameplay code that looks up the same names over and over
+ * interns them once and uses the first form.
+ * @return The property, or NULL if there is none of that name.
+ */
+const TmxProperty* findProperty(const TmxPropertyMap_t& properties, TmxStringId name);
+const TmxProperty* findProperty(const TmxPropertyMap_t& properties, const char* name);
+
+
+/**
+ * Typed reads of a property, without touching its text.  Int and float properties read as either, object ids as
+ * ints.
+ * @return The value, or defaultValue if there is no property of that name or it holds another type.
+ */
+int getIntProperty(const TmxPropertyMap_t& properties, TmxStringId name, int defaultValue = 0);
+float getFloatProperty(const TmxPropertyMap_t& properties, TmxStringId name, float defaultValue = 0.f);
+bool getBoolProperty(const TmxPropertyMap_t& properties, TmxStringId name, bool defaultValue = false);
+unsigned int getColorProperty(const TmxPropertyMap_t& properties, TmxStringId name, unsigned int defaultValue = 0);
 
 
 /**
@@ -300,5 +711,86 @@ TmxReturn parseFromMemory(void* data, size_t length, TmxMap* outMap, const std::
 TmxReturn calculateTileCoordinatesUV(const TmxTileset& tileset,  unsigned int tileFlatIndex, float pixelCorrection, bool flipY, TmxRect& outRect);
 
 
+/**
+ * Builds the gid to tileset lookup for a collection of tilesets.  The parse functions do this for TmxMap::tilesetLookup.
+ * @param tilesets Tilesets, usually TmxMap::tilesetCollection.
+ * @param outLookup Lookup to fill, previous contents are replaced.
+ */
+void buildTilesetLookup(const TmxTilesetCollection_t& tilesets, TmxTilesetLookup* outLookup);
+
+
+/**
+ * Resolves tilesetIndex and tileFlatIndex for a run of tiles from their gids.
+ * Tiles with gid 0 or a gid outside of every tileset get 0 for both.
+ * @param lookup Lookup built by buildTilesetLookup.
+ * @param tiles First tile to resolve.
+ * @param count Number of tiles.
+ * @return kSuccess, or kUnknownTileIndices if any tile could not be resolved.
+ */
+TmxReturn resolveTileIndices(const TmxTilesetLookup& lookup, TmxLayerTile* tiles, size_t count);
+
+
+/**
+ * Turns raw gids, flip bits included, into fully resolved tiles.  Uses AVX2 where the cpu has it.
+ * @param lookup Lookup built by buildTilesetLookup.
+ * @param gids Raw gids as stored in the tmx file or TmxLayer::gids.
+ * @param count Number of gids.
+ * @param outTiles Receives count tiles.
+ * @return kSuccess, or kUnknownTileIndices if any tile could not be resolved.
+ */
+TmxReturn resolveLayerGids(const TmxTilesetLookup& lookup, const unsigned int* gids, size_t count, TmxLayerTile* outTiles);
+
+
+/**
+ * Number of tiles in a layer, whichever storage it was parsed into.  0 for layers of infinite maps, their tiles are in their chunks.
+ */
+unsigned int getLayerTileCount(const TmxLayer& layer);
+unsigned int getLayerTileCount(const TmxLayerChunk& chunk);
+
+
+/**
+ * The tile definitions of a tileset, wherever they are kept.
+ * @param tileset The tileset to read from.
+ * @return The tileset's own tileDefinitions, or the ones it shares with the tileset cache.
+ */
+const TmxTileDefinitionMap_t& getTileDefinitions(const TmxTileset& tileset);
+
+
+/**
+ * The resolved tiles of a layer, decoding a kLayerStorageLazy layer the first time it is asked for.  Any number of
+ * threads may ask at once, the layer is decoded once and the others wait for it.
+ * Chunks of an infinite map are each decoded on their own the first time they are asked for.
+ * @param map The map the layer belongs to.
+ * @param layer The layer to read from.
+ * @return The tiles, or NULL if the layer holds gids or its data failed to decode.
+ */
+const TmxLayerTileCollection_t* getLayerTiles(const TmxMap& map, const TmxLayer& layer);
+const TmxLayerTileCollection_t* getLayerTiles(const TmxMap& map, const TmxLayerChunk& chunk);
+
+
+/**
+ * Reads one tile of a layer, whichever storage it was parsed into.  Tiles of kLayerStorageGids layers are resolved on the fly.
+ * A chunk of an infinite map is read the same way, index is then relative to the chunk.
+ * @param map The map the layer belongs to.
+ * @param layer The layer to read from.
+ * @param index Flat index of the tile, x + y * width.
+ * @param outTile Receives the tile.
+ * @return kSuccess on success, kInvalidTileIndex if index is out of range, kErrorParsing if a lazy layer failed to decode.
+ */
+TmxReturn getLayerTile(const TmxMap& map, const TmxLayer& layer, unsigned int index, TmxLayerTile* outTile);
+TmxReturn getLayerTile(const TmxMap& map, const TmxLayerChunk& chunk, unsigned int index, TmxLayerTile* outTile);
+
+
+/**
+ * Finds a chunk of an infinite map's layer by its chunk coordinate, which is its tile coordinate divided by
+ * the layer's chunkWidth and chunkHeight, rounded down.  Chunks Tiled left out because they were empty are not found.
+ * @param layer The layer to search.
+ * @param chunkX Column of the chunk, may be negative.
+ * @param chunkY Row of the chunk, may be negative.
+ * @return The chunk, or NULL if the layer has no chunk there.
+ */
+const TmxLayerChunk* getLayerChunk(const TmxLayer& layer, int chunkX, int chunkY);
+
+
 }
 #endif /* _LIB_TMX_PARSER_H_ */
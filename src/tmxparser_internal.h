@@ -0,0 +1,153 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef _LIB_TMX_PARSER_INTERNAL_H_
+#define _LIB_TMX_PARSER_INTERNAL_H_
+
+
+/*
+ * Parser internals shared between the translation units of the library.  Not part of the public api.
+ */
+
+
+#include "tmxparser.h"
+
+#include "compression.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+
+namespace tmxparser
+{
+
+
+// Where the gids of a layer end up while its data node is decoded
+typedef struct
+{
+	TmxLayerStorage storage;
+	const TmxTilesetLookup* lookup;
+	TmxLayerTileCollection_t* tiles;
+	TmxLayerGidCollection_t* gids;
+	size_t count;
+	size_t index;
+	bool unknownGids;
+	const std::atomic<bool>* cancel; // checked between batches
+} TmxLayerGidSink;
+
+
+// Gids are handed to _storeLayerGids in batches of this size
+#define LAYER_GID_BATCH_SIZE 1024
+
+
+// Makes options.arena current for the allocations of a parse, on whichever thread runs that part of it
+#ifdef TMXPARSER_USE_ARENA
+#define TMX_ARENA_SCOPE(ARENA) TmxArenaScope arenaScope(ARENA)
+#else
+#define TMX_ARENA_SCOPE(ARENA)
+#endif
+
+
+// Bytes charged by one parse against options.memoryBudget, shared by the layer threads
+struct TmxMemoryBudget
+{
+	size_t limit;					// 0 for no limit
+	std::atomic<size_t> used;
+	std::atomic<bool> exceeded;		// also set when the allocator ran out
+
+	TmxMemoryBudget() : limit(0), used(0), exceeded(false) {}
+};
+
+
+// Buffer from the parse's allocator, grown but never shrunk
+typedef struct
+{
+	unsigned char* data;
+	size_t size;
+} TmxScratchBuffer;
+
+
+void* _allocateParseMemory(void* opaque, size_t size);
+void _freeParseMemory(void* opaque, void* address);
+
+
+// Everything a parse needs besides the map itself, kept by TmxParser between parses
+struct TmxParseContext
+{
+	tinyxml2::XMLDocument document;			// the map, or one child of <map> at a time when streaming
+	tinyxml2::XMLDocument tilesetDocument;	// external tilesets
+	Decompressor decompressor;
+	TmxScratchBuffer gidChunk;
+	TmxScratchBuffer encodedChunk;
+	std::string mapTag;
+
+	TmxAllocator* allocator;		// options.allocator of the last parse, NULL for malloc
+	bool decompressorHooked;		// the decompressor allocates through the context, see _useParseAllocator
+	TmxMemoryBudget ownBudget;
+	TmxMemoryBudget* budget;		// ownBudget, or the budget of the parse a pool worker helps with
+
+	ThreadPool* layerPool;							// created by the first parse that asks for threads
+	ThreadPool* sharedPool;							// not owned, used instead of layerPool when set
+	std::vector<TmxParseContext*> workerContexts;	// scratch state of each pool worker
+
+	TmxParseContext() : allocator(NULL), decompressorHooked(false), budget(&ownBudget), layerPool(NULL), sharedPool(NULL)
+	{
+		gidChunk.data = NULL;
+		gidChunk.size = 0;
+		encodedChunk.data = NULL;
+		encodedChunk.size = 0;
+	}
+	~TmxParseContext()
+	{
+		delete layerPool;
+		for (size_t i = 0; i < workerContexts.size(); i++)
+			delete workerContexts[i];
+		_freeParseMemory(this, gidChunk.data);
+		_freeParseMemory(this, encodedChunk.data);
+	}
+};
+
+
+std::string _updatePath(std::string path, const std::string& tilesetPath);
+std::string _canonicalPath(const std::string& fileName);
+long long _modifiedTime(const struct stat& fileInfo);
+void _buildTilesetLookupFromRanges(TmxTilesetRangeCollection_t& ranges, TmxTilesetLookup* outLookup);
+TmxReturn _parseLayerCsvData(const char* text, TmxLayerGidSink* sink);
+TmxReturn _parseLayerBase64Data(const char* text, size_t textLength, const char* compression, TmxParseContext* context, TmxLayerGidSink* sink);
+TmxReturn _beginParseMemory(TmxParseContext* context, const TmxParseOptions& options, size_t xmlLength);
+bool _chargeParseMemory(TmxParseContext* context, size_t bytes);
+TmxReturn _parseMemoryError(TmxParseContext* context);
+TmxReturn _beginLayerGids(TmxLayerTileCollection_t* tiles, TmxLayerGidCollection_t* gids, size_t count, TmxLayerStorage storage, const TmxTilesetLookup& lookup, TmxParseContext* context, TmxLayerGidSink* outSink);
+TmxReturn _storeLayerGids(TmxLayerGidSink* sink, const unsigned int* gids, size_t gidCount);
+bool _isFilterEmpty(const TmxParseFilter& filter);
+bool _filterAccepts(const TmxParseFilter& filter, const std::string& name);
+
+
+}
+#endif /* _LIB_TMX_PARSER_INTERNAL_H_ */
@@ -0,0 +1,1208 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "tmxview.h"
+#include "tmxparser_internal.h"
+#include "mappedfile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+#ifndef LOG_TAG
+#define LOG_TAG "libtmxparser"
+#endif
+
+#define QUOTEME_(x) #x
+#define QUOTEME(x) QUOTEME_(x)
+#define LOGE(...) fprintf(stderr, "E/" QUOTEME(LOG_TAG) "(" ")" __VA_ARGS__ ); fprintf(stderr, "\n");
+#define LOGW(...) fprintf(stderr, "W/" QUOTEME(LOG_TAG) "(" ")" __VA_ARGS__ ); fprintf(stderr, "\n");
+
+
+namespace tmxparser
+{
+
+
+static const TmxStringView kEmptyView = { "", 0 };
+
+
+typedef struct
+{
+	const char* name;
+	size_t nameLength;
+	TmxStringView value;
+} TmxInSituAttribute;
+
+
+// Pull parser over a writable xml buffer, one element at a time.  The children of the current element are
+// walked with firstChild() and nextSibling(), or dropped with skipChildren(), before moving on to its
+// siblings.  Both return false once the parent's end tag is consumed, or on malformed xml, see failed().
+class TmxInSituReader
+{
+public:
+	TmxInSituReader(char* begin, size_t length)
+		: _begin(begin), _p(begin), _end(begin + length), _hasChildren(false), _failed(false), _textEnd(NULL)
+	{
+		_name = kEmptyView;
+	}
+
+	bool firstChild() { return _hasChildren && _nextElement(); }
+	bool nextSibling() { return _nextElement(); }
+	void skipChildren();
+	TmxStringView text();
+
+	bool isElement(const char* name) const { return _name == name; }
+	TmxStringView name() const { return _name; }
+	bool hasChildren() const { return _hasChildren; }
+	bool failed() const { return _failed; }
+
+	/// attributes of the current element
+	const TmxStringView* attribute(const char* name) const;
+
+private:
+	bool _nextElement();
+	bool _skipPast(const char* terminator);
+	bool _parseStartTag();
+
+	char* _begin;
+	char* _p;
+	char* _end;
+	TmxStringView _name;
+	std::vector<TmxInSituAttribute> _attributes;
+	bool _hasChildren;
+	bool _failed;
+	char* _textEnd; // '<' that text() overwrote with a NUL, put back by the next read
+};
+
+
+static inline bool _isXmlSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+
+static char* _encodeUtf8(unsigned long codePoint, char* out)
+{
+	if (codePoint < 0x80)
+	{
+		*out++ = (char)codePoint;
+	}
+	else if (codePoint < 0x800)
+	{
+		*out++ = (char)(0xC0 | (codePoint >> 6));
+		*out++ = (char)(0x80 | (codePoint & 0x3F));
+	}
+	else if (codePoint < 0x10000)
+	{
+		*out++ = (char)(0xE0 | (codePoint >> 12));
+		*out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (codePoint & 0x3F));
+	}
+	else
+	{
+		*out++ = (char)(0xF0 | (codePoint >> 18));
+		*out++ = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+		*out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (codePoint & 0x3F));
+	}
+	return out;
+}
+
+
+// Value of a digit of a character reference, -1 for anything else
+static int _digitValue(char c, bool hex)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (hex && c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (hex && c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+
+// Decodes entity references in place, every entity is at least as long as what it stands for.
+// Returns the new end of the text.
+static char* _decodeEntities(char* begin, char* end)
+{
+	char* in = (char*)memchr(begin, '&', end - begin);
+	if (in == NULL)
+	{
+		return end;
+	}
+
+	static const struct { const char* entity; size_t length; char value; } kEntities[] =
+	{
+		{ "&amp;", 5, '&' }, { "&lt;", 4, '<' }, { "&gt;", 4, '>' }, { "&quot;", 6, '"' }, { "&apos;", 6, '\'' },
+	};
+
+	char* out = in;
+	while (in < end)
+	{
+		if (*in != '&')
+		{
+			*out++ = *in++;
+			continue;
+		}
+
+		bool decoded = false;
+		if (in + 2 < end && in[1] == '#')
+		{
+			// scanned by hand, the text is not NUL terminated and may end in the middle of the reference
+			bool hex = (in[2] == 'x');
+			char* digits = in + (hex ? 3 : 2);
+			char* digitsEnd = digits;
+			unsigned long codePoint = 0;
+			for (; digitsEnd < end; digitsEnd++)
+			{
+				int digit = _digitValue(*digitsEnd, hex);
+				if (digit < 0)
+				{
+					break;
+				}
+				if (codePoint <= 0x10FFFF)
+				{
+					codePoint = codePoint * (hex ? 16 : 10) + digit;
+				}
+			}
+
+			if (digitsEnd > digits && digitsEnd < end && *digitsEnd == ';' && codePoint != 0 && codePoint <= 0x10FFFF)
+			{
+				out = _encodeUtf8(codePoint, out);
+				in = digitsEnd + 1;
+				decoded = true;
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < sizeof(kEntities) / sizeof(kEntities[0]); i++)
+			{
+				if ((size_t)(end - in) >= kEntities[i].length && memcmp(in, kEntities[i].entity, kEntities[i].length) == 0)
+				{
+					*out++ = kEntities[i].value;
+					in += kEntities[i].length;
+					decoded = true;
+					break;
+				}
+			}
+		}
+
+		if (!decoded)
+		{
+			*out++ = *in++;
+		}
+	}
+
+	return out;
+}
+
+
+bool TmxInSituReader::_skipPast(const char* terminator)
+{
+	size_t length = strlen(terminator);
+	for (char* p = _p; p + length <= _end; p++)
+	{
+		if (memcmp(p, terminator, length) == 0)
+		{
+			_p = p + length;
+			return true;
+		}
+	}
+
+	_failed = true;
+	return false;
+}
+
+
+bool TmxInSituReader::_nextElement()
+{
+	if (_textEnd != NULL)
+	{
+		*_textEnd = '<';
+		_textEnd = NULL;
+	}
+
+	for (;;)
+	{
+		_p = (char*)memchr(_p, '<', _end - _p);
+		if (_p == NULL || _p + 1 >= _end)
+		{
+			_p = _end;
+			_failed = true;
+			return false;
+		}
+
+		size_t left = _end - _p;
+		if (_p[1] == '/')
+		{
+			_hasChildren = false;
+			_skipPast(">");
+			return false;
+		}
+		else if (left >= 4 && memcmp(_p, "<!--", 4) == 0)
+		{
+			if (!_skipPast("-->"))
+				return false;
+		}
+		else if (left >= 9 && memcmp(_p, "<![CDATA[", 9) == 0)
+		{
+			if (!_skipPast("]]>"))
+				return false;
+		}
+		else if (_p[1] == '?')
+		{
+			if (!_skipPast("?>"))
+				return false;
+		}
+		else if (_p[1] == '!')
+		{
+			if (!_skipPast(">"))
+				return false;
+		}
+		else
+		{
+			return _parseStartTag();
+		}
+	}
+}
+
+
+bool TmxInSituReader::_parseStartTag()
+{
+	_attributes.clear();
+
+	char* p = _p + 1;
+	char* nameStart = p;
+	while (p < _end && !_isXmlSpace(*p) && *p != '/' && *p != '>')
+		p++;
+	_name.data = nameStart;
+	_name.length = p - nameStart;
+
+	for (;;)
+	{
+		while (p < _end && _isXmlSpace(*p))
+			p++;
+
+		if (p >= _end)
+		{
+			break;
+		}
+		else if (*p == '>')
+		{
+			_hasChildren = true;
+			_p = p + 1;
+			return true;
+		}
+		else if (*p == '/')
+		{
+			if (p + 1 >= _end || p[1] != '>')
+				break;
+			_hasChildren = false;
+			_p = p + 2;
+			return true;
+		}
+
+		TmxInSituAttribute attribute;
+		attribute.name = p;
+		while (p < _end && !_isXmlSpace(*p) && *p != '=' && *p != '>' && *p != '/')
+			p++;
+		attribute.nameLength = p - attribute.name;
+
+		while (p < _end && _isXmlSpace(*p))
+			p++;
+		if (p >= _end || *p != '=')
+			break;
+		p++;
+		while (p < _end && _isXmlSpace(*p))
+			p++;
+		if (p >= _end || (*p != '"' && *p != '\''))
+			break;
+
+		char* valueStart = p + 1;
+		char* valueEnd = (char*)memchr(valueStart, *p, _end - valueStart);
+		if (valueEnd == NULL)
+			break;
+
+		// the closing quote, or the room entities freed, takes the NUL
+		char* decodedEnd = _decodeEntities(valueStart, valueEnd);
+		*decodedEnd = '\0';
+		attribute.value.data = valueStart;
+		attribute.value.length = decodedEnd - valueStart;
+		_attributes.push_back(attribute);
+
+		p = valueEnd + 1;
+	}
+
+	LOGE("Malformed xml tag at offset %u", (unsigned int)(_p - _begin));
+	_failed = true;
+	_p = _end;
+	return false;
+}
+
+
+void TmxInSituReader::skipChildren()
+{
+	for (bool child = firstChild(); child; child = nextSibling())
+	{
+		skipChildren();
+	}
+}
+
+
+TmxStringView TmxInSituReader::text()
+{
+	char* start = _p;
+	char* lt = (char*)memchr(_p, '<', _end - _p);
+	if (lt == NULL)
+	{
+		lt = _end;
+		_failed = true;
+	}
+
+	char* decodedEnd = _decodeEntities(start, lt);
+	_p = lt;
+	if (decodedEnd == lt && lt < _end)
+	{
+		_textEnd = lt;
+	}
+	if (decodedEnd < _end)
+	{
+		*decodedEnd = '\0';
+	}
+
+	TmxStringView view = { start, (size_t)(decodedEnd - start) };
+	return view;
+}
+
+
+const TmxStringView* TmxInSituReader::attribute(const char* name) const
+{
+	size_t nameLength = strlen(name);
+	for (size_t i = 0; i < _attributes.size(); i++)
+	{
+		if (_attributes[i].nameLength == nameLength && memcmp(_attributes[i].name, name, nameLength) == 0)
+		{
+			return &_attributes[i].value;
+		}
+	}
+	return NULL;
+}
+
+
+static TmxStringView _stringValue(const TmxStringView* value)
+{
+	return (value != NULL) ? *value : kEmptyView;
+}
+
+
+static unsigned int _unsignedValue(const TmxStringView* value, unsigned int defaultValue)
+{
+	return (value != NULL) ? (unsigned int)strtoul(value->data, NULL, 10) : defaultValue;
+}
+
+
+static int _intValue(const TmxStringView* value, int defaultValue)
+{
+	return (value != NULL) ? (int)strtol(value->data, NULL, 10) : defaultValue;
+}
+
+
+static float _floatValue(const TmxStringView* value, float defaultValue)
+{
+	return (value != NULL) ? (float)strtod(value->data, NULL) : defaultValue;
+}
+
+
+static bool _boolValue(const TmxStringView* value, bool defaultValue)
+{
+	if (value == NULL)
+	{
+		return defaultValue;
+	}
+
+	// same as tinyxml2, a number or true/false
+	if ((value->data[0] >= '0' && value->data[0] <= '9') || value->data[0] == '-')
+	{
+		return strtol(value->data, NULL, 10) != 0;
+	}
+	return *value == "true";
+}
+
+
+static TmxReturn _requireUnsigned(const TmxInSituReader& reader, const char* name, unsigned int* out)
+{
+	const TmxStringView* value = reader.attribute(name);
+	if (value == NULL)
+	{
+		LOGE("Missing required attribute [%s]", name);
+		return kMissingRequiredAttribute;
+	}
+
+	*out = _unsignedValue(value, 0);
+	return kSuccess;
+}
+
+
+// Prototypes
+TmxReturn _viewParseMapNode(TmxInSituReader& reader, TmxMapView* outView, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context);
+void _viewBuildTilesetLookup(TmxMapView* outView);
+TmxReturn _viewParsePropertyNode(TmxInSituReader& reader, TmxPropertyViewCollection_t* outProperties);
+TmxReturn _viewParseImageNode(TmxInSituReader& reader, TmxImageView* outImage);
+TmxReturn _viewParseTilesetNode(TmxInSituReader& reader, TmxTilesetView* outTileset, const std::string& tilesetPath, TmxMapView* outView);
+TmxReturn _viewParseTileset(TmxInSituReader& reader, TmxTilesetView* outTileset);
+TmxReturn _viewParseTileDefinitionNode(TmxInSituReader& reader, TmxTileDefinitionView* outTileDefinition);
+TmxReturn _viewParseTileAnimationNode(TmxInSituReader& reader, TmxAnimationFrameCollection_t* outAnimationCollection);
+TmxReturn _viewParseLayerNode(TmxInSituReader& reader, const TmxTilesetLookup& lookup, const TmxParseOptions& options, TmxParseContext* context, TmxLayerView* outLayer);
+TmxReturn _viewParseLayerDataNode(TmxInSituReader& reader, TmxParseContext* context, TmxLayerGidSink* sink);
+TmxReturn _viewParseObjectGroupNode(TmxInSituReader& reader, TmxObjectGroupView* outObjectGroup);
+TmxReturn _viewParseObjectNode(TmxInSituReader& reader, TmxObjectView* outObj);
+TmxReturn _viewParseShapePoints(const TmxStringView* points, TmxShapePointCollection_t* outPoints);
+TmxReturn _viewParseImageLayerNode(TmxInSituReader& reader, TmxImageLayerView* outImageLayer);
+
+
+TmxReturn parseViewFromMemory(char* data, size_t length, TmxMapView* outView, const std::string& tilesetPath, const TmxParseOptions& options)
+{
+	TmxInSituReader reader(data, length);
+	bool found = false;
+	while (!found && reader.nextSibling())
+	{
+		found = reader.isElement("map");
+		if (!found)
+			reader.skipChildren();
+	}
+
+	if (!found)
+	{
+		LOGE("Missing map node...");
+		return TmxReturn::kMissingMapNode;
+	}
+
+	// parsed in place, so the xml itself costs nothing
+	TmxParseContext context;
+	TmxReturn error = _beginParseMemory(&context, options, 0);
+	if (error)
+	{
+		return error;
+	}
+	return _viewParseMapNode(reader, outView, tilesetPath, options, &context);
+}
+
+
+const TmxStringView* findProperty(const TmxPropertyViewCollection_t& properties, const char* name)
+{
+	for (size_t i = properties.size(); i > 0; i--)
+	{
+		if (properties[i - 1].name == name)
+		{
+			return &properties[i - 1].value;
+		}
+	}
+	return NULL;
+}
+
+
+// Whether the current child of <map> passes the filter for its kind, the others always do
+static bool _viewFilterAccepts(TmxInSituReader& reader, const TmxParseOptions& options)
+{
+	const TmxParseFilter* filter = NULL;
+	if (reader.isElement("layer"))
+		filter = &options.layerFilter;
+	else if (reader.isElement("objectgroup"))
+		filter = &options.objectGroupFilter;
+	else if (reader.isElement("imagelayer"))
+		filter = &options.imageLayerFilter;
+
+	if (filter == NULL || _isFilterEmpty(*filter))
+	{
+		return true;
+	}
+
+	return _filterAccepts(*filter, toString(_stringValue(reader.attribute("name"))));
+}
+
+
+TmxReturn _viewParseMapNode(TmxInSituReader& reader, TmxMapView* outView, const std::string& tilesetPath, const TmxParseOptions& options, TmxParseContext* context)
+{
+	outView->version = _stringValue(reader.attribute("version"));
+	outView->orientation = kOrthogonal;
+	const TmxStringView* orientation = reader.attribute("orientation");
+	if (orientation != NULL)
+	{
+		if (*orientation == "isometric")
+			outView->orientation = kIsometric;
+		else if (*orientation == "staggered")
+			outView->orientation = kStaggered;
+	}
+	else
+	{
+		LOGW("Missing orientation attribute");
+	}
+
+	TmxReturn error = TmxReturn::kSuccess;
+	if ((error = _requireUnsigned(reader, "width", &outView->width)) != kSuccess ||
+		(error = _requireUnsigned(reader, "height", &outView->height)) != kSuccess ||
+		(error = _requireUnsigned(reader, "tilewidth", &outView->tileWidth)) != kSuccess ||
+		(error = _requireUnsigned(reader, "tileheight", &outView->tileHeight)) != kSuccess)
+	{
+		return error;
+	}
+
+	outView->backgroundColor = _stringValue(reader.attribute("backgroundcolor"));
+	outView->renderOrder = _stringValue(reader.attribute("renderorder"));
+
+	const TmxStringView* infinite = reader.attribute("infinite");
+	if (infinite != NULL && *infinite == "1")
+	{
+		LOGE("Infinite maps are not supported by map views...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	// layers are decoded as they are read, so they need the lookup of every tileset before them
+	bool layersStarted = false;
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (!_viewFilterAccepts(reader, options))
+		{
+			reader.skipChildren();
+		}
+		else if (reader.isElement("properties"))
+		{
+			error = _viewParsePropertyNode(reader, &outView->properties);
+		}
+		else if (reader.isElement("tileset"))
+		{
+			if (layersStarted)
+			{
+				LOGE("Tileset after the first layer, not supported by map views...");
+				return TmxReturn::kErrorParsing;
+			}
+
+			outView->tilesets.push_back(TmxTilesetView());
+			error = _viewParseTilesetNode(reader, &outView->tilesets.back(), tilesetPath, outView);
+		}
+		else if (reader.isElement("layer"))
+		{
+			if (!layersStarted)
+			{
+				_viewBuildTilesetLookup(outView);
+				layersStarted = true;
+			}
+
+			outView->layers.push_back(TmxLayerView());
+			error = _viewParseLayerNode(reader, outView->tilesetLookup, options, context, &outView->layers.back());
+		}
+		else if (reader.isElement("objectgroup"))
+		{
+			outView->objectGroups.push_back(TmxObjectGroupView());
+			error = _viewParseObjectGroupNode(reader, &outView->objectGroups.back());
+		}
+		else if (reader.isElement("imagelayer"))
+		{
+			outView->imageLayers.push_back(TmxImageLayerView());
+			error = _viewParseImageLayerNode(reader, &outView->imageLayers.back());
+		}
+		else
+		{
+			reader.skipChildren();
+		}
+
+		if (error)
+		{
+			LOGE("Error processing %.*s node...", (int)reader.name().length, reader.name().data);
+			return error;
+		}
+	}
+
+	if (reader.failed())
+	{
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (!layersStarted)
+	{
+		_viewBuildTilesetLookup(outView);
+	}
+
+	return TmxReturn::kSuccess;
+}
+
+
+void _viewBuildTilesetLookup(TmxMapView* outView)
+{
+	TmxTilesetRangeCollection_t ranges;
+	ranges.reserve(outView->tilesets.size());
+
+	// same ranges buildTilesetLookup makes for a TmxMap
+	unsigned int lastEndIndex = 1;
+	for (unsigned int index = 0; index < outView->tilesets.size(); index++)
+	{
+		const TmxTilesetView& tileset = outView->tilesets[index];
+
+		TmxTilesetRange range;
+		range.firstgid = tileset.firstgid;
+		range.endgid = tileset.firstgid + (tileset.colCount * tileset.rowCount);
+		range.flatIndexBase = lastEndIndex;
+		range.tilesetIndex = index;
+
+		if (range.endgid > range.firstgid)
+		{
+			ranges.push_back(range);
+		}
+
+		lastEndIndex = range.endgid;
+	}
+
+	_buildTilesetLookupFromRanges(ranges, &outView->tilesetLookup);
+}
+
+
+TmxReturn _viewParsePropertyNode(TmxInSituReader& reader, TmxPropertyViewCollection_t* outProperties)
+{
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (reader.isElement("property"))
+		{
+			const TmxStringView* name = reader.attribute("name");
+			const TmxStringView* value = reader.attribute("value");
+			if (name == NULL || value == NULL)
+			{
+				return TmxReturn::kMalformedPropertyNode;
+			}
+
+			TmxPropertyView property = { *name, *value };
+			outProperties->push_back(property);
+		}
+
+		reader.skipChildren();
+	}
+
+	return reader.failed() ? TmxReturn::kErrorParsing : TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseImageNode(TmxInSituReader& reader, TmxImageView* outImage)
+{
+	outImage->source = _stringValue(reader.attribute("source"));
+	if (outImage->source.length == 0)
+	{
+		LOGE("Missing required attribute [%s]", "source");
+		return TmxReturn::kMissingRequiredAttribute;
+	}
+
+	outImage->format = _stringValue(reader.attribute("format"));
+	outImage->transparentColor = _stringValue(reader.attribute("trans"));
+	outImage->width = _unsignedValue(reader.attribute("width"), 0);
+	outImage->height = _unsignedValue(reader.attribute("height"), 0);
+
+	reader.skipChildren();
+	return reader.failed() ? TmxReturn::kErrorParsing : TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseTilesetNode(TmxInSituReader& reader, TmxTilesetView* outTileset, const std::string& tilesetPath, TmxMapView* outView)
+{
+	TmxReturn error = _requireUnsigned(reader, "firstgid", &outTileset->firstgid);
+	if (error)
+	{
+		return error;
+	}
+
+	const TmxStringView* source = reader.attribute("source");
+	if (source == NULL)
+	{
+		outTileset->source = kEmptyView;
+		return _viewParseTileset(reader, outTileset);
+	}
+
+	// External tileset file, the view keeps its text
+	outTileset->source = *source;
+	reader.skipChildren();
+	if (reader.failed())
+	{
+		return TmxReturn::kErrorParsing;
+	}
+
+	MappedFile tileFile;
+	if (!tileFile.open(_updatePath(toString(outTileset->source), tilesetPath)))
+	{
+		LOGE("Cannot read tileset xml file");
+		return TmxReturn::kErrorParsing;
+	}
+
+	// the file is followed by the tileset name, the source without its extension
+	size_t nameLength = std::string(outTileset->source.data, outTileset->source.length).rfind('.');
+	if (nameLength == std::string::npos)
+	{
+		nameLength = outTileset->source.length;
+	}
+
+	std::shared_ptr<std::vector<char> > buffer = std::make_shared<std::vector<char> >(tileFile.size() + 1 + nameLength + 1, '\0');
+	memcpy(buffer->data(), tileFile.data(), tileFile.size());
+	memcpy(buffer->data() + tileFile.size() + 1, outTileset->source.data, nameLength);
+	tileFile.close();
+	outView->tilesetBuffers.push_back(buffer);
+
+	TmxInSituReader tileReader(buffer->data(), buffer->size() - nameLength - 2);
+	bool found = false;
+	while (!found && tileReader.nextSibling())
+	{
+		found = tileReader.isElement("tileset");
+		if (!found)
+			tileReader.skipChildren();
+	}
+
+	if (!found)
+	{
+		return TmxReturn::kMissingTilesetNode;
+	}
+
+	error = _viewParseTileset(tileReader, outTileset);
+
+	TmxStringView name = { buffer->data() + buffer->size() - nameLength - 1, nameLength };
+	outTileset->name = name;
+	return error;
+}
+
+
+TmxReturn _viewParseTileset(TmxInSituReader& reader, TmxTilesetView* outTileset)
+{
+	outTileset->name = _stringValue(reader.attribute("name"));
+
+	TmxReturn error = TmxReturn::kSuccess;
+	if ((error = _requireUnsigned(reader, "tilewidth", &outTileset->tileWidth)) != kSuccess ||
+		(error = _requireUnsigned(reader, "tileheight", &outTileset->tileHeight)) != kSuccess)
+	{
+		return error;
+	}
+
+	outTileset->tileSpacingInImage = _unsignedValue(reader.attribute("spacing"), 0);
+	outTileset->tileMarginInImage = _unsignedValue(reader.attribute("margin"), 0);
+	outTileset->offset.x = 0;
+	outTileset->offset.y = 0;
+
+	bool hasImage = false;
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (reader.isElement("image") && !hasImage)
+		{
+			hasImage = true;
+			error = _viewParseImageNode(reader, &outTileset->image);
+		}
+		else if (reader.isElement("tileoffset"))
+		{
+			outTileset->offset.x = _intValue(reader.attribute("x"), 0);
+			outTileset->offset.y = _intValue(reader.attribute("y"), 0);
+			reader.skipChildren();
+		}
+		else if (reader.isElement("tile"))
+		{
+			outTileset->tileDefinitions.push_back(TmxTileDefinitionView());
+			error = _viewParseTileDefinitionNode(reader, &outTileset->tileDefinitions.back());
+		}
+		else
+		{
+			reader.skipChildren();
+		}
+
+		if (error)
+		{
+			LOGE("Error parsing tileset %.*s node...", (int)reader.name().length, reader.name().data);
+			return error;
+		}
+	}
+
+	if (reader.failed())
+	{
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (!hasImage)
+	{
+		LOGE("We do not support maps with tilesets that have no image associated currently...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	outTileset->colCount = (outTileset->image.width - outTileset->tileMarginInImage) / (outTileset->tileWidth + outTileset->tileSpacingInImage);
+	outTileset->rowCount = (outTileset->image.height - outTileset->tileMarginInImage) / (outTileset->tileHeight + outTileset->tileSpacingInImage);
+
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseTileDefinitionNode(TmxInSituReader& reader, TmxTileDefinitionView* outTileDefinition)
+{
+	outTileDefinition->id = _unsignedValue(reader.attribute("id"), 0);
+
+	TmxReturn error = TmxReturn::kSuccess;
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (reader.isElement("properties"))
+		{
+			error = _viewParsePropertyNode(reader, &outTileDefinition->properties);
+		}
+		else if (reader.isElement("animation"))
+		{
+			error = _viewParseTileAnimationNode(reader, &outTileDefinition->animations);
+		}
+		else if (reader.isElement("objectgroup"))
+		{
+			outTileDefinition->objectgroups.push_back(TmxObjectGroupView());
+			error = _viewParseObjectGroupNode(reader, &outTileDefinition->objectgroups.back());
+		}
+		else
+		{
+			reader.skipChildren();
+		}
+
+		if (error)
+		{
+			return error;
+		}
+	}
+
+	return reader.failed() ? TmxReturn::kErrorParsing : TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseTileAnimationNode(TmxInSituReader& reader, TmxAnimationFrameCollection_t* outAnimationCollection)
+{
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (reader.isElement("frame"))
+		{
+			TmxAnimationFrame frame;
+			frame.duration = _floatValue(reader.attribute("duration"), 0.f);
+			frame.tileId = _unsignedValue(reader.attribute("tileid"), 0);
+
+			outAnimationCollection->push_back(frame);
+		}
+
+		reader.skipChildren();
+	}
+
+	return reader.failed() ? TmxReturn::kErrorParsing : TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseLayerNode(TmxInSituReader& reader, const TmxTilesetLookup& lookup, const TmxParseOptions& options, TmxParseContext* context, TmxLayerView* outLayer)
+{
+	outLayer->name = _stringValue(reader.attribute("name"));
+	outLayer->opacity = _floatValue(reader.attribute("opacity"), 1.f);
+	outLayer->visible = (_intValue(reader.attribute("visible"), 1) == 1);
+	outLayer->width = _unsignedValue(reader.attribute("width"), 0);
+	outLayer->height = _unsignedValue(reader.attribute("height"), 0);
+
+	TmxReturn error = TmxReturn::kSuccess;
+	bool hasData = false;
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (reader.isElement("properties"))
+		{
+			error = _viewParsePropertyNode(reader, &outLayer->properties);
+		}
+		else if (reader.isElement("data") && !hasData)
+		{
+			hasData = true;
+
+			TmxLayerGidSink sink;
+			error = _beginLayerGids(&outLayer->tiles, &outLayer->gids, (size_t)outLayer->width * outLayer->height, options.layerStorage, lookup, context, &sink);
+			if (!error)
+			{
+				error = _viewParseLayerDataNode(reader, context, &sink);
+			}
+			if (!error && sink.unknownGids)
+			{
+				LOGW("Layer references gids outside of every tileset...");
+			}
+		}
+		else
+		{
+			reader.skipChildren();
+		}
+
+		if (error)
+		{
+			return error;
+		}
+	}
+
+	if (reader.failed())
+	{
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (!hasData)
+	{
+		LOGE("Layer missing data node...");
+		return TmxReturn::kMissingDataNode;
+	}
+
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseLayerDataNode(TmxInSituReader& reader, TmxParseContext* context, TmxLayerGidSink* sink)
+{
+	TmxReturn error = TmxReturn::kSuccess;
+
+	const TmxStringView* encoding = reader.attribute("encoding");
+	const TmxStringView* compression = reader.attribute("compression");
+
+	if (encoding == NULL)
+	{
+		unsigned int gids[LAYER_GID_BATCH_SIZE];
+		size_t gidCount = 0;
+		for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+		{
+			if (reader.isElement("tile"))
+			{
+				gids[gidCount++] = _unsignedValue(reader.attribute("gid"), 0);
+				if (gidCount == LAYER_GID_BATCH_SIZE)
+				{
+					error = _storeLayerGids(sink, gids, gidCount);
+					if (error)
+					{
+						return error;
+					}
+					gidCount = 0;
+				}
+			}
+
+			reader.skipChildren();
+		}
+
+		if (reader.failed())
+		{
+			return TmxReturn::kErrorParsing;
+		}
+
+		return _storeLayerGids(sink, gids, gidCount);
+	}
+
+	if (*encoding != "csv" && *encoding != "base64")
+	{
+		LOGE("Unsupported encoding: %s", encoding->data);
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (!reader.hasChildren())
+	{
+		LOGE("Layer data node is empty...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	// the text is only NUL terminated until the reader moves on, and not at all when it ran into the end of the buffer
+	TmxStringView text = reader.text();
+	if (reader.failed())
+	{
+		LOGE("Layer data node is not closed...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	if (*encoding == "csv")
+	{
+		error = _parseLayerCsvData(text.data, sink);
+	}
+	else
+	{
+		error = _parseLayerBase64Data(text.data, text.length, compression ? compression->data : NULL, context, sink);
+	}
+
+	reader.skipChildren();
+	if (!error && reader.failed())
+	{
+		error = TmxReturn::kErrorParsing;
+	}
+
+	return error;
+}
+
+
+TmxReturn _viewParseObjectGroupNode(TmxInSituReader& reader, TmxObjectGroupView* outObjectGroup)
+{
+	outObjectGroup->name = _stringValue(reader.attribute("name"));
+	outObjectGroup->color = _stringValue(reader.attribute("color"));
+	outObjectGroup->opacity = _floatValue(reader.attribute("opacity"), 1.f);
+	outObjectGroup->visible = _boolValue(reader.attribute("visible"), true);
+
+	TmxReturn error = TmxReturn::kSuccess;
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (reader.isElement("properties"))
+		{
+			error = _viewParsePropertyNode(reader, &outObjectGroup->properties);
+		}
+		else if (reader.isElement("object"))
+		{
+			outObjectGroup->objects.push_back(TmxObjectView());
+			if (_viewParseObjectNode(reader, &outObjectGroup->objects.back()) != kSuccess)
+			{
+				LOGE("Error parsing object node...");
+				error = TmxReturn::kErrorParsing;
+			}
+		}
+		else
+		{
+			reader.skipChildren();
+		}
+
+		if (error)
+		{
+			return error;
+		}
+	}
+
+	return reader.failed() ? TmxReturn::kErrorParsing : TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseObjectNode(TmxInSituReader& reader, TmxObjectView* outObj)
+{
+	outObj->name = _stringValue(reader.attribute("name"));
+	outObj->type = _stringValue(reader.attribute("type"));
+	outObj->x = _floatValue(reader.attribute("x"), 0.f);
+	outObj->y = _floatValue(reader.attribute("y"), 0.f);
+	outObj->width = _floatValue(reader.attribute("width"), 0.f);
+	outObj->height = _floatValue(reader.attribute("height"), 0.f);
+	outObj->rotation = _floatValue(reader.attribute("rotation"), 0.f);
+	outObj->referenceGid = _unsignedValue(reader.attribute("gid"), 0);
+	outObj->visible = _boolValue(reader.attribute("visible"), false);
+	outObj->shapeType = kSquare;
+
+	TmxReturn error = TmxReturn::kSuccess;
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (reader.isElement("properties"))
+		{
+			error = _viewParsePropertyNode(reader, &outObj->properties);
+		}
+		else if (outObj->shapeType == kSquare && reader.isElement("ellipse"))
+		{
+			outObj->shapeType = kEllipse;
+			reader.skipChildren();
+		}
+		else if (outObj->shapeType == kSquare && (reader.isElement("polygon") || reader.isElement("polyline")))
+		{
+			outObj->shapeType = reader.isElement("polygon") ? kPolygon : kPolyline;
+			error = _viewParseShapePoints(reader.attribute("points"), &outObj->shapePoints);
+			reader.skipChildren();
+		}
+		else
+		{
+			reader.skipChildren();
+		}
+
+		if (error)
+		{
+			return error;
+		}
+	}
+
+	return reader.failed() ? TmxReturn::kErrorParsing : TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseShapePoints(const TmxStringView* points, TmxShapePointCollection_t* outPoints)
+{
+	if (points == NULL)
+	{
+		LOGE("Missing points attribute for shape requiring one...");
+		return TmxReturn::kErrorParsing;
+	}
+
+	// "x,y x,y ..."
+	const char* p = points->data;
+	while (*p != '\0')
+	{
+		char* end = NULL;
+		TmxShapePoint pair;
+		pair.first = (float)strtod(p, &end);
+		p = (*end == ',') ? end + 1 : end;
+		pair.second = (float)strtod(p, &end);
+		p = end;
+
+		outPoints->push_back(pair);
+
+		if (*p != ' ' && *p != '\0')
+		{
+			LOGE("Malformed points attribute...");
+			return TmxReturn::kErrorParsing;
+		}
+		while (*p == ' ')
+			p++;
+	}
+
+	return TmxReturn::kSuccess;
+}
+
+
+TmxReturn _viewParseImageLayerNode(TmxInSituReader& reader, TmxImageLayerView* outImageLayer)
+{
+	outImageLayer->name = _stringValue(reader.attribute("name"));
+	if (outImageLayer->name.length == 0)
+	{
+		LOGE("Missing required attribute [%s]", "name");
+		return TmxReturn::kMissingRequiredAttribute;
+	}
+
+	outImageLayer->x = _unsignedValue(reader.attribute("x"), 0);
+	outImageLayer->y = _unsignedValue(reader.attribute("y"), 0);
+	outImageLayer->widthInTiles = _unsignedValue(reader.attribute("width"), 0);
+	outImageLayer->heightInTiles = _unsignedValue(reader.attribute("height"), 0);
+	outImageLayer->opacity = _floatValue(reader.attribute("opacity"), 1.f);
+	outImageLayer->visible = _boolValue(reader.attribute("visible"), true);
+
+	TmxImageView image = { kEmptyView, kEmptyView, kEmptyView, 0, 0 };
+	outImageLayer->image = image;
+
+	TmxReturn error = TmxReturn::kSuccess;
+	for (bool child = reader.firstChild(); child; child = reader.nextSibling())
+	{
+		if (reader.isElement("properties"))
+		{
+			error = _viewParsePropertyNode(reader, &outImageLayer->properties);
+		}
+		else if (reader.isElement("image"))
+		{
+			error = _viewParseImageNode(reader, &outImageLayer->image);
+		}
+		else
+		{
+			reader.skipChildren();
+		}
+
+		if (error)
+		{
+			return error;
+		}
+	}
+
+	return reader.failed() ? TmxReturn::kErrorParsing : TmxReturn::kSuccess;
+}
+
+
+}
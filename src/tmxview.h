@@ -0,0 +1,237 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Stephen Damm - shinhalsafar@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef _LIB_TMX_VIEW_H_
+#define _LIB_TMX_VIEW_H_
+
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tmxparser.h"
+
+
+namespace tmxparser
+{
+
+
+/*
+ * Read only maps whose strings point into the xml they were parsed from.  The caller's buffer is parsed in
+ * place: entities are decoded and every string is NUL terminated where it sits, so the buffer is modified
+ * and has to outlive the view.  Only the collections themselves are allocated, no string is copied.
+ */
+
+
+typedef struct
+{
+	const char* data; /// NUL terminated, never NULL.  Missing optional attributes are empty.
+	size_t length;
+} TmxStringView;
+
+
+inline bool operator==(const TmxStringView& view, const char* str)
+{
+	return strlen(str) == view.length && memcmp(view.data, str, view.length) == 0;
+}
+
+
+inline bool operator!=(const TmxStringView& view, const char* str)
+{
+	return !(view == str);
+}
+
+
+inline std::string toString(const TmxStringView& view)
+{
+	return std::string(view.data, view.length);
+}
+
+
+typedef struct
+{
+	TmxStringView name;
+	TmxStringView value;
+} TmxPropertyView;
+
+
+typedef std::vector<TmxPropertyView> TmxPropertyViewCollection_t; /// in file order
+
+
+typedef struct
+{
+	TmxStringView name;
+	TmxStringView type;
+	float x;
+	float y;
+	float width;
+	float height;
+	float rotation;
+	unsigned int referenceGid;
+	bool visible;
+	TmxPropertyViewCollection_t properties;
+	TmxShapeType shapeType;
+	TmxShapePointCollection_t shapePoints;
+} TmxObjectView;
+
+
+typedef std::vector<TmxObjectView> TmxObjectViewCollection_t;
+
+
+typedef struct
+{
+	TmxStringView name;
+	TmxStringView color;
+	float opacity;
+	bool visible;
+	TmxPropertyViewCollection_t properties;
+	TmxObjectViewCollection_t objects;
+} TmxObjectGroupView;
+
+
+typedef std::vector<TmxObjectGroupView> TmxObjectGroupViewCollection_t;
+
+
+typedef struct
+{
+	TileId_t id;
+	TmxPropertyViewCollection_t properties;
+	TmxAnimationFrameCollection_t animations;
+	TmxObjectGroupViewCollection_t objectgroups;
+} TmxTileDefinitionView;
+
+
+typedef std::vector<TmxTileDefinitionView> TmxTileDefinitionViewCollection_t; /// in file order
+
+
+typedef struct
+{
+	TmxStringView format;
+	TmxStringView source; /// as written in the file, relative to the tmx or tsx
+	TmxStringView transparentColor;
+	unsigned int width;
+	unsigned int height;
+} TmxImageView;
+
+
+typedef struct
+{
+	TmxStringView source;
+	unsigned int firstgid;
+	TmxStringView name; /// the tsx file name without its extension for external tilesets, like TmxTileset::name
+	unsigned int tileWidth;
+	unsigned int tileHeight;
+	unsigned int tileSpacingInImage;
+	unsigned int tileMarginInImage;
+	TmxOffset offset;
+
+	unsigned int rowCount;
+	unsigned int colCount;
+
+	TmxImageView image;
+	TmxTileDefinitionViewCollection_t tileDefinitions;
+} TmxTilesetView;
+
+
+typedef std::vector<TmxTilesetView> TmxTilesetViewCollection_t;
+
+
+typedef struct
+{
+	TmxStringView name;
+	unsigned int width;
+	unsigned int height;
+	float opacity;
+	bool visible;
+	TmxPropertyViewCollection_t properties;
+	TmxLayerTileCollection_t tiles;
+	TmxLayerGidCollection_t gids; /// filled instead of tiles with kLayerStorageGids
+} TmxLayerView;
+
+
+typedef std::vector<TmxLayerView> TmxLayerViewCollection_t;
+
+
+typedef struct
+{
+	TmxStringView name;
+	unsigned int x;
+	unsigned int y;
+	unsigned int widthInTiles;
+	unsigned int heightInTiles;
+	float opacity;
+	bool visible;
+	TmxPropertyViewCollection_t properties;
+	TmxImageView image;
+} TmxImageLayerView;
+
+
+typedef std::vector<TmxImageLayerView> TmxImageLayerViewCollection_t;
+
+
+typedef struct
+{
+	TmxStringView version;
+	TmxOrientation orientation;
+	unsigned int width;
+	unsigned int height;
+	unsigned int tileWidth;
+	unsigned int tileHeight;
+	TmxStringView backgroundColor;
+	TmxStringView renderOrder;
+	TmxPropertyViewCollection_t properties;
+	TmxTilesetViewCollection_t tilesets;
+	TmxTilesetLookup tilesetLookup;
+	TmxLayerViewCollection_t layers;
+	TmxObjectGroupViewCollection_t objectGroups;
+	TmxImageLayerViewCollection_t imageLayers;
+
+	std::vector<std::shared_ptr<std::vector<char> > > tilesetBuffers; /// external tsx files, owned by the view and shared by its copies
+} TmxMapView;
+
+
+/**
+ * Parse a tmx in place into a view.  Tilesets must come before the layers that use them, as Tiled saves them.
+ * Infinite maps are not supported, parse them into a TmxMap.
+ * @param data Tmx file in memory.  Modified by the parse and referenced by the view, keep it alive as long as the view.
+ * @param length Size of the data buffer.
+ * @param outView An allocated TmxMapView object ready to be populated.
+ * @param tilesetPath Directory external tilesets are loaded from.
+ * @param options Optional parse settings, only layerStorage and the layer, object group and image layer filters apply.  Layers are decoded on the calling thread.
+ * @return kSuccess on success.
+ */
+TmxReturn parseViewFromMemory(char* data, size_t length, TmxMapView* outView, const std::string& tilesetPath, const TmxParseOptions& options = TmxParseOptions());
+
+
+/**
+ * Finds a property by name.
+ * @return The value of the last property with that name, NULL if there is none.
+ */
+const TmxStringView* findProperty(const TmxPropertyViewCollection_t& properties, const char* name);
+
+
+}
+#endif /* _LIB_TMX_VIEW_H_ */
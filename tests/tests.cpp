@@ -1,5 +1,30 @@
 #include "gtest/gtest.h"
+
+#include <atomic>
+#include <clocale>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <zlib.h>
+#include <zstd.h>
+
 #include "../src/tmxparser.h"
+#include "../src/tmxarena.h"
+#include "../src/base64.h"
+#include "../src/mappedfile.h"
+#include "../src/threadpool.h"
+#include "../src/tmxbinary.h"
+#include "../src/tmxview.h"
+
+#include "tinyxml2.h"
 
 
 /*template<>
@@ -10,6 +35,69 @@ bool std::operator==(const tmxparser::TmxShapePoint& l, const tmxparser::TmxShap
 }*/
 
 
+// counts the allocations made while an AllocationCounter is alive, on any thread.  With failAt set, the
+// allocation of that number throws std::bad_alloc.
+static std::atomic<size_t> gAllocationCount(0);
+static std::atomic<size_t> gFailAllocationAt(0);
+static std::atomic<bool> gCountAllocations(false);
+
+
+class AllocationCounter
+{
+public:
+	explicit AllocationCounter(size_t failAt = 0) { gAllocationCount = 0; gFailAllocationAt = failAt; gCountAllocations = true; }
+	~AllocationCounter() { stop(); }
+
+	size_t stop() { gCountAllocations = false; gFailAllocationAt = 0; return gAllocationCount.load(); }
+
+private:
+	AllocationCounter(const AllocationCounter&);
+	AllocationCounter& operator=(const AllocationCounter&);
+};
+
+
+void* operator new(size_t size)
+{
+	if (gCountAllocations.load(std::memory_order_relaxed))
+	{
+		size_t count = ++gAllocationCount;
+		if (count == gFailAllocationAt.load(std::memory_order_relaxed))
+		{
+			throw std::bad_alloc();
+		}
+	}
+
+	void* p = malloc(size != 0 ? size : 1);
+	if (p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+
+// called through a pointer, so the compiler does not take the free for a mismatch with operator new once both are inlined
+static void (*volatile gFree)(void*) = free;
+
+
+void operator delete(void* p) noexcept
+{
+	gFree(p);
+}
+
+
+void operator delete[](void* p) noexcept
+{
+	gFree(p);
+}
+
+
 class TmxParseTest : public ::testing::Test
 {
 public:
@@ -21,6 +109,7 @@ public:
 		}
 
 		_map = new tmxparser::TmxMap();
+		_mapPath = mapPath;
 		tmxparser::parseFromFile(mapPath, _map, "../test_files");
 	}
 
@@ -55,10 +144,12 @@ protected:
 
 
 	static tmxparser::TmxMap* _map;
+	static std::string _mapPath;
 };
 
 
 tmxparser::TmxMap* TmxParseTest::_map = NULL;
+std::string TmxParseTest::_mapPath;
 
 
 TEST_F(TmxParseTest, MapNotNull)
@@ -198,6 +289,573 @@ TEST_F(TmxParseTest, TilesValidation)
 }
 
 
+TEST_F(TmxParseTest, CompactLayerStorage)
+{
+	tmxparser::TmxParseOptions options;
+	options.layerStorage = tmxparser::kLayerStorageGids;
+
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile(_mapPath, &map, "../test_files", options));
+
+	const tmxparser::TmxLayer& layer = map.layerCollection[0];
+	ASSERT_TRUE(layer.tiles.empty());
+	ASSERT_EQ(100, layer.gids.size());
+	ASSERT_EQ(100, tmxparser::getLayerTileCount(layer));
+
+	for (unsigned int i = 0; i < 100; i++)
+	{
+		tmxparser::TmxLayerTile tile;
+		ASSERT_EQ(tmxparser::kSuccess, tmxparser::getLayerTile(map, layer, i, &tile));
+		ASSERT_EQ(_map->layerCollection[0].tiles[i].gid, tile.gid);
+		ASSERT_EQ(_map->layerCollection[0].tiles[i].tilesetIndex, tile.tilesetIndex);
+		ASSERT_EQ(_map->layerCollection[0].tiles[i].tileFlatIndex, tile.tileFlatIndex);
+	}
+
+	tmxparser::TmxLayerTile tile;
+	ASSERT_EQ(tmxparser::kInvalidTileIndex, tmxparser::getLayerTile(map, layer, 100, &tile));
+}
+
+
+TEST_F(TmxParseTest, LazyLayerStorage)
+{
+	for (unsigned int threadCount = 1; threadCount <= 2; threadCount++)
+	{
+		tmxparser::TmxParseOptions options;
+		options.layerStorage = tmxparser::kLayerStorageLazy;
+		options.threadCount = threadCount;
+
+		tmxparser::TmxMap map;
+		ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile(_mapPath, &map, "../test_files", options));
+		ASSERT_EQ(_map->layerCollection.size(), map.layerCollection.size());
+
+		for (size_t layer = 0; layer < map.layerCollection.size(); layer++)
+		{
+			const tmxparser::TmxLayer& lazyLayer = map.layerCollection[layer];
+			ASSERT_TRUE(lazyLayer.tiles.empty());
+			ASSERT_EQ(_map->layerCollection[layer].tiles.size(), tmxparser::getLayerTileCount(lazyLayer));
+
+			// xml layers have nothing encoded to keep, they come back as gids
+			if (lazyLayer.lazyData == NULL)
+			{
+				ASSERT_EQ(_map->layerCollection[layer].tiles.size(), lazyLayer.gids.size());
+				continue;
+			}
+
+			// first touch from several threads at once decodes the layer once
+			std::vector<const tmxparser::TmxLayerTileCollection_t*> decoded(4, NULL);
+			std::vector<std::thread> threads;
+			for (size_t i = 0; i < decoded.size(); i++)
+			{
+				threads.push_back(std::thread([&, i]() { decoded[i] = tmxparser::getLayerTiles(map, lazyLayer); }));
+			}
+			for (size_t i = 0; i < threads.size(); i++)
+			{
+				threads[i].join();
+			}
+
+			ASSERT_TRUE(decoded[0] != NULL);
+			for (size_t i = 1; i < decoded.size(); i++)
+			{
+				ASSERT_EQ(decoded[0], decoded[i]);
+			}
+
+			const tmxparser::TmxLayerTileCollection_t& tiles = *decoded[0];
+			ASSERT_EQ(_map->layerCollection[layer].tiles.size(), tiles.size());
+			for (size_t tile = 0; tile < tiles.size(); tile++)
+			{
+				ASSERT_EQ(_map->layerCollection[layer].tiles[tile].gid, tiles[tile].gid);
+				ASSERT_EQ(_map->layerCollection[layer].tiles[tile].tilesetIndex, tiles[tile].tilesetIndex);
+
+				tmxparser::TmxLayerTile single;
+				ASSERT_EQ(tmxparser::kSuccess, tmxparser::getLayerTile(map, lazyLayer, (unsigned int)tile, &single));
+				ASSERT_EQ(tiles[tile].tileFlatIndex, single.tileFlatIndex);
+			}
+		}
+	}
+}
+
+
+TEST_F(TmxParseTest, StreamingParseMatchesDocument)
+{
+	tmxparser::TmxParseOptions options;
+	options.parseMode = tmxparser::kParseModeStreaming;
+
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile(_mapPath, &map, "../test_files", options));
+
+	ASSERT_EQ(_map->width, map.width);
+	ASSERT_EQ(_map->height, map.height);
+	ASSERT_EQ(_map->propertyMap.size(), map.propertyMap.size());
+	for (size_t i = 0; i < map.propertyMap.size(); i++)
+	{
+		ASSERT_EQ(_map->propertyMap[i].name, map.propertyMap[i].name);
+		ASSERT_EQ(_map->propertyMap[i].value, map.propertyMap[i].value);
+	}
+	ASSERT_EQ(_map->tilesetCollection.size(), map.tilesetCollection.size());
+	ASSERT_EQ(_map->tilesetCollection[0].image.source, map.tilesetCollection[0].image.source);
+	ASSERT_EQ(_map->objectGroupCollection.size(), map.objectGroupCollection.size());
+	ASSERT_EQ(_map->objectGroupCollection[0].objects.size(), map.objectGroupCollection[0].objects.size());
+	ASSERT_EQ(_map->imageLayerCollection.size(), map.imageLayerCollection.size());
+	ASSERT_EQ(_map->layerCollection.size(), map.layerCollection.size());
+
+	for (size_t i = 0; i < map.layerCollection.size(); i++)
+	{
+		const tmxparser::TmxLayerTileCollection_t& expected = _map->layerCollection[i].tiles;
+		const tmxparser::TmxLayerTileCollection_t& tiles = map.layerCollection[i].tiles;
+		ASSERT_EQ(expected.size(), tiles.size());
+		for (size_t t = 0; t < tiles.size(); t++)
+		{
+			ASSERT_EQ(expected[t].gid, tiles[t].gid);
+			ASSERT_EQ(expected[t].tilesetIndex, tiles[t].tilesetIndex);
+			ASSERT_EQ(expected[t].tileFlatIndex, tiles[t].tileFlatIndex);
+		}
+	}
+}
+
+
+TEST_F(TmxParseTest, ParserReuse)
+{
+	tmxparser::TmxParser parser;
+	tmxparser::TmxParseOptions streaming;
+	streaming.parseMode = tmxparser::kParseModeStreaming;
+
+	for (int i = 0; i < 4; i++)
+	{
+		tmxparser::TmxMap map;
+		ASSERT_EQ(tmxparser::kSuccess, parser.parseFromFile(_mapPath, &map, "../test_files", (i % 2) ? streaming : tmxparser::TmxParseOptions()));
+		ASSERT_EQ(_map->tilesetCollection.size(), map.tilesetCollection.size());
+		ASSERT_EQ(_map->layerCollection.size(), map.layerCollection.size());
+
+		const tmxparser::TmxLayerTileCollection_t& expected = _map->layerCollection[0].tiles;
+		const tmxparser::TmxLayerTileCollection_t& tiles = map.layerCollection[0].tiles;
+		ASSERT_EQ(expected.size(), tiles.size());
+		for (size_t t = 0; t < tiles.size(); t++)
+		{
+			ASSERT_EQ(expected[t].gid, tiles[t].gid);
+			ASSERT_EQ(expected[t].tileFlatIndex, tiles[t].tileFlatIndex);
+		}
+	}
+
+	tmxparser::TmxMap missing;
+	ASSERT_EQ(tmxparser::kErrorParsing, parser.parseFromFile("../test_files/does_not_exist.tmx", &missing, "../test_files"));
+}
+
+
+TEST_F(TmxParseTest, ThreadedParseMatchesSequential)
+{
+	tmxparser::TmxParser parser;
+	for (int mode = 0; mode < 2; mode++)
+	{
+		tmxparser::TmxParseOptions options;
+		options.threadCount = 3;
+		options.useTilesetCache = false;
+		options.parseMode = mode ? tmxparser::kParseModeStreaming : tmxparser::kParseModeDocument;
+
+		tmxparser::TmxMap map;
+		ASSERT_EQ(tmxparser::kSuccess, parser.parseFromFile(_mapPath, &map, "../test_files", options));
+		ASSERT_EQ(_map->tilesetCollection.size(), map.tilesetCollection.size());
+		for (size_t i = 0; i < map.tilesetCollection.size(); i++)
+		{
+			ASSERT_EQ(_map->tilesetCollection[i].firstgid, map.tilesetCollection[i].firstgid);
+			ASSERT_EQ(_map->tilesetCollection[i].name, map.tilesetCollection[i].name);
+			ASSERT_EQ(_map->tilesetCollection[i].image.source, map.tilesetCollection[i].image.source);
+			ASSERT_EQ(_map->tilesetCollection[i].colCount, map.tilesetCollection[i].colCount);
+		}
+
+		ASSERT_EQ(_map->layerCollection.size(), map.layerCollection.size());
+		const tmxparser::TmxLayerTileCollection_t& expected = _map->layerCollection[0].tiles;
+		const tmxparser::TmxLayerTileCollection_t& tiles = map.layerCollection[0].tiles;
+		ASSERT_TRUE(map.layerCollection[0].gids.empty());
+		ASSERT_EQ(expected.size(), tiles.size());
+		for (size_t t = 0; t < tiles.size(); t++)
+		{
+			ASSERT_EQ(expected[t].gid, tiles[t].gid);
+			ASSERT_EQ(expected[t].tilesetIndex, tiles[t].tilesetIndex);
+			ASSERT_EQ(expected[t].tileFlatIndex, tiles[t].tileFlatIndex);
+		}
+	}
+}
+
+
+TEST_F(TmxParseTest, BinaryMapRoundTrip)
+{
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::writeBinaryMap(*_map, "binary_map_test.tmxb", _mapPath, "../test_files"));
+
+	tmxparser::TmxBinaryMap binaryMap;
+	ASSERT_EQ(tmxparser::kSuccess, binaryMap.open("binary_map_test.tmxb"));
+
+	const tmxparser::TmxBinaryHeader* header = binaryMap.header();
+	ASSERT_EQ(_map->width, header->width);
+	ASSERT_EQ(_map->tileHeight, header->tileHeight);
+	ASSERT_EQ(_map->version, binaryMap.string(header->version));
+	ASSERT_EQ(_map->propertyMap.size(), header->properties.count);
+
+	const tmxparser::TmxBinaryProperty* properties = binaryMap.array<tmxparser::TmxBinaryProperty>(header->properties);
+	for (uint64_t i = 0; i < header->properties.count; i++)
+	{
+		const tmxparser::TmxProperty* property = tmxparser::findProperty(_map->propertyMap, binaryMap.string(properties[i].name));
+		ASSERT_TRUE(property != NULL);
+		ASSERT_EQ(property->value, binaryMap.string(properties[i].value));
+	}
+
+	ASSERT_EQ(_map->tilesetCollection.size(), header->tilesets.count);
+	const tmxparser::TmxBinaryTileset* tilesets = binaryMap.array<tmxparser::TmxBinaryTileset>(header->tilesets);
+	for (size_t i = 0; i < _map->tilesetCollection.size(); i++)
+	{
+		ASSERT_EQ(_map->tilesetCollection[i].firstgid, tilesets[i].firstgid);
+		ASSERT_EQ(_map->tilesetCollection[i].name, binaryMap.string(tilesets[i].name));
+		ASSERT_EQ(_map->tilesetCollection[i].image.source, binaryMap.string(tilesets[i].image.source));
+		ASSERT_EQ(_map->tilesetCollection[i].tileDefinitions.size(), tilesets[i].tileDefinitions.count);
+	}
+
+	ASSERT_EQ(_map->layerCollection.size(), header->layers.count);
+	const tmxparser::TmxBinaryLayer* layers = binaryMap.array<tmxparser::TmxBinaryLayer>(header->layers);
+	const tmxparser::TmxLayerTileCollection_t& expected = _map->layerCollection[0].tiles;
+	ASSERT_EQ(expected.size(), layers[0].tiles.count);
+	const tmxparser::TmxLayerTile* tiles = binaryMap.array<tmxparser::TmxLayerTile>(layers[0].tiles);
+	for (size_t t = 0; t < expected.size(); t++)
+	{
+		ASSERT_EQ(expected[t].gid, tiles[t].gid);
+		ASSERT_EQ(expected[t].tilesetIndex, tiles[t].tilesetIndex);
+		ASSERT_EQ(expected[t].tileFlatIndex, tiles[t].tileFlatIndex);
+	}
+
+	ASSERT_EQ(_map->objectGroupCollection.size(), header->objectGroups.count);
+	const tmxparser::TmxBinaryObjectGroup* groups = binaryMap.array<tmxparser::TmxBinaryObjectGroup>(header->objectGroups);
+	ASSERT_EQ(_map->objectGroupCollection[0].name, binaryMap.string(groups[0].name));
+	ASSERT_EQ(_map->objectGroupCollection[0].objects.size(), groups[0].objects.count);
+	const tmxparser::TmxBinaryObject* objects = binaryMap.array<tmxparser::TmxBinaryObject>(groups[0].objects);
+	for (size_t o = 0; o < groups[0].objects.count; o++)
+	{
+		ASSERT_STREQ(tmxparser::getInternedString(_map->objectGroupCollection[0].objects[o].name), binaryMap.string(objects[o].name));
+		ASSERT_EQ(_map->objectGroupCollection[0].objects[o].shapePoints.size(), objects[o].shapePoints.count);
+	}
+
+	binaryMap.close();
+	remove("binary_map_test.tmxb");
+}
+
+
+TEST_F(TmxParseTest, AsyncParseMatchesSync)
+{
+	std::vector<tmxparser::TmxParsePhase> phases;
+	std::vector<unsigned int> lastDone(4, 0), lastTotal(4, 0);
+	tmxparser::TmxParseOptions options;
+	options.progress = [&](tmxparser::TmxParsePhase phase, unsigned int done, unsigned int total)
+	{
+		if (phases.empty() || phases.back() != phase)
+			phases.push_back(phase);
+		lastDone[phase] = done;
+		lastTotal[phase] = total;
+	};
+
+	tmxparser::TmxMap map;
+	tmxparser::TmxReturn callbackResult = tmxparser::kErrorParsing;
+	std::future<tmxparser::TmxReturn> result = tmxparser::parseFromFileAsync(_mapPath, &map, "../test_files", options, [&](tmxparser::TmxReturn retVal)
+	{
+		callbackResult = retVal;
+	});
+	ASSERT_EQ(tmxparser::kSuccess, result.get());
+	ASSERT_EQ(tmxparser::kSuccess, callbackResult);
+
+	ASSERT_EQ(_map->layerCollection.size(), map.layerCollection.size());
+	ASSERT_EQ(_map->objectGroupCollection[0].objects.size(), map.objectGroupCollection[0].objects.size());
+	ASSERT_EQ(_map->layerCollection[0].tiles.size(), map.layerCollection[0].tiles.size());
+
+	ASSERT_EQ(4, phases.size());
+	for (int phase = tmxparser::kParsePhaseXml; phase <= tmxparser::kParsePhaseObjects; phase++)
+	{
+		ASSERT_EQ(phase, phases[phase]);
+		ASSERT_EQ(lastTotal[phase], lastDone[phase]);
+	}
+	ASSERT_EQ(map.layerCollection.size(), lastDone[tmxparser::kParsePhaseLayers]);
+
+	// a user executor runs the parse wherever it likes
+	std::vector<std::thread> threads;
+	tmxparser::TmxExecutor executor = [&](const std::function<void()>& job) { threads.push_back(std::thread(job)); };
+
+	tmxparser::TmxMap executorMap;
+	result = tmxparser::parseFromFileAsync(_mapPath, &executorMap, "../test_files", tmxparser::TmxParseOptions(), tmxparser::TmxParseCallback(), executor);
+	ASSERT_EQ(tmxparser::kSuccess, result.get());
+	threads[0].join();
+	ASSERT_EQ(_map->layerCollection.size(), executorMap.layerCollection.size());
+
+	// a throwing callback still makes the future ready
+	tmxparser::TmxMap throwingMap;
+	result = tmxparser::parseFromFileAsync(_mapPath, &throwingMap, "../test_files", tmxparser::TmxParseOptions(), [](tmxparser::TmxReturn)
+	{
+		throw std::runtime_error("callback");
+	});
+	ASSERT_THROW(result.get(), std::runtime_error);
+
+	// more parses than workers, each decoding its layers on the same pool
+	tmxparser::TmxParseOptions pooledOptions;
+	pooledOptions.useTilesetCache = false;
+	std::vector<tmxparser::TmxMap> pooledMaps(16);
+	std::vector<std::future<tmxparser::TmxReturn> > pooledResults;
+	for (size_t i = 0; i < pooledMaps.size(); i++)
+	{
+		pooledResults.push_back(tmxparser::parseFromFileAsync(_mapPath, &pooledMaps[i], "../test_files", pooledOptions));
+	}
+	for (size_t i = 0; i < pooledMaps.size(); i++)
+	{
+		ASSERT_EQ(tmxparser::kSuccess, pooledResults[i].get());
+		ASSERT_EQ(_map->layerCollection.size(), pooledMaps[i].layerCollection.size());
+		ASSERT_EQ(_map->layerCollection[0].tiles.size(), pooledMaps[i].layerCollection[0].tiles.size());
+	}
+}
+
+
+TEST_F(TmxParseTest, CancelledParse)
+{
+	std::atomic<bool> cancel(true);
+	tmxparser::TmxParseOptions options;
+	options.cancel = &cancel;
+
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kCancelled, tmxparser::parseFromFileAsync(_mapPath, &map, "../test_files", options).get());
+
+	options.parseMode = tmxparser::kParseModeStreaming;
+	tmxparser::TmxMap streamedMap;
+	ASSERT_EQ(tmxparser::kCancelled, tmxparser::parseFromFile(_mapPath, &streamedMap, "../test_files", options));
+
+	// cancelled from inside, once the tilesets are in
+	cancel = false;
+	options.parseMode = tmxparser::kParseModeDocument;
+	options.threadCount = 2;
+	options.progress = [&](tmxparser::TmxParsePhase phase, unsigned int, unsigned int)
+	{
+		ASSERT_NE(tmxparser::kParsePhaseObjects, phase);
+		if (phase == tmxparser::kParsePhaseTilesets)
+			cancel = true;
+	};
+
+	tmxparser::TmxMap threadedMap;
+	ASSERT_EQ(tmxparser::kCancelled, tmxparser::parseFromFile(_mapPath, &threadedMap, "../test_files", options));
+}
+
+
+TEST_F(TmxParseTest, BatchParseMatchesSingle)
+{
+	std::vector<std::string> fileNames(6, _mapPath);
+	fileNames.push_back("missing_batch_map.tmx");
+
+	tmxparser::TmxParseOptions options;
+	options.threadCount = 4;
+
+	std::vector<tmxparser::TmxMap> maps;
+	std::vector<tmxparser::TmxReturn> results;
+	tmxparser::TmxBatchStats stats;
+	ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::parseBatchFromFiles(fileNames, &maps, &results, "../test_files", options, &stats));
+	ASSERT_EQ(fileNames.size(), maps.size());
+	ASSERT_EQ(fileNames.size(), results.size());
+	ASSERT_EQ(fileNames.size(), stats.mapCount);
+	ASSERT_EQ(1, stats.failedCount);
+	ASSERT_EQ(tmxparser::kErrorParsing, results.back());
+	ASSERT_LT(0u, stats.byteCount);
+
+	for (size_t i = 0; i + 1 < maps.size(); i++)
+	{
+		ASSERT_EQ(tmxparser::kSuccess, results[i]);
+		ASSERT_EQ(_map->layerCollection.size(), maps[i].layerCollection.size());
+		ASSERT_EQ(_map->tilesetCollection.size(), maps[i].tilesetCollection.size());
+		ASSERT_EQ(_map->objectGroupCollection.size(), maps[i].objectGroupCollection.size());
+		for (size_t layer = 0; layer < maps[i].layerCollection.size(); layer++)
+		{
+			ASSERT_EQ(_map->layerCollection[layer].tiles.size(), maps[i].layerCollection[layer].tiles.size());
+			for (size_t tile = 0; tile < maps[i].layerCollection[layer].tiles.size(); tile++)
+			{
+				ASSERT_EQ(_map->layerCollection[layer].tiles[tile].gid, maps[i].layerCollection[layer].tiles[tile].gid);
+				ASSERT_EQ(_map->layerCollection[layer].tiles[tile].tilesetIndex, maps[i].layerCollection[layer].tiles[tile].tilesetIndex);
+			}
+		}
+	}
+}
+
+
+TEST_F(TmxParseTest, SteppedLoadMatchesParse)
+{
+	tmxparser::TmxMapLoader loader;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, loader.begin(_mapPath, &map, "../test_files"));
+
+	// a few tiles or objects at a time, so layers and object groups have to resume mid way
+	unsigned int steps = 0;
+	tmxparser::TmxReturn retVal;
+	while ((retVal = loader.stepWork(3)) == tmxparser::kInProgress)
+		steps++;
+	ASSERT_EQ(tmxparser::kSuccess, retVal);
+	ASSERT_TRUE(loader.finished());
+	ASSERT_LT(2u, steps);
+	ASSERT_EQ(tmxparser::kSuccess, loader.stepWork(3));
+
+	ASSERT_EQ(_map->tilesetCollection.size(), map.tilesetCollection.size());
+	ASSERT_EQ(_map->tilesetCollection[0].image.source, map.tilesetCollection[0].image.source);
+	ASSERT_EQ(_map->imageLayerCollection.size(), map.imageLayerCollection.size());
+	ASSERT_EQ(_map->layerCollection.size(), map.layerCollection.size());
+	for (size_t layer = 0; layer < map.layerCollection.size(); layer++)
+	{
+		ASSERT_EQ(_map->layerCollection[layer].tiles.size(), map.layerCollection[layer].tiles.size());
+		for (size_t tile = 0; tile < map.layerCollection[layer].tiles.size(); tile++)
+		{
+			ASSERT_EQ(_map->layerCollection[layer].tiles[tile].gid, map.layerCollection[layer].tiles[tile].gid);
+			ASSERT_EQ(_map->layerCollection[layer].tiles[tile].tileFlatIndex, map.layerCollection[layer].tiles[tile].tileFlatIndex);
+		}
+	}
+	ASSERT_EQ(_map->objectGroupCollection.size(), map.objectGroupCollection.size());
+	for (size_t group = 0; group < map.objectGroupCollection.size(); group++)
+	{
+		ASSERT_EQ(_map->objectGroupCollection[group].objects.size(), map.objectGroupCollection[group].objects.size());
+		for (size_t obj = 0; obj < map.objectGroupCollection[group].objects.size(); obj++)
+		{
+			ASSERT_EQ(_map->objectGroupCollection[group].objects[obj].name, map.objectGroupCollection[group].objects[obj].name);
+		}
+	}
+
+	// time budgeted, always gets somewhere even with no time at all
+	tmxparser::TmxMap timedMap;
+	ASSERT_EQ(tmxparser::kSuccess, loader.begin(_mapPath, &timedMap, "../test_files"));
+	while ((retVal = loader.step(0.0)) == tmxparser::kInProgress)
+		;
+	ASSERT_EQ(tmxparser::kSuccess, retVal);
+	ASSERT_EQ(_map->layerCollection.size(), timedMap.layerCollection.size());
+
+	tmxparser::TmxMap missingMap;
+	ASSERT_EQ(tmxparser::kErrorParsing, loader.begin("missing_stepped_map.tmx", &missingMap, ""));
+	ASSERT_EQ(tmxparser::kErrorParsing, loader.step(1.0));
+}
+
+
+TEST_F(TmxParseTest, FilteredParse)
+{
+	ASSERT_LT(0u, _map->layerCollection.size());
+	ASSERT_LT(0u, _map->objectGroupCollection.size());
+	const std::string layerName = _map->layerCollection[0].name.c_str();
+
+	tmxparser::TmxParseOptions options;
+	options.layerFilter.names.push_back(layerName);
+	options.objectGroupFilter.accept = [](const std::string&) { return false; };
+	options.tileDefinitionFilter.names.push_back("no such type");
+
+	// every way of parsing skips the same elements
+	const tmxparser::TmxParseMode modes[] = { tmxparser::kParseModeDocument, tmxparser::kParseModeStreaming, tmxparser::kParseModeStreaming };
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+	{
+		options.parseMode = modes[i];
+		options.threadCount = (unsigned int)i + 1;
+
+		tmxparser::TmxMap map;
+		ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile(_mapPath, &map, "../test_files", options));
+		ASSERT_EQ(1u, map.layerCollection.size());
+		ASSERT_STREQ(layerName.c_str(), map.layerCollection[0].name.c_str());
+		ASSERT_EQ(_map->layerCollection[0].tiles.size(), map.layerCollection[0].tiles.size());
+		ASSERT_EQ(0u, map.objectGroupCollection.size());
+		ASSERT_EQ(_map->imageLayerCollection.size(), map.imageLayerCollection.size());
+		ASSERT_EQ(_map->tilesetCollection.size(), map.tilesetCollection.size());
+		ASSERT_EQ(0u, map.tilesetCollection[0].tileDefinitions.size());
+	}
+
+	tmxparser::TmxMapLoader loader;
+	tmxparser::TmxMap loadedMap;
+	ASSERT_EQ(tmxparser::kSuccess, loader.begin(_mapPath, &loadedMap, "../test_files", options));
+	tmxparser::TmxReturn retVal;
+	while ((retVal = loader.stepWork(16)) == tmxparser::kInProgress)
+		;
+	ASSERT_EQ(tmxparser::kSuccess, retVal);
+	ASSERT_EQ(1u, loadedMap.layerCollection.size());
+	ASSERT_EQ(0u, loadedMap.objectGroupCollection.size());
+
+	MappedFile file;
+	ASSERT_TRUE(file.open(_mapPath));
+	std::vector<char> xml(file.data(), file.data() + file.size());
+	tmxparser::TmxMapView view;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseViewFromMemory(xml.data(), xml.size(), &view, "../test_files", options));
+	ASSERT_EQ(1u, view.layers.size());
+	ASSERT_EQ(0u, view.objectGroups.size());
+
+	// tiles without a type are matched by ""
+	tmxparser::TmxParseOptions untypedOptions;
+	untypedOptions.tileDefinitionFilter.names.push_back("");
+	untypedOptions.layerFilter.accept = [](const std::string& name) { return name.empty(); };
+	tmxparser::TmxMap untypedMap;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile(_mapPath, &untypedMap, "../test_files", untypedOptions));
+	ASSERT_EQ(_map->tilesetCollection[0].tileDefinitions.size(), untypedMap.tilesetCollection[0].tileDefinitions.size());
+	ASSERT_EQ(0u, untypedMap.layerCollection.size());
+	ASSERT_EQ(_map->objectGroupCollection.size(), untypedMap.objectGroupCollection.size());
+}
+
+
+TEST_F(TmxParseTest, MapViewMatchesMap)
+{
+	MappedFile file;
+	ASSERT_TRUE(file.open(_mapPath));
+	std::vector<char> xml(file.data(), file.data() + file.size());
+
+	tmxparser::TmxMapView view;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseViewFromMemory(xml.data(), xml.size(), &view, "../test_files"));
+
+	ASSERT_STREQ(_map->version.c_str(), tmxparser::toString(view.version).c_str());
+	ASSERT_EQ(_map->width, view.width);
+	ASSERT_EQ(_map->tileHeight, view.tileHeight);
+	ASSERT_EQ(_map->propertyMap.size(), view.properties.size());
+	for (size_t i = 0; i < view.properties.size(); i++)
+	{
+		const tmxparser::TmxProperty* property = tmxparser::findProperty(_map->propertyMap, tmxparser::toString(view.properties[i].name).c_str());
+		ASSERT_TRUE(property != NULL);
+		ASSERT_EQ(property->value, view.properties[i].value.data);
+	}
+
+	ASSERT_EQ(_map->tilesetCollection.size(), view.tilesets.size());
+	for (size_t i = 0; i < view.tilesets.size(); i++)
+	{
+		const tmxparser::TmxTileset& tileset = _map->tilesetCollection[i];
+		ASSERT_EQ(tileset.name, view.tilesets[i].name.data);
+		ASSERT_EQ(tileset.source, view.tilesets[i].source.data);
+		ASSERT_EQ(tileset.colCount, view.tilesets[i].colCount);
+		ASSERT_EQ(tileset.rowCount, view.tilesets[i].rowCount);
+		ASSERT_EQ(tileset.tileDefinitions.size(), view.tilesets[i].tileDefinitions.size());
+		for (size_t d = 0; d < view.tilesets[i].tileDefinitions.size(); d++)
+		{
+			const tmxparser::TmxTileDefinitionView& definition = view.tilesets[i].tileDefinitions[d];
+			ASSERT_EQ(1, tileset.tileDefinitions.count(definition.id));
+			ASSERT_EQ(tileset.tileDefinitions.at(definition.id).propertyMap.size(), definition.properties.size());
+		}
+	}
+
+	ASSERT_EQ(_map->layerCollection.size(), view.layers.size());
+	for (size_t i = 0; i < view.layers.size(); i++)
+	{
+		ASSERT_EQ(_map->layerCollection[i].name, view.layers[i].name.data);
+		const tmxparser::TmxLayerTileCollection_t& expected = _map->layerCollection[i].tiles;
+		const tmxparser::TmxLayerTileCollection_t& tiles = view.layers[i].tiles;
+		ASSERT_EQ(expected.size(), tiles.size());
+		for (size_t t = 0; t < tiles.size(); t++)
+		{
+			ASSERT_EQ(expected[t].gid, tiles[t].gid);
+			ASSERT_EQ(expected[t].tilesetIndex, tiles[t].tilesetIndex);
+			ASSERT_EQ(expected[t].tileFlatIndex, tiles[t].tileFlatIndex);
+		}
+	}
+
+	ASSERT_EQ(_map->objectGroupCollection.size(), view.objectGroups.size());
+	const tmxparser::TmxObjectGroupView& group = view.objectGroups[0];
+	ASSERT_TRUE(group.name == "Collision");
+	ASSERT_EQ(_map->objectGroupCollection[0].objects.size(), group.objects.size());
+	for (size_t o = 0; o < group.objects.size(); o++)
+	{
+		const tmxparser::TmxObject& object = _map->objectGroupCollection[0].objects[o];
+		ASSERT_STREQ(tmxparser::getInternedString(object.name), group.objects[o].name.data);
+		ASSERT_STREQ(tmxparser::getInternedString(object.type), group.objects[o].type.data);
+		ASSERT_EQ(object.x, group.objects[o].x);
+		ASSERT_EQ(object.shapeType, group.objects[o].shapeType);
+		ASSERT_EQ(object.shapePoints, group.objects[o].shapePoints);
+	}
+
+	// the strings live in the buffer itself
+	ASSERT_TRUE(group.objects[0].name.data >= xml.data() && group.objects[0].name.data < xml.data() + xml.size());
+}
+
+
 TEST_F(TmxParseTest, ObjectGroupValidation)
 {
 	ASSERT_EQ(1, _map->objectGroupCollection.size());
@@ -216,8 +874,8 @@ TEST_F(TmxParseTest, ObjectsValidation)
 	ASSERT_EQ(4, objGroup.objects.size());
 
 	tmxparser::TmxObject obj = objGroup.objects[0];
-	ASSERT_EQ("testRect", obj.name);
-	ASSERT_EQ("testRect", obj.type);
+	ASSERT_STREQ("testRect", tmxparser::getInternedString(obj.name));
+	ASSERT_STREQ("testRect", tmxparser::getInternedString(obj.type));
 	ASSERT_EQ(0, obj.x);
 	ASSERT_EQ(0, obj.y);
 	ASSERT_EQ(160, obj.width);
@@ -225,8 +883,8 @@ TEST_F(TmxParseTest, ObjectsValidation)
 	ASSERT_EQ(tmxparser::kSquare, obj.shapeType);
 
 	obj = objGroup.objects[1];
-	ASSERT_EQ("testCircle", obj.name);
-	ASSERT_EQ("testType", obj.type);
+	ASSERT_STREQ("testCircle", tmxparser::getInternedString(obj.name));
+	ASSERT_STREQ("testType", tmxparser::getInternedString(obj.type));
 	ASSERT_EQ(48, obj.x);
 	ASSERT_EQ(83, obj.y);
 	ASSERT_EQ(73, obj.width);
@@ -234,8 +892,8 @@ TEST_F(TmxParseTest, ObjectsValidation)
 	ASSERT_EQ(tmxparser::kEllipse, obj.shapeType);
 
 	obj = objGroup.objects[2];
-	ASSERT_EQ("testPolygon", obj.name);
-	ASSERT_EQ("testPolygon", obj.type);
+	ASSERT_STREQ("testPolygon", tmxparser::getInternedString(obj.name));
+	ASSERT_STREQ("testPolygon", tmxparser::getInternedString(obj.type));
 	ASSERT_EQ(134, obj.x);
 	ASSERT_EQ(73, obj.y);
 	ASSERT_EQ(tmxparser::kPolygon, obj.shapeType);
@@ -247,8 +905,8 @@ TEST_F(TmxParseTest, ObjectsValidation)
 	ASSERT_EQ(tmxparser::TmxShapePoint(-79,-10), obj.shapePoints[3]);
 
 	obj = objGroup.objects[3];
-	ASSERT_EQ("testPolyline", obj.name);
-	ASSERT_EQ("testPolyline", obj.type);
+	ASSERT_STREQ("testPolyline", tmxparser::getInternedString(obj.name));
+	ASSERT_STREQ("testPolyline", tmxparser::getInternedString(obj.type));
 	ASSERT_EQ(15.5, obj.x);
 	ASSERT_EQ(69.5, obj.y);
 	ASSERT_EQ(tmxparser::kPolyline, obj.shapeType);
@@ -263,6 +921,1413 @@ TEST_F(TmxParseTest, ObjectsValidation)
 }
 
 
+TEST(Base64Test, BufferDecodeSkipsWhitespace)
+{
+	const char* text = "\n   AQAAAAIA\r\n AAA=\n  ";
+	unsigned char out[16];
+
+	ASSERT_EQ(8, base64_decode(text, strlen(text), out, sizeof(out)));
+	ASSERT_EQ(1, out[0]);
+	ASSERT_EQ(0, out[3]);
+	ASSERT_EQ(2, out[4]);
+	ASSERT_EQ(0, out[7]);
+
+	ASSERT_EQ(BASE64_DECODE_ERROR, base64_decode("AQ*A", 4, out, sizeof(out)));
+}
+
+
+TEST(Base64Test, BlockDecoderMatchesScalar)
+{
+	// long enough for several 16 and 32 character blocks, with every tail length after them
+	std::vector<unsigned char> bytes(700);
+	for (size_t i = 0; i < bytes.size(); i++)
+		bytes[i] = (unsigned char)((i * 131 + 7) ^ (i >> 3));
+
+	std::vector<unsigned char> out(bytes.size() + 3);
+	for (size_t length = 0; length <= bytes.size(); length++)
+	{
+		SCOPED_TRACE(length);
+		std::string text = base64_encode(bytes.data(), (unsigned int)length);
+		std::string expected = base64_decode(text);
+		ASSERT_EQ(length, expected.size());
+		ASSERT_EQ(0, memcmp(expected.data(), bytes.data(), length));
+
+		size_t consumed = 0;
+		ASSERT_EQ(length, base64_decode(text.data(), text.size(), out.data(), out.size(), &consumed));
+		ASSERT_EQ(text.size(), consumed);
+		ASSERT_EQ(0, memcmp(expected.data(), out.data(), length));
+
+		// unpadded, the way some writers leave it
+		std::string unpadded = text.substr(0, text.find('='));
+		ASSERT_EQ(length, base64_decode(unpadded.data(), unpadded.size(), out.data(), out.size()));
+		ASSERT_EQ(0, memcmp(expected.data(), out.data(), length));
+
+		// line breaks and indentation inside what would otherwise be a whole block
+		std::string wrapped;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			if (i % 27 == 0)
+				wrapped += "\n   ";
+			wrapped += text[i];
+		}
+		wrapped += "\n";
+		ASSERT_EQ(length, base64_decode(wrapped.data(), wrapped.size(), out.data(), out.size()));
+		ASSERT_EQ(0, memcmp(expected.data(), out.data(), length));
+
+		// an output buffer that fills mid block, continued where it stopped
+		size_t written = 0;
+		size_t position = 0;
+		while (position < text.size())
+		{
+			size_t step = base64_decode(text.data() + position, text.size() - position, out.data() + written, std::min<size_t>(out.size() - written, 40), &consumed);
+			ASSERT_NE(BASE64_DECODE_ERROR, step);
+			if (step == 0 && consumed == 0)
+				break;
+			written += step;
+			position += consumed;
+		}
+		ASSERT_EQ(length, written);
+		ASSERT_EQ(0, memcmp(expected.data(), out.data(), length));
+	}
+
+	// a bad character anywhere, inside a block or in the tail, fails the whole decode
+	std::string text = base64_encode(bytes.data(), 300);
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		std::string bad = text;
+		bad[i] = '*';
+		ASSERT_EQ(BASE64_DECODE_ERROR, base64_decode(bad.data(), bad.size(), out.data(), out.size()));
+	}
+}
+
+
+// gids compressed the way tiled writes them for the given compression attribute
+static std::vector<unsigned char> compressGids(const std::vector<unsigned int>& gids, const std::string& compression)
+{
+	size_t length = gids.size() * 4;
+	std::vector<unsigned char> compressed;
+	if (compression == "zstd")
+	{
+		compressed.resize(ZSTD_compressBound(length));
+		size_t written = ZSTD_compress(compressed.data(), compressed.size(), gids.data(), length, 3);
+		compressed.resize(ZSTD_isError(written) ? 0 : written);
+		return compressed;
+	}
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	int windowBits = (compression == "gzip") ? 15 + 16 : 15;
+	if (deflateInit2(&stream, 9, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return compressed;
+	compressed.resize(deflateBound(&stream, length));
+	stream.next_in = (Bytef*)gids.data();
+	stream.avail_in = (uInt)length;
+	stream.next_out = compressed.data();
+	stream.avail_out = (uInt)compressed.size();
+	int ret = deflate(&stream, Z_FINISH);
+	compressed.resize(ret == Z_STREAM_END ? stream.total_out : 0);
+	deflateEnd(&stream);
+	return compressed;
+}
+
+
+static std::string compressedLayerMap(const std::string& compression, const std::string& data, unsigned int width, unsigned int height)
+{
+	std::ostringstream xml;
+	xml << "<map version=\"1.0\" orientation=\"orthogonal\" width=\"" << width << "\" height=\"" << height << "\" tilewidth=\"16\" tileheight=\"16\">"
+		<< " <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"256\" height=\"256\"/></tileset>"
+		<< " <layer name=\"a\" width=\"" << width << "\" height=\"" << height << "\"><data encoding=\"base64\" compression=\"" << compression << "\">"
+		<< data << "</data></layer></map>";
+	return xml.str();
+}
+
+
+TEST(Base64Test, DecodesCompressedLayers)
+{
+	// several gid chunks worth, so the streams are drained more than once
+	std::vector<unsigned int> gids(96 * 96);
+	for (size_t i = 0; i < gids.size(); i++)
+		gids[i] = (unsigned int)((i * 7919) % 255 + 1);
+
+	const char* compressions[] = { "zlib", "gzip", "zstd" };
+	for (size_t c = 0; c < sizeof(compressions) / sizeof(compressions[0]); c++)
+	{
+		SCOPED_TRACE(compressions[c]);
+		std::vector<unsigned char> compressed = compressGids(gids, compressions[c]);
+		ASSERT_FALSE(compressed.empty());
+
+		std::string data = base64_encode(compressed.data(), (unsigned int)compressed.size());
+		std::string xml = compressedLayerMap(compressions[c], data, 96, 96);
+		tmxparser::TmxMap map;
+		ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &map, ""));
+		ASSERT_EQ(1, map.layerCollection.size());
+		ASSERT_EQ(gids.size(), map.layerCollection[0].tiles.size());
+		for (size_t i = 0; i < gids.size(); i++)
+		{
+			ASSERT_EQ(gids[i], map.layerCollection[0].tiles[i].gid);
+		}
+
+		// cut off inside the stream, the tiles that did decode are not enough
+		std::string truncated = base64_encode(compressed.data(), (unsigned int)(compressed.size() / 2));
+		xml = compressedLayerMap(compressions[c], truncated, 96, 96);
+		ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::parseFromMemory(&xml[0], xml.size(), &map, ""));
+
+		// missing only the stream trailer, every tile is there
+		truncated = base64_encode(compressed.data(), (unsigned int)(compressed.size() - 4));
+		xml = compressedLayerMap(compressions[c], truncated, 96, 96);
+		ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::parseFromMemory(&xml[0], xml.size(), &map, ""));
+
+		// not compressed with what the layer claims
+		xml = compressedLayerMap(compressions[c], base64_encode((const unsigned char*)gids.data(), 64), 96, 96);
+		ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::parseFromMemory(&xml[0], xml.size(), &map, ""));
+	}
+}
+
+
+TEST(TilesetLookupTest, DenseAndSparseLookupsAgree)
+{
+	tmxparser::TmxTilesetCollection_t tilesets(2);
+	tilesets[0].firstgid = 1;
+	tilesets[0].colCount = 4;
+	tilesets[0].rowCount = 4;
+	tilesets[1].firstgid = 17;
+	tilesets[1].colCount = 2;
+	tilesets[1].rowCount = 2;
+
+	tmxparser::TmxLayerTile tiles[4];
+	tiles[0].gid = 0;
+	tiles[1].gid = 16;
+	tiles[2].gid = 18;
+	tiles[3].gid = 21;
+
+	tmxparser::TmxTilesetLookup lookup;
+	tmxparser::buildTilesetLookup(tilesets, &lookup);
+	ASSERT_FALSE(lookup.rangeByGid.empty());
+	ASSERT_EQ(tmxparser::kUnknownTileIndices, tmxparser::resolveTileIndices(lookup, tiles, 4));
+	ASSERT_EQ(0, tiles[1].tilesetIndex);
+	ASSERT_EQ(15, tiles[1].tileFlatIndex);
+	ASSERT_EQ(1, tiles[2].tilesetIndex);
+	ASSERT_EQ(1, tiles[2].tileFlatIndex);
+
+	// far apart gids use the binary search
+	tilesets[1].firstgid = 100000000;
+	tiles[2].gid = 100000001;
+	tmxparser::buildTilesetLookup(tilesets, &lookup);
+	ASSERT_TRUE(lookup.rangeByGid.empty());
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::resolveTileIndices(lookup, tiles, 3));
+	ASSERT_EQ(15, tiles[1].tileFlatIndex);
+	ASSERT_EQ(1, tiles[2].tilesetIndex);
+	ASSERT_EQ(100000001 - 17, tiles[2].tileFlatIndex);
+}
+
+
+TEST(MappedFileTest, MatchesBufferedRead)
+{
+	FILE* file = fopen("../test_files/test_csv_level.tmx", "rb");
+	ASSERT_TRUE(file != NULL);
+	std::string expected;
+	char buffer[4096];
+	size_t bytesRead;
+	while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		expected.append(buffer, bytesRead);
+	}
+	fclose(file);
+
+	MappedFile mapped;
+	ASSERT_TRUE(mapped.open("../test_files/test_csv_level.tmx"));
+	ASSERT_EQ(expected, std::string(mapped.data(), mapped.size()));
+
+	ASSERT_FALSE(mapped.open("../test_files/does_not_exist.tmx"));
+	ASSERT_EQ(0, mapped.size());
+}
+
+
+TEST(CsvLayerTest, MalformedDataIsRejected)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"2\" height=\"2\" tilewidth=\"16\" tileheight=\"16\">"
+		" <layer name=\"World\" width=\"2\" height=\"2\">"
+		"  <data encoding=\"csv\">\n1,2,\n3,x\n</data>"
+		" </layer>"
+		"</map>";
+
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::parseFromMemory(&xml[0], xml.size(), &map, ""));
+
+	xml.replace(xml.find("3,x"), 3, "3,4");
+	tmxparser::TmxMap goodMap;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &goodMap, ""));
+	ASSERT_EQ(4, goodMap.layerCollection[0].tiles.size());
+	ASSERT_EQ(4, goodMap.layerCollection[0].tiles[3].gid);
+}
+
+
+TEST(CsvLayerTest, FlipFlagsAreSplitFromGids)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"3\" height=\"3\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"32\" height=\"32\"/></tileset>"
+		" <tileset firstgid=\"5\" name=\"b\" tilewidth=\"16\" tileheight=\"16\"><image source=\"b.png\" width=\"32\" height=\"32\"/></tileset>"
+		" <layer name=\"World\" width=\"3\" height=\"3\">"
+		"  <data encoding=\"csv\">\n2147483654,1073741825,536870915,\n0,4,5,\n3758096391,8,2\n</data>"
+		" </layer>"
+		"</map>";
+
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &map, ""));
+
+	const tmxparser::TmxLayerTileCollection_t& tiles = map.layerCollection[0].tiles;
+	ASSERT_EQ(9, tiles.size());
+
+	ASSERT_EQ(6, tiles[0].gid);
+	ASSERT_TRUE(tiles[0].flipX);
+	ASSERT_FALSE(tiles[0].flipY);
+	ASSERT_EQ(1, tiles[0].tilesetIndex);
+	ASSERT_EQ(1, tiles[0].tileFlatIndex);
+
+	ASSERT_EQ(1, tiles[1].gid);
+	ASSERT_TRUE(tiles[1].flipY);
+	ASSERT_EQ(0, tiles[1].tilesetIndex);
+
+	ASSERT_EQ(3, tiles[2].gid);
+	ASSERT_TRUE(tiles[2].flipDiagonal);
+	ASSERT_FALSE(tiles[2].flipX);
+
+	ASSERT_EQ(0, tiles[3].gid);
+	ASSERT_EQ(4, tiles[4].gid);
+	ASSERT_EQ(3, tiles[4].tileFlatIndex);
+
+	ASSERT_EQ(7, tiles[6].gid);
+	ASSERT_TRUE(tiles[6].flipX && tiles[6].flipY && tiles[6].flipDiagonal);
+	ASSERT_EQ(1, tiles[6].tilesetIndex);
+	ASSERT_EQ(2, tiles[6].tileFlatIndex);
+
+	ASSERT_EQ(8, tiles[7].gid);
+	ASSERT_EQ(3, tiles[7].tileFlatIndex);
+	ASSERT_FALSE(tiles[8].flipX || tiles[8].flipY || tiles[8].flipDiagonal);
+}
+
+
+TEST(ParallelLayerTest, MatchesSingleThreaded)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"16\" height=\"16\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"128\" height=\"128\"/></tileset>";
+	for (unsigned int layer = 0; layer < 7; layer++)
+	{
+		xml += " <layer name=\"L" + std::to_string(layer) + "\" width=\"16\" height=\"16\"><data encoding=\"csv\">";
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			xml += std::to_string((i * 7 + layer * 13) % 65) + (i < 255 ? "," : "");
+		}
+		xml += "</data></layer>";
+	}
+	xml += "</map>";
+
+	tmxparser::TmxMap expected;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &expected, ""));
+
+	tmxparser::TmxParser parser;
+	for (int mode = 0; mode < 2; mode++)
+	{
+		tmxparser::TmxParseOptions options;
+		options.threadCount = 4;
+		options.parseMode = mode ? tmxparser::kParseModeStreaming : tmxparser::kParseModeDocument;
+
+		tmxparser::TmxMap map;
+		ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&xml[0], xml.size(), &map, "", options));
+		ASSERT_EQ(7, map.layerCollection.size());
+
+		for (size_t layer = 0; layer < map.layerCollection.size(); layer++)
+		{
+			ASSERT_EQ(expected.layerCollection[layer].name, map.layerCollection[layer].name);
+			for (size_t i = 0; i < 256; i++)
+			{
+				ASSERT_EQ(expected.layerCollection[layer].tiles[i].gid, map.layerCollection[layer].tiles[i].gid);
+				ASSERT_EQ(expected.layerCollection[layer].tiles[i].tileFlatIndex, map.layerCollection[layer].tiles[i].tileFlatIndex);
+			}
+		}
+	}
+}
+
+
+TEST(ThreadPoolTest, NestedGroupsDoNotDeadlock)
+{
+	// every worker ends up waiting on jobs it queued itself, which only finishes if waiters help out
+	ThreadPool pool(2);
+	std::atomic<unsigned int> leaves(0);
+	ThreadPool::Group outer;
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		pool.enqueue([&](unsigned int)
+		{
+			ThreadPool::Group inner;
+			for (unsigned int j = 0; j < 16; j++)
+			{
+				pool.enqueue([&](unsigned int) { ++leaves; }, &inner);
+			}
+			pool.wait(inner);
+		}, &outer);
+	}
+	pool.wait(outer);
+	ASSERT_EQ(8u * 16u, leaves.load());
+
+	pool.enqueue([&](unsigned int) { ++leaves; });
+	pool.wait();
+	ASSERT_EQ(8u * 16u + 1u, leaves.load());
+}
+
+
+TEST(ThreadPoolTest, ExceptionsReachTheWaiter)
+{
+	ThreadPool pool(2);
+	std::atomic<unsigned int> finished(0);
+	ThreadPool::Group outer;
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		pool.enqueue([&, i](unsigned int)
+		{
+			// thrown on a worker that waits on its own jobs, passed on to the outer group
+			ThreadPool::Group inner;
+			for (unsigned int j = 0; j < 4; j++)
+			{
+				pool.enqueue([&, i, j](unsigned int)
+				{
+					if (i == 2 && j == 3)
+						throw std::runtime_error("job");
+					++finished;
+				}, &inner);
+			}
+			pool.wait(inner);
+		}, &outer);
+	}
+	ASSERT_THROW(pool.wait(outer), std::runtime_error);
+	ASSERT_EQ(15u, finished.load());
+
+	// the error was handed out once, the pool carries on
+	pool.wait(outer);
+	pool.enqueue([&](unsigned int) { throw std::runtime_error("ungrouped"); });
+	pool.enqueue([&](unsigned int) { ++finished; }, &outer);
+	pool.wait(outer);
+	pool.wait();
+	ASSERT_EQ(16u, finished.load());
+}
+
+
+static void writeTestFile(const char* fileName, const std::string& contents)
+{
+	FILE* file = fopen(fileName, "wb");
+	fwrite(contents.data(), 1, contents.size(), file);
+	fclose(file);
+}
+
+
+TEST(TilesetCacheTest, ReloadsChangedFiles)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" source=\"tileset_cache_test.tsx\"/>"
+		" <tileset firstgid=\"100\" source=\"tileset_cache_test.tsx\"/>"
+		" <layer name=\"World\" width=\"1\" height=\"1\"><data encoding=\"csv\">101</data></layer>"
+		"</map>";
+
+	writeTestFile("tileset_cache_test.tsx", "<tileset tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"64\" height=\"64\"/></tileset>");
+
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &map, "."));
+	ASSERT_EQ(2, map.tilesetCollection.size());
+	ASSERT_EQ(1, map.tilesetCollection[0].firstgid);
+	ASSERT_EQ(100, map.tilesetCollection[1].firstgid);
+	ASSERT_EQ(4, map.tilesetCollection[1].colCount);
+	ASSERT_EQ(1, map.layerCollection[0].tiles[0].tilesetIndex);
+
+	writeTestFile("tileset_cache_test.tsx", "<tileset tilewidth=\"32\" tileheight=\"32\"><image source=\"a.png\" width=\"256\" height=\"256\"/></tileset>");
+
+	tmxparser::TmxMap changedMap;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &changedMap, "."));
+	ASSERT_EQ(32, changedMap.tilesetCollection[0].tileWidth);
+	ASSERT_EQ(8, changedMap.tilesetCollection[1].colCount);
+	ASSERT_EQ(100, changedMap.tilesetCollection[1].firstgid);
+
+	// same size and, most likely, the same second
+	writeTestFile("tileset_cache_test.tsx", "<tileset tilewidth=\"32\" tileheight=\"32\"><image source=\"a.png\" width=\"128\" height=\"256\"/></tileset>");
+
+	tmxparser::TmxMap resizedMap;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &resizedMap, "."));
+	ASSERT_NE(resizedMap.tilesetCollection[1].rowCount, resizedMap.tilesetCollection[1].colCount);
+
+	// cached tile definitions are copied into each tileset by default
+	writeTestFile("tileset_cache_test.tsx", "<tileset tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"64\" height=\"64\"/><tile id=\"1\"/></tileset>");
+	tmxparser::TmxMap copiedMap;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &copiedMap, "."));
+	ASSERT_TRUE(copiedMap.tilesetCollection[0].sharedTileDefinitions == NULL);
+	ASSERT_EQ(1u, copiedMap.tilesetCollection[0].tileDefinitions.count(1));
+	ASSERT_EQ(1u, copiedMap.tilesetCollection[1].tileDefinitions.count(1));
+
+	// and shared when asked for, whichever path led to the file
+	tmxparser::TmxParseOptions sharedOptions;
+	sharedOptions.shareTileDefinitions = true;
+	tmxparser::TmxMap sharedMap;
+	tmxparser::TmxMap otherPathMap;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &sharedMap, ".", sharedOptions));
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &otherPathMap, "../tests", sharedOptions));
+	ASSERT_TRUE(sharedMap.tilesetCollection[0].sharedTileDefinitions != NULL);
+	ASSERT_EQ(sharedMap.tilesetCollection[0].sharedTileDefinitions, sharedMap.tilesetCollection[1].sharedTileDefinitions);
+	ASSERT_EQ(sharedMap.tilesetCollection[0].sharedTileDefinitions, otherPathMap.tilesetCollection[0].sharedTileDefinitions);
+	ASSERT_TRUE(sharedMap.tilesetCollection[0].tileDefinitions.empty());
+	ASSERT_EQ(1u, tmxparser::getTileDefinitions(sharedMap.tilesetCollection[0]).count(1));
+
+	tmxparser::clearTilesetCache();
+	remove("tileset_cache_test.tsx");
+}
+
+
+TEST(TilesetCacheTest, SurvivesThrowingParses)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" source=\"tileset_throw_test.tsx\"/>"
+		" <layer name=\"l\" width=\"1\" height=\"1\"><data encoding=\"csv\">1</data></layer>"
+		"</map>";
+	writeTestFile("tileset_throw_test.tsx", "<tileset tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"64\" height=\"64\"/>"
+		"<tile id=\"1\"><properties><property name=\"a\" value=\"1\"/></properties></tile></tileset>");
+
+	// each allocation of the parse fails in turn, the cache entry must never be left without a result
+	tmxparser::TmxParseOptions options;
+	options.threadCount = 1;
+	bool parsed = false;
+	for (size_t failAt = 1; !parsed; failAt++)
+	{
+		tmxparser::clearTilesetCache();
+		tmxparser::TmxMap map;
+		try
+		{
+			AllocationCounter counter(failAt);
+			parsed = (tmxparser::parseFromMemory(&xml[0], xml.size(), &map, ".", options) == tmxparser::kSuccess);
+			parsed = parsed && counter.stop() < failAt;
+		}
+		catch (const std::bad_alloc&)
+		{
+		}
+
+		// the next load reparses instead of finding a broken entry
+		tmxparser::TmxMap reloadedMap;
+		ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromMemory(&xml[0], xml.size(), &reloadedMap, ".", options));
+		ASSERT_EQ(1u, reloadedMap.tilesetCollection[0].tileDefinitions.size());
+	}
+
+	tmxparser::clearTilesetCache();
+	remove("tileset_throw_test.tsx");
+}
+
+
+TEST(ParallelLayerTest, ExceptionsReachTheCaller)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" source=\"parallel_throw_test.tsx\"/>"
+		" <layer name=\"a\" width=\"1\" height=\"1\"><data encoding=\"csv\">1</data></layer>"
+		" <layer name=\"b\" width=\"1\" height=\"1\"><data encoding=\"csv\">1</data></layer>"
+		"</map>";
+	writeTestFile("parallel_throw_test.tmx", xml);
+	writeTestFile("parallel_throw_test.tsx", "<tileset tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"64\" height=\"64\"/><tile id=\"1\"/></tileset>");
+
+	// the filter runs in the tsx load job, whatever it throws comes out of the parse rather than ending the process
+	tmxparser::TmxParseOptions options;
+	options.threadCount = 2;
+	options.tileDefinitionFilter.accept = [](const std::string&) -> bool { throw std::runtime_error("filter"); };
+
+	const tmxparser::TmxParseMode modes[] = { tmxparser::kParseModeDocument, tmxparser::kParseModeStreaming };
+	for (size_t m = 0; m < 2; m++)
+	{
+		options.parseMode = modes[m];
+		tmxparser::TmxMap map;
+		ASSERT_THROW(tmxparser::parseFromFile("parallel_throw_test.tmx", &map, ".", options), std::runtime_error);
+	}
+
+	std::vector<std::string> fileNames(4, "parallel_throw_test.tmx");
+	std::vector<tmxparser::TmxMap> maps;
+	std::vector<tmxparser::TmxReturn> results;
+	ASSERT_THROW(tmxparser::parseBatchFromFiles(fileNames, &maps, &results, ".", options), std::runtime_error);
+
+	// and the same parses go through once the filter behaves
+	options.tileDefinitionFilter.accept = [](const std::string&) { return true; };
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseBatchFromFiles(fileNames, &maps, &results, ".", options));
+	ASSERT_EQ(1u, maps[0].tilesetCollection[0].tileDefinitions.size());
+
+	tmxparser::clearTilesetCache();
+	remove("parallel_throw_test.tmx");
+	remove("parallel_throw_test.tsx");
+}
+
+
+TEST(SteppedLoadTest, ResumesLargeLayers)
+{
+	std::vector<unsigned int> gids(128 * 128);
+	std::string csv;
+	for (size_t i = 0; i < gids.size(); i++)
+	{
+		gids[i] = (unsigned int)(i * 31 % 257);
+		csv += std::to_string(gids[i]) + (i + 1 < gids.size() ? ((i % 128 == 127) ? ",\n" : ",") : "");
+	}
+
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"128\" height=\"128\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"256\" height=\"256\"/></tileset>"
+		" <layer name=\"csv\" width=\"128\" height=\"128\"><data encoding=\"csv\">" + csv + "</data></layer>"
+		" <layer name=\"base64\" width=\"128\" height=\"128\"><data encoding=\"base64\">" + base64_encode((const unsigned char*)gids.data(), (unsigned int)(gids.size() * 4)) + "</data></layer>"
+		"</map>";
+	writeTestFile("stepped_load_test.tmx", xml);
+
+	tmxparser::TmxMapLoader loader;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, loader.begin("stepped_load_test.tmx", &map, ""));
+
+	unsigned int steps = 0;
+	tmxparser::TmxReturn retVal;
+	while ((retVal = loader.stepWork(1000)) == tmxparser::kInProgress)
+		steps++;
+	ASSERT_EQ(tmxparser::kSuccess, retVal);
+	ASSERT_LT(2 * gids.size() / 4096, steps);
+	remove("stepped_load_test.tmx");
+
+	ASSERT_EQ(2, map.layerCollection.size());
+	for (size_t layer = 0; layer < 2; layer++)
+	{
+		ASSERT_EQ(gids.size(), map.layerCollection[layer].tiles.size());
+		for (size_t i = 0; i < gids.size(); i++)
+		{
+			ASSERT_EQ(gids[i], map.layerCollection[layer].tiles[i].gid);
+		}
+	}
+}
+
+
+TEST(InfiniteMapTest, DecodesChunks)
+{
+	// chunk coordinates, written out of order, the gaps are empty space Tiled leaves out
+	const int chunkCoords[][2] = { { 0, -1 }, { -1, -1 }, { 2, 0 }, { -3, 4 } };
+	const size_t chunkCount = sizeof(chunkCoords) / sizeof(chunkCoords[0]);
+
+	std::string csvChunks;
+	std::string base64Chunks;
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		std::vector<unsigned int> gids(16 * 16);
+		std::string csv;
+		for (size_t i = 0; i < gids.size(); i++)
+		{
+			gids[i] = (unsigned int)((c * 37 + i) % 257);
+			csv += std::to_string(gids[i]) + (i + 1 < gids.size() ? "," : "");
+		}
+
+		std::string chunkTag = "<chunk x=\"" + std::to_string(chunkCoords[c][0] * 16) + "\" y=\"" + std::to_string(chunkCoords[c][1] * 16) + "\" width=\"16\" height=\"16\">";
+		csvChunks += chunkTag + csv + "</chunk>";
+		base64Chunks += chunkTag + base64_encode((const unsigned char*)gids.data(), (unsigned int)(gids.size() * 4)) + "</chunk>";
+	}
+
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"30\" height=\"20\" tilewidth=\"16\" tileheight=\"16\" infinite=\"1\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"256\" height=\"256\"/></tileset>"
+		" <tileset firstgid=\"1000\" source=\"super_mario_one_tileset.tsx\"/>"
+		" <layer name=\"csv\" width=\"30\" height=\"20\"><data encoding=\"csv\">" + csvChunks + "</data></layer>"
+		" <layer name=\"base64\" width=\"30\" height=\"20\"><data encoding=\"base64\">" + base64Chunks + "</data></layer>"
+		" <layer name=\"empty\" width=\"30\" height=\"20\"><data encoding=\"csv\"/></layer>"
+		"</map>";
+	writeTestFile("infinite_map_test.tmx", xml);
+
+	const tmxparser::TmxLayerStorage storages[] = { tmxparser::kLayerStorageTiles, tmxparser::kLayerStorageGids, tmxparser::kLayerStorageLazy };
+	const tmxparser::TmxParseMode modes[] = { tmxparser::kParseModeDocument, tmxparser::kParseModeStreaming };
+	std::vector<tmxparser::TmxMap> maps;
+	for (size_t s = 0; s < 3; s++)
+	{
+		for (size_t m = 0; m < 2; m++)
+		{
+			for (unsigned int threads = 1; threads <= 4; threads += 3)
+			{
+				tmxparser::TmxParseOptions options;
+				options.layerStorage = storages[s];
+				options.parseMode = modes[m];
+				options.threadCount = threads;
+
+				maps.push_back(tmxparser::TmxMap());
+				ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile("infinite_map_test.tmx", &maps.back(), "../test_files", options));
+			}
+		}
+	}
+
+	tmxparser::TmxMapLoader loader;
+	maps.push_back(tmxparser::TmxMap());
+	ASSERT_EQ(tmxparser::kSuccess, loader.begin("infinite_map_test.tmx", &maps.back(), "../test_files"));
+	tmxparser::TmxReturn retVal;
+	while ((retVal = loader.stepWork(100)) == tmxparser::kInProgress)
+		;
+	ASSERT_EQ(tmxparser::kSuccess, retVal);
+
+	tmxparser::TmxMapView view;
+	std::vector<char> viewXml(xml.begin(), xml.end());
+	ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::parseViewFromMemory(viewXml.data(), viewXml.size(), &view, "../test_files"));
+	ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::writeBinaryMap(maps[0], "infinite_map_test.tmxb", "infinite_map_test.tmx", "../test_files"));
+	remove("infinite_map_test.tmx");
+
+	for (size_t i = 0; i < maps.size(); i++)
+	{
+		const tmxparser::TmxMap& map = maps[i];
+		ASSERT_TRUE(map.infinite);
+		ASSERT_EQ(3, map.layerCollection.size());
+		ASSERT_TRUE(map.layerCollection[2].chunks.empty());
+		ASSERT_TRUE(tmxparser::getLayerChunk(map.layerCollection[2], 0, 0) == NULL);
+		for (size_t l = 0; l < 2; l++)
+		{
+			const tmxparser::TmxLayer& layer = map.layerCollection[l];
+			ASSERT_EQ(16u, layer.chunkWidth);
+			ASSERT_EQ(16u, layer.chunkHeight);
+			ASSERT_EQ(chunkCount, layer.chunks.size());
+			ASSERT_EQ(0u, tmxparser::getLayerTileCount(layer));
+			ASSERT_TRUE(tmxparser::getLayerChunk(layer, 1, 0) == NULL);
+			ASSERT_TRUE(tmxparser::getLayerChunk(layer, 0, 1) == NULL);
+
+			for (size_t c = 0; c < chunkCount; c++)
+			{
+				const tmxparser::TmxLayerChunk* chunk = tmxparser::getLayerChunk(layer, chunkCoords[c][0], chunkCoords[c][1]);
+				ASSERT_TRUE(chunk != NULL);
+				ASSERT_EQ(chunkCoords[c][0] * 16, chunk->x);
+				ASSERT_EQ(chunkCoords[c][1] * 16, chunk->y);
+				ASSERT_EQ(256u, tmxparser::getLayerTileCount(*chunk));
+
+				for (unsigned int t = 0; t < 256; t++)
+				{
+					tmxparser::TmxLayerTile tile;
+					ASSERT_EQ(tmxparser::kSuccess, tmxparser::getLayerTile(map, *chunk, t, &tile));
+					ASSERT_EQ((c * 37 + t) % 257, tile.gid);
+					ASSERT_EQ((tile.gid != 0) ? tile.gid - 1 : 0, tile.tileFlatIndex);
+				}
+			}
+		}
+	}
+}
+
+
+TEST(MapLoaderTest, StepsThroughCompressedLayers)
+{
+	// larger than a gid chunk, so a step may stop while the decompressor still has output to drain
+	std::vector<unsigned int> gids(96 * 96);
+	for (size_t i = 0; i < gids.size(); i++)
+		gids[i] = (unsigned int)((i * 7919) % 255 + 1);
+
+	const char* compressions[] = { "zlib", "gzip", "zstd" };
+	const size_t budgets[] = { 1, 7, 1000, 5000 };
+	for (size_t c = 0; c < sizeof(compressions) / sizeof(compressions[0]); c++)
+	{
+		SCOPED_TRACE(compressions[c]);
+		std::vector<unsigned char> compressed = compressGids(gids, compressions[c]);
+		ASSERT_FALSE(compressed.empty());
+		std::string xml = compressedLayerMap(compressions[c], base64_encode(compressed.data(), (unsigned int)compressed.size()), 96, 96);
+		writeTestFile("stepped_compressed_test.tmx", xml);
+
+		tmxparser::TmxMap parsedMap;
+		ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile("stepped_compressed_test.tmx", &parsedMap, ""));
+
+		for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+		{
+			tmxparser::TmxMapLoader loader;
+			tmxparser::TmxMap map;
+			ASSERT_EQ(tmxparser::kSuccess, loader.begin("stepped_compressed_test.tmx", &map, ""));
+			tmxparser::TmxReturn retVal;
+			while ((retVal = loader.stepWork(budgets[b])) == tmxparser::kInProgress)
+				;
+			ASSERT_EQ(tmxparser::kSuccess, retVal);
+
+			ASSERT_EQ(1, map.layerCollection.size());
+			const tmxparser::TmxLayerTileCollection_t& tiles = map.layerCollection[0].tiles;
+			ASSERT_EQ(parsedMap.layerCollection[0].tiles.size(), tiles.size());
+			for (size_t i = 0; i < tiles.size(); i++)
+			{
+				ASSERT_EQ(parsedMap.layerCollection[0].tiles[i].gid, tiles[i].gid);
+				ASSERT_EQ(parsedMap.layerCollection[0].tiles[i].tileFlatIndex, tiles[i].tileFlatIndex);
+			}
+		}
+	}
+	remove("stepped_compressed_test.tmx");
+}
+
+
+TEST(AllocationTest, ElementsAreBuiltInPlace)
+{
+	const size_t elementCount = 100;
+	std::string properties = "<properties><property name=\"a\" value=\"1\"/><property name=\"b\" value=\"2\"/><property name=\"c\" value=\"3\"/><property name=\"d\" value=\"4\"/></properties>";
+	std::string tiles;
+	std::string objects;
+	for (size_t i = 0; i < elementCount; i++)
+	{
+		tiles += "<tile id=\"" + std::to_string(i) + "\">" + properties + "</tile>";
+		objects += "<object name=\"o\" x=\"1\" y=\"2\" width=\"3\" height=\"4\">" + properties + "</object>";
+	}
+
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"256\" height=\"256\"/>" + tiles + "</tileset>"
+		" <layer name=\"l\" width=\"1\" height=\"1\"><data encoding=\"csv\">1</data></layer>"
+		" <objectgroup name=\"g\">" + objects + "</objectgroup>"
+		"</map>";
+	writeTestFile("allocation_test.tmx", xml);
+
+	// the first step only parses the xml, the allocations of tinyxml2 are left out that way
+	tmxparser::TmxMapLoader loader;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, loader.begin("allocation_test.tmx", &map, ""));
+	ASSERT_EQ(tmxparser::kInProgress, loader.stepWork(1));
+	remove("allocation_test.tmx");
+
+	AllocationCounter loaderCounter;
+	tmxparser::TmxReturn retVal;
+	while ((retVal = loader.stepWork(1000)) == tmxparser::kInProgress)
+		;
+	size_t loaderAllocations = loaderCounter.stop();
+	ASSERT_EQ(tmxparser::kSuccess, retVal);
+	ASSERT_EQ(elementCount, map.tilesetCollection[0].tileDefinitions.size());
+	ASSERT_EQ(elementCount, map.objectGroupCollection[0].objects.size());
+
+	// the document path, less what tinyxml2 allocates for the same xml
+	tmxparser::TmxParser parser;
+	tmxparser::TmxMap documentMap;
+	size_t xmlAllocations = 0;
+	size_t documentAllocations = 0;
+	{
+		AllocationCounter counter;
+		tinyxml2::XMLDocument doc;
+		ASSERT_EQ(tinyxml2::XML_SUCCESS, doc.Parse(xml.c_str(), xml.size()));
+		xmlAllocations = counter.stop();
+	}
+	{
+		AllocationCounter counter;
+		ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&xml[0], xml.size(), &documentMap, ""));
+		documentAllocations = counter.stop();
+	}
+	ASSERT_LE(xmlAllocations, documentAllocations);
+
+	// a tile definition costs its node in the tileset and its property map, an object only its property map.
+	// Each property map is one array, names are interned and the short values fit in their strings.  The slack is
+	// the map itself, its collections and the parse's scratch state, none of which grows with the element count.
+	const size_t propertyMapAllocations = 1;
+	const size_t fixedAllocations = 20;
+	ASSERT_GE(elementCount * (1 + 2 * propertyMapAllocations) + fixedAllocations, loaderAllocations);
+	ASSERT_GE(elementCount * (1 + 2 * propertyMapAllocations) + fixedAllocations, documentAllocations - xmlAllocations);
+}
+
+
+TEST(StringTableTest, PropertiesAreFoundById)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <layer name=\"l\" width=\"1\" height=\"1\"><data encoding=\"csv\">0</data></layer>"
+		" <objectgroup name=\"g\">"
+		"  <object name=\"coin\" type=\"pickup\"><properties><property name=\"value\" value=\"5\"/><property name=\"collides\" value=\"false\"/>"
+		"   <property name=\"value\" value=\"10\"/></properties></object>"
+		"  <object name=\"coin\" type=\"pickup\"><properties><property name=\"collides\" value=\"true\"/></properties></object>"
+		"  <object/>"
+		" </objectgroup>"
+		"</map>";
+
+	tmxparser::TmxParser parser;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&xml[0], xml.size(), &map, ""));
+
+	const tmxparser::TmxObjectCollection_t& objects = map.objectGroupCollection[0].objects;
+	ASSERT_EQ(3, objects.size());
+	ASSERT_EQ(tmxparser::internString("coin"), objects[0].name);
+	ASSERT_EQ(objects[0].name, objects[1].name);
+	ASSERT_EQ(objects[0].type, objects[1].type);
+	ASSERT_STREQ("pickup", tmxparser::getInternedString(objects[1].type));
+	ASSERT_EQ(tmxparser::kEmptyStringId, objects[2].name);
+	ASSERT_EQ(tmxparser::kEmptyStringId, objects[2].type);
+	ASSERT_STREQ("", tmxparser::getInternedString(tmxparser::kEmptyStringId));
+	ASSERT_EQ(NULL, tmxparser::getInternedString(tmxparser::kInvalidStringId));
+
+	// sorted by id, a name given twice keeps its last value
+	const tmxparser::TmxPropertyMap_t& properties = objects[0].propertyMap;
+	ASSERT_EQ(2, properties.size());
+	ASSERT_LT(properties[0].name, properties[1].name);
+	tmxparser::TmxStringId value = tmxparser::findStringId("value");
+	ASSERT_NE(tmxparser::kInvalidStringId, value);
+	ASSERT_EQ("10", tmxparser::findProperty(properties, value)->value);
+	ASSERT_EQ("false", tmxparser::findProperty(properties, "collides")->value);
+	ASSERT_EQ("true", tmxparser::findProperty(objects[1].propertyMap, "collides")->value);
+	ASSERT_EQ(NULL, tmxparser::findProperty(objects[1].propertyMap, value));
+
+	// looking a name up does not add it
+	ASSERT_EQ(NULL, tmxparser::findProperty(properties, "never used by any map"));
+	ASSERT_EQ(tmxparser::kInvalidStringId, tmxparser::findStringId("never used by any map"));
+}
+
+
+TEST(PropertyTest, ValuesAreTyped)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <properties>"
+		"  <property name=\"title\" value=\"Level 1\"/>"
+		"  <property name=\"enemies\" type=\"int\" value=\"-12\"/>"
+		"  <property name=\"gravity\" type=\"float\" value=\"9.81\"/>"
+		"  <property name=\"dark\" type=\"bool\" value=\"true\"/>"
+		"  <property name=\"fog\" type=\"color\" value=\"#80102030\"/>"
+		"  <property name=\"sky\" type=\"color\" value=\"#102030\"/>"
+		"  <property name=\"music\" type=\"file\" value=\"level1.ogg\"/>"
+		"  <property name=\"boss\" type=\"object\" value=\"42\"/>"
+		" </properties>"
+		" <layer name=\"l\" width=\"1\" height=\"1\"><data encoding=\"csv\">0</data></layer>"
+		"</map>";
+
+	tmxparser::TmxParser parser;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&xml[0], xml.size(), &map, ""));
+	const tmxparser::TmxPropertyMap_t& properties = map.propertyMap;
+	ASSERT_EQ(8, properties.size());
+
+	ASSERT_EQ(tmxparser::kPropertyString, tmxparser::findProperty(properties, "title")->type);
+	ASSERT_EQ("Level 1", tmxparser::findProperty(properties, "title")->value);
+	ASSERT_EQ(-12, tmxparser::getIntProperty(properties, tmxparser::internString("enemies")));
+	ASSERT_EQ(-12.f, tmxparser::getFloatProperty(properties, tmxparser::internString("enemies")));
+	ASSERT_FLOAT_EQ(9.81f, tmxparser::getFloatProperty(properties, tmxparser::internString("gravity")));
+	ASSERT_EQ(9, tmxparser::getIntProperty(properties, tmxparser::internString("gravity")));
+	ASSERT_TRUE(tmxparser::getBoolProperty(properties, tmxparser::internString("dark")));
+	ASSERT_EQ(0x10203080u, tmxparser::getColorProperty(properties, tmxparser::internString("fog")));
+	ASSERT_EQ(0x102030FFu, tmxparser::getColorProperty(properties, tmxparser::internString("sky")));
+	ASSERT_EQ(tmxparser::kPropertyFile, tmxparser::findProperty(properties, "music")->type);
+	ASSERT_EQ("level1.ogg", tmxparser::findProperty(properties, "music")->value);
+	ASSERT_EQ(tmxparser::kPropertyObject, tmxparser::findProperty(properties, "boss")->type);
+	ASSERT_EQ(42u, tmxparser::findProperty(properties, "boss")->objectId);
+
+	// missing, or of another type
+	ASSERT_EQ(7, tmxparser::getIntProperty(properties, tmxparser::internString("missing"), 7));
+	ASSERT_EQ(7, tmxparser::getIntProperty(properties, tmxparser::internString("title"), 7));
+	ASSERT_TRUE(tmxparser::getBoolProperty(properties, tmxparser::internString("enemies"), true));
+
+	// text that does not fit its type, or is out of its range, is kept as a string
+	const char* malformed[][2] = {
+		{ "int", "ten" }, { "int", "2147483648" }, { "int", "-99999999999999999999" }, { "float", "" }, { "float", "9,81" },
+		{ "float", "1e40" }, { "bool", "yes" }, { "color", "#12345" }, { "object", "-1" }, { "object", "4294967296" } };
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+	{
+		std::string mistyped =
+			"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+			" <properties><property name=\"p\" type=\"" + std::string(malformed[i][0]) + "\" value=\"" + malformed[i][1] + "\"/>"
+			"  <property name=\"q\" type=\"int\" value=\"3\"/></properties>"
+			" <layer name=\"l\" width=\"1\" height=\"1\"><data encoding=\"csv\">0</data></layer>"
+			"</map>";
+		tmxparser::TmxMap mistypedMap;
+		ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&mistyped[0], mistyped.size(), &mistypedMap, "")) << malformed[i][1];
+		ASSERT_EQ(tmxparser::kPropertyString, tmxparser::findProperty(mistypedMap.propertyMap, "p")->type) << malformed[i][1];
+		ASSERT_EQ(malformed[i][1], tmxparser::findProperty(mistypedMap.propertyMap, "p")->value);
+		ASSERT_EQ(3, tmxparser::getIntProperty(mistypedMap.propertyMap, tmxparser::internString("q")));
+	}
+
+	// floats are read the way Tiled writes them, whatever the locale
+	const char* numericLocale = setlocale(LC_NUMERIC, NULL);
+	std::string previousLocale = (numericLocale != NULL) ? numericLocale : "C";
+	if (setlocale(LC_NUMERIC, "de_DE.UTF-8") != NULL)
+	{
+		tmxparser::TmxMap localeMap;
+		ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&xml[0], xml.size(), &localeMap, ""));
+		setlocale(LC_NUMERIC, previousLocale.c_str());
+		ASSERT_FLOAT_EQ(9.81f, tmxparser::getFloatProperty(localeMap.propertyMap, tmxparser::internString("gravity")));
+	}
+}
+
+
+TEST(ArenaTest, ReleasesEverythingAtOnce)
+{
+	typedef std::vector<int, tmxparser::TmxArenaAllocator<int> > ArenaVector;
+
+	tmxparser::TmxArena arena(1024);
+	void* small = arena.allocate(3, 1);
+	void* aligned = arena.allocate(64, 16);
+	ASSERT_EQ(0u, (uintptr_t)aligned % 16);
+	ASSERT_NE(small, aligned);
+	ASSERT_TRUE(arena.allocate(4096, 8) != NULL); // larger than a block
+	ASSERT_EQ(3u + 64u + 4096u, arena.bytesAllocated());
+	ASSERT_LE(arena.bytesAllocated(), arena.bytesReserved());
+
+	// a large odd sized allocation leaves its block ending unaligned, the next aligned one must not go past it
+	tmxparser::TmxArena oddArena(1024);
+	char* odd = (char*)oddArena.allocate(300001, 1);
+	char* next = (char*)oddArena.allocate(64, 8);
+	ASSERT_EQ(0u, (uintptr_t)next % 8);
+	ASSERT_TRUE(next + 64 <= odd || next >= odd + 300001);
+	memset(next, 0, 64);
+
+	// containers created with the arena current allocate from it, copies made without it from the heap
+	ArenaVector* vector = arena.create<ArenaVector>();
+	ASSERT_TRUE(vector->get_allocator().arena == &arena);
+	{
+		AllocationCounter counter;
+		for (int i = 0; i < 1000; i++)
+			vector->push_back(i);
+		ASSERT_EQ(0u, counter.stop());
+	}
+
+	ArenaVector copy(*vector);
+	ASSERT_TRUE(copy.get_allocator().arena == NULL);
+
+	arena.release();
+	ASSERT_EQ(0u, arena.bytesAllocated());
+	ASSERT_EQ(0u, arena.bytesReserved());
+	ASSERT_EQ(1000u, copy.size());
+	ASSERT_EQ(999, copy.back());
+}
+
+
+#ifdef TMXPARSER_USE_ARENA
+TEST_F(TmxParseTest, ArenaMapMatchesHeapMap)
+{
+	tmxparser::TmxArena arena;
+	tmxparser::TmxParseOptions options;
+	options.arena = &arena;
+	options.threadCount = 4;
+	options.useTilesetCache = false;
+	tmxparser::TmxMap* map = arena.create<tmxparser::TmxMap>();
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile(_mapPath, map, "../test_files", options));
+	ASSERT_TRUE(map->layerCollection.get_allocator().arena == &arena);
+	ASSERT_TRUE(map->layerCollection[0].tiles.get_allocator().arena == &arena);
+	ASSERT_TRUE(map->tilesetCollection[0].image.source.get_allocator().arena == &arena);
+
+	// a copy made outside of the arena lives on the heap and outlasts it
+	tmxparser::TmxMap copy = *map;
+	ASSERT_TRUE(copy.layerCollection[0].tiles.get_allocator().arena == NULL);
+	arena.release();
+
+	ASSERT_STREQ(_map->version.c_str(), copy.version.c_str());
+	ASSERT_EQ(_map->propertyMap.size(), copy.propertyMap.size());
+	ASSERT_EQ(_map->tilesetCollection.size(), copy.tilesetCollection.size());
+	ASSERT_STREQ(_map->tilesetCollection[0].image.source.c_str(), copy.tilesetCollection[0].image.source.c_str());
+	ASSERT_EQ(_map->objectGroupCollection.size(), copy.objectGroupCollection.size());
+	ASSERT_EQ(_map->layerCollection.size(), copy.layerCollection.size());
+	for (size_t i = 0; i < copy.layerCollection.size(); i++)
+	{
+		ASSERT_EQ(_map->layerCollection[i].tiles.size(), copy.layerCollection[i].tiles.size());
+		for (size_t t = 0; t < copy.layerCollection[i].tiles.size(); t++)
+			ASSERT_EQ(_map->layerCollection[i].tiles[t].gid, copy.layerCollection[i].tiles[t].gid);
+	}
+
+	// past the xml only the parse's scratch strings and the tsx documents come from the heap
+	size_t heapAllocations[2];
+	for (int useArena = 0; useArena < 2; useArena++)
+	{
+		options.arena = useArena ? &arena : NULL;
+		tmxparser::TmxMap* loadedMap = useArena ? arena.create<tmxparser::TmxMap>() : new tmxparser::TmxMap();
+		tmxparser::TmxMapLoader loader;
+		ASSERT_EQ(tmxparser::kSuccess, loader.begin(_mapPath, loadedMap, "../test_files", options));
+		ASSERT_EQ(tmxparser::kInProgress, loader.stepWork(1));
+
+		AllocationCounter counter;
+		tmxparser::TmxReturn retVal;
+		while ((retVal = loader.stepWork(1000)) == tmxparser::kInProgress)
+			;
+		heapAllocations[useArena] = counter.stop();
+		ASSERT_EQ(tmxparser::kSuccess, retVal);
+
+		if (!useArena)
+			delete loadedMap;
+	}
+	ASSERT_LT(heapAllocations[1], heapAllocations[0]);
+}
+#endif
+
+
+TEST(MemoryBudgetTest, OversizedLayerFailsFast)
+{
+	// a few hundred bytes of xml asking for 40 GB of tiles
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"100000\" height=\"100000\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"256\" height=\"256\"/></tileset>"
+		" <layer name=\"l\" width=\"100000\" height=\"100000\"><data encoding=\"csv\">1</data></layer>"
+		"</map>";
+
+	tmxparser::TmxParseOptions options;
+	options.memoryBudget = 16 * 1024 * 1024;
+	tmxparser::TmxParser parser;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kMemoryBudgetExceeded, parser.parseFromMemory(&xml[0], xml.size(), &map, "", options));
+
+	tmxparser::TmxMap streamedMap;
+	options.parseMode = tmxparser::kParseModeStreaming;
+	ASSERT_EQ(tmxparser::kMemoryBudgetExceeded, parser.parseFromMemory(&xml[0], xml.size(), &streamedMap, "", options));
+
+	std::string viewXml = xml;
+	tmxparser::TmxMapView view;
+	ASSERT_EQ(tmxparser::kMemoryBudgetExceeded, tmxparser::parseViewFromMemory(&viewXml[0], viewXml.size(), &view, "", options));
+
+	// the xml alone is already too much
+	tmxparser::TmxMap smallMap;
+	options.memoryBudget = xml.size() / 2;
+	ASSERT_EQ(tmxparser::kMemoryBudgetExceeded, parser.parseFromMemory(&xml[0], xml.size(), &smallMap, "", options));
+}
+
+
+TEST(MemoryBudgetTest, ChargesNewStrings)
+{
+	std::string objects;
+	for (int i = 0; i < 1000; i++)
+	{
+		objects += "<object id=\"" + std::to_string(i) + "\" name=\"budget_string_" + std::to_string(i) + "\" x=\"0\" y=\"0\"/>";
+	}
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <objectgroup name=\"g\">" + objects + "</objectgroup>"
+		"</map>";
+
+	// the xml fits, the thousand strings it adds to the table do not
+	tmxparser::TmxParseOptions options;
+	options.memoryBudget = xml.size() + 4096;
+	tmxparser::TmxParser parser;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kMemoryBudgetExceeded, parser.parseFromMemory(&xml[0], xml.size(), &map, "", options));
+	ASSERT_NE(tmxparser::kInvalidStringId, tmxparser::findStringId("budget_string_0"));
+
+	// strings already in the table are free
+	tmxparser::TmxMap unlimitedMap;
+	ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&xml[0], xml.size(), &unlimitedMap, ""));
+	tmxparser::TmxMap budgetMap;
+	ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&xml[0], xml.size(), &budgetMap, "", options));
+	ASSERT_STREQ("budget_string_999", tmxparser::getInternedString(budgetMap.objectGroupCollection[0].objects[999].name));
+
+	tmxparser::clearStringTable();
+	ASSERT_EQ(tmxparser::kInvalidStringId, tmxparser::findStringId("budget_string_0"));
+	ASSERT_EQ(tmxparser::kEmptyStringId, tmxparser::findStringId(""));
+	ASSERT_STREQ("", tmxparser::getInternedString(tmxparser::kEmptyStringId));
+	ASSERT_TRUE(tmxparser::getInternedString(1) == NULL);
+}
+
+
+// counts what the parser allocates through it, and what it gives back
+class CountingAllocator : public tmxparser::TmxAllocator
+{
+public:
+	CountingAllocator() : allocations(0), live(0) {}
+
+	virtual void* allocate(size_t size)
+	{
+		allocations++;
+		live++;
+		return malloc(size);
+	}
+
+	virtual void deallocate(void* p)
+	{
+		live--;
+		free(p);
+	}
+
+	std::atomic<size_t> allocations;
+	std::atomic<size_t> live;
+};
+
+
+TEST(MemoryBudgetTest, AllocatorServesDecompression)
+{
+	std::vector<unsigned int> gids(64 * 64);
+	for (size_t i = 0; i < gids.size(); i++)
+		gids[i] = (unsigned int)(i % 7 + 1);
+
+	std::vector<unsigned char> compressed(compressBound(gids.size() * 4));
+	uLongf compressedLength = compressed.size();
+	ASSERT_EQ(Z_OK, compress2(compressed.data(), &compressedLength, (const Bytef*)gids.data(), gids.size() * 4, 9));
+	std::string data = base64_encode(compressed.data(), (unsigned int)compressedLength);
+
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"64\" height=\"64\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"256\" height=\"256\"/></tileset>"
+		" <layer name=\"a\" width=\"64\" height=\"64\"><data encoding=\"base64\" compression=\"zlib\">" + data + "</data></layer>"
+		" <layer name=\"b\" width=\"64\" height=\"64\"><data encoding=\"base64\" compression=\"zlib\">" + data + "</data></layer>"
+		"</map>";
+
+	CountingAllocator allocator;
+	tmxparser::TmxParseOptions options;
+	options.allocator = &allocator;
+	options.memoryBudget = 1024 * 1024;
+	for (unsigned int threadCount = 1; threadCount <= 2; threadCount++)
+	{
+		options.threadCount = threadCount;
+		tmxparser::TmxParser parser;
+		tmxparser::TmxMap map;
+		ASSERT_EQ(tmxparser::kSuccess, parser.parseFromMemory(&xml[0], xml.size(), &map, "", options));
+		ASSERT_LT(0u, allocator.allocations.load());
+
+		ASSERT_EQ(2, map.layerCollection.size());
+		for (size_t layer = 0; layer < 2; layer++)
+		{
+			ASSERT_EQ(gids.size(), map.layerCollection[layer].tiles.size());
+			for (size_t i = 0; i < gids.size(); i++)
+			{
+				ASSERT_EQ(gids[i], map.layerCollection[layer].tiles[i].gid);
+			}
+		}
+	}
+	ASSERT_EQ(0u, allocator.live.load());
+
+	// lazy layers are decoded long after the parse, still through its allocator
+	{
+		options.threadCount = 1;
+		options.layerStorage = tmxparser::kLayerStorageLazy;
+		tmxparser::TmxMap map;
+		ASSERT_EQ(tmxparser::kSuccess, tmxparser::TmxParser().parseFromMemory(&xml[0], xml.size(), &map, "", options));
+		size_t allocations = allocator.allocations.load();
+		const tmxparser::TmxLayerTileCollection_t* tiles = tmxparser::getLayerTiles(map, map.layerCollection[0]);
+		ASSERT_TRUE(tiles != NULL);
+		ASSERT_EQ(gids.size(), tiles->size());
+		ASSERT_LT(allocations, allocator.allocations.load());
+		options.layerStorage = tmxparser::kLayerStorageTiles;
+	}
+	ASSERT_EQ(0u, allocator.live.load());
+
+	// enough for the xml and the tiles, but not for the buffers they are decoded through
+	options.threadCount = 1;
+	options.memoryBudget = xml.size() + 2 * gids.size() * sizeof(tmxparser::TmxLayerTile) + 1024;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kMemoryBudgetExceeded, tmxparser::TmxParser().parseFromMemory(&xml[0], xml.size(), &map, "", options));
+	ASSERT_EQ(0u, allocator.live.load());
+}
+
+
+
+TEST(MapViewTest, DecodesEntitiesInPlace)
+{
+	std::string xml =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<!-- views -->\n"
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"2\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">\n"
+		" <properties><property name=\"title\" value=\"Tom &amp; Jerry &#x263A;\"/></properties>\n"
+		" <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" tileheight=\"16\">\n"
+		"  <image source=\"tiles.png\" width=\"32\" height=\"16\"/>\n"
+		" </tileset>\n"
+		" <layer name=\"ground\" width=\"2\" height=\"1\"><data encoding=\"csv\">2,1</data></layer>\n"
+		" <objectgroup name=\"spawns\">\n"
+		"  <object name=\"&lt;player&gt;\" type='start' x=\"4\" y=\"8\"><properties><property name=\"team\" value=\"red\"/></properties></object>\n"
+		"  <object name=\"exit\" x=\"1\" y=\"2\"><polyline points=\"0,0 4,-2.5\"/></object>\n"
+		" </objectgroup>\n"
+		"</map>\n";
+	std::vector<char> buffer(xml.begin(), xml.end());
+
+	tmxparser::TmxMapView view;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseViewFromMemory(buffer.data(), buffer.size(), &view, ""));
+
+	ASSERT_STREQ("Tom & Jerry \xE2\x98\xBA", view.properties[0].value.data);
+	ASSERT_EQ(strlen(view.properties[0].value.data), view.properties[0].value.length);
+	ASSERT_EQ(1, view.tilesets.size());
+	ASSERT_TRUE(view.tilesets[0].image.source == "tiles.png");
+
+	ASSERT_EQ(2, view.layers[0].tiles.size());
+	ASSERT_EQ(2, view.layers[0].tiles[0].gid);
+	ASSERT_EQ(1, view.layers[0].tiles[0].tileFlatIndex);
+
+	ASSERT_EQ(2, view.objectGroups[0].objects.size());
+	const tmxparser::TmxObjectView& player = view.objectGroups[0].objects[0];
+	ASSERT_TRUE(player.name == "<player>");
+	ASSERT_TRUE(player.type == "start");
+	ASSERT_EQ(4, player.x);
+	ASSERT_TRUE(*tmxparser::findProperty(player.properties, "team") == "red");
+	ASSERT_EQ(NULL, tmxparser::findProperty(player.properties, "missing"));
+
+	const tmxparser::TmxObjectView& exit = view.objectGroups[0].objects[1];
+	ASSERT_EQ(tmxparser::kPolyline, exit.shapeType);
+	ASSERT_EQ(tmxparser::TmxShapePoint(4, -2.5f), exit.shapePoints[1]);
+	ASSERT_TRUE(exit.type == "");
+
+	std::vector<char> truncated(xml.begin(), xml.begin() + xml.find("<objectgroup"));
+	tmxparser::TmxMapView broken;
+	ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::parseViewFromMemory(truncated.data(), truncated.size(), &broken, ""));
+
+	// cut off inside a character reference and placed right before an unreadable page, so reading past the end faults
+	long pageSize = sysconf(_SC_PAGESIZE);
+	char* pages = (char*)mmap(NULL, 2 * pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ASSERT_TRUE(pages != MAP_FAILED);
+	ASSERT_EQ(0, mprotect(pages + pageSize, pageSize, PROT_NONE));
+	const char* cuts[] = { "2,&#49", "2,&#x31", "2,&#", "2,1&amp" };
+	for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++)
+	{
+		std::string text = xml.substr(0, xml.find("2,1</data>")) + cuts[i];
+		ASSERT_LE(text.size(), (size_t)pageSize);
+		char* cut = pages + pageSize - text.size();
+		memcpy(cut, text.data(), text.size());
+		tmxparser::TmxMapView cutView;
+		ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::parseViewFromMemory(cut, text.size(), &cutView, ""));
+	}
+	munmap(pages, 2 * pageSize);
+}
+
+
+TEST(BinaryMapTest, DetectsStaleSources)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"2\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"32\" height=\"32\"/></tileset>"
+		" <layer name=\"World\" width=\"2\" height=\"1\"><data encoding=\"csv\">1,2</data></layer>"
+		"</map>";
+	writeTestFile("binary_map_source.tmx", xml);
+
+	tmxparser::TmxParseOptions options;
+	options.layerStorage = tmxparser::kLayerStorageGids;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile("binary_map_source.tmx", &map, ".", options));
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::writeBinaryMap(map, "binary_map_source.tmxb", "binary_map_source.tmx", "."));
+
+	tmxparser::TmxBinaryMap binaryMap;
+	ASSERT_EQ(tmxparser::kSuccess, binaryMap.open("binary_map_source.tmxb"));
+	const tmxparser::TmxBinaryLayer* layers = binaryMap.array<tmxparser::TmxBinaryLayer>(binaryMap.header()->layers);
+	const tmxparser::TmxLayerTile* tiles = binaryMap.array<tmxparser::TmxLayerTile>(layers[0].tiles);
+	ASSERT_EQ(2, tiles[1].gid);
+	ASSERT_EQ(1, tiles[1].tileFlatIndex);
+
+	// the sources are recorded by their full path, so the blob checks them from any working directory
+	char workingDirectory[4096];
+	ASSERT_TRUE(getcwd(workingDirectory, sizeof(workingDirectory)) != NULL);
+	ASSERT_EQ(0, chdir(".."));
+	tmxparser::TmxReturn movedResult = binaryMap.open("tests/binary_map_source.tmxb");
+	ASSERT_EQ(0, chdir(workingDirectory));
+	ASSERT_EQ(tmxparser::kSuccess, movedResult);
+
+	// same size and, most likely, the same second
+	std::string edited = xml;
+	edited.replace(edited.find("1,2"), 3, "1,3");
+	writeTestFile("binary_map_source.tmx", edited);
+	ASSERT_EQ(tmxparser::kStaleBinaryMap, binaryMap.open("binary_map_source.tmxb"));
+
+	writeTestFile("binary_map_source.tmx", xml + "\n");
+	ASSERT_EQ(tmxparser::kStaleBinaryMap, binaryMap.open("binary_map_source.tmxb"));
+	ASSERT_TRUE(binaryMap.header() == NULL);
+	ASSERT_EQ(tmxparser::kSuccess, binaryMap.open("binary_map_source.tmxb", false));
+
+	binaryMap.close();
+	remove("binary_map_source.tmx");
+	remove("binary_map_source.tmxb");
+	ASSERT_EQ(tmxparser::kErrorParsing, binaryMap.open("binary_map_source.tmxb"));
+}
+
+
+TEST(BinaryMapTest, KeepsPropertyTypes)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"1\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <properties>"
+		"  <property name=\"boss\" type=\"object\" value=\"42\"/>"
+		"  <property name=\"dark\" type=\"bool\" value=\"true\"/>"
+		"  <property name=\"enemies\" type=\"int\" value=\"-12\"/>"
+		"  <property name=\"fog\" type=\"color\" value=\"#80102030\"/>"
+		"  <property name=\"gravity\" type=\"float\" value=\"9.81\"/>"
+		"  <property name=\"title\" value=\"Level 1\"/>"
+		" </properties>"
+		" <layer name=\"l\" width=\"1\" height=\"1\"><data encoding=\"csv\">0</data></layer>"
+		"</map>";
+	writeTestFile("binary_map_types.tmx", xml);
+
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile("binary_map_types.tmx", &map, "."));
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::writeBinaryMap(map, "binary_map_types.tmxb", "binary_map_types.tmx", "."));
+
+	tmxparser::TmxBinaryMap binaryMap;
+	ASSERT_EQ(tmxparser::kSuccess, binaryMap.open("binary_map_types.tmxb"));
+	ASSERT_EQ(6u, binaryMap.header()->properties.count);
+	const tmxparser::TmxBinaryProperty* properties = binaryMap.array<tmxparser::TmxBinaryProperty>(binaryMap.header()->properties);
+	ASSERT_EQ(tmxparser::kPropertyObject, properties[0].type);
+	ASSERT_EQ(42u, properties[0].objectId);
+	ASSERT_EQ(tmxparser::kPropertyBool, properties[1].type);
+	ASSERT_EQ(1u, properties[1].boolValue);
+	ASSERT_EQ(tmxparser::kPropertyInt, properties[2].type);
+	ASSERT_EQ(-12, properties[2].intValue);
+	ASSERT_EQ(tmxparser::kPropertyColor, properties[3].type);
+	ASSERT_EQ(0x10203080u, properties[3].colorValue);
+	ASSERT_EQ(tmxparser::kPropertyFloat, properties[4].type);
+	ASSERT_FLOAT_EQ(9.81f, properties[4].floatValue);
+	ASSERT_EQ(tmxparser::kPropertyString, properties[5].type);
+	ASSERT_STREQ("Level 1", binaryMap.string(properties[5].value));
+
+	binaryMap.close();
+	remove("binary_map_types.tmx");
+	remove("binary_map_types.tmxb");
+}
+
+
+TEST(BinaryMapTest, RejectsOutOfBoundsData)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"2\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"32\" height=\"32\"/></tileset>"
+		" <layer name=\"World\" width=\"2\" height=\"1\"><data encoding=\"csv\">1,2</data></layer>"
+		"</map>";
+	writeTestFile("binary_map_bounds.tmx", xml);
+
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile("binary_map_bounds.tmx", &map, "."));
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::writeBinaryMap(map, "binary_map_bounds.tmxb", "binary_map_bounds.tmx", "."));
+
+	std::string blob;
+	{
+		MappedFile file;
+		ASSERT_TRUE(file.open("binary_map_bounds.tmxb"));
+		blob.assign(file.data(), file.size());
+	}
+	tmxparser::TmxBinaryHeader header;
+	memcpy(&header, blob.data(), sizeof(header));
+
+	// the header itself is intact, each copy breaks one array or string it refers to
+	std::vector<std::string> broken(5, blob);
+	tmxparser::TmxBinaryArray layers = header.layers;
+	layers.count = (uint64_t)1 << 60;
+	memcpy(&broken[0][offsetof(tmxparser::TmxBinaryHeader, layers)], &layers, sizeof(layers));
+	tmxparser::TmxBinaryArray sources = header.sources;
+	sources.offset = blob.size() + 16;
+	memcpy(&broken[1][offsetof(tmxparser::TmxBinaryHeader, sources)], &sources, sizeof(sources));
+	tmxparser::TmxBinaryString version = header.version;
+	version.length = blob.size();
+	memcpy(&broken[2][offsetof(tmxparser::TmxBinaryHeader, version)], &version, sizeof(version));
+
+	tmxparser::TmxBinaryLayer layer;
+	memcpy(&layer, blob.data() + header.layers.offset, sizeof(layer));
+	layer.tiles.count += 1;
+	memcpy(&broken[3][header.layers.offset], &layer, sizeof(layer));
+	memcpy(&layer, blob.data() + header.layers.offset, sizeof(layer));
+	broken[4][layer.name.offset + layer.name.length] = 'x';
+
+	for (size_t i = 0; i < broken.size(); i++)
+	{
+		writeTestFile("binary_map_bounds.tmxb", broken[i]);
+		tmxparser::TmxBinaryMap binaryMap;
+		ASSERT_EQ(tmxparser::kErrorParsing, binaryMap.open("binary_map_bounds.tmxb")) << i;
+		ASSERT_TRUE(binaryMap.header() == NULL);
+	}
+
+	writeTestFile("binary_map_bounds.tmxb", blob);
+	tmxparser::TmxBinaryMap binaryMap;
+	ASSERT_EQ(tmxparser::kSuccess, binaryMap.open("binary_map_bounds.tmxb", false));
+
+	binaryMap.close();
+	remove("binary_map_bounds.tmx");
+	remove("binary_map_bounds.tmxb");
+}
+
+
+TEST(BinaryMapTest, RejectsUndecodableLazyLayers)
+{
+	std::string xml =
+		"<map version=\"1.0\" orientation=\"orthogonal\" width=\"2\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">"
+		" <tileset firstgid=\"1\" name=\"a\" tilewidth=\"16\" tileheight=\"16\"><image source=\"a.png\" width=\"32\" height=\"32\"/></tileset>"
+		" <layer name=\"World\" width=\"2\" height=\"1\"><data encoding=\"base64\" compression=\"zlib\">bm90IHpsaWI=</data></layer>"
+		"</map>";
+	writeTestFile("binary_map_lazy.tmx", xml);
+
+	tmxparser::TmxParseOptions options;
+	options.layerStorage = tmxparser::kLayerStorageLazy;
+	tmxparser::TmxMap map;
+	ASSERT_EQ(tmxparser::kSuccess, tmxparser::parseFromFile("binary_map_lazy.tmx", &map, ".", options));
+	ASSERT_EQ(tmxparser::kErrorParsing, tmxparser::writeBinaryMap(map, "binary_map_lazy.tmxb", "binary_map_lazy.tmx", "."));
+
+	MappedFile file;
+	ASSERT_FALSE(file.open("binary_map_lazy.tmxb"));
+	remove("binary_map_lazy.tmx");
+}
+
+
 int main(int argc, char **argv)
 {
 	int retVal = 0;